@@ -2,7 +2,12 @@ LOCAL_PATH:= $(call my-dir)
 
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES:= native_dec_test.cpp
+LOCAL_SRC_FILES:= \
+	native_dec_test.cpp \
+	../rkvpu-codec/rkvpu_async_writer.cpp \
+	../rkvpu-codec/rkvpu_stream_probe.cpp \
+	../rkvpu-codec/rkvpu_sps.cpp \
+	../rkvpu-codec/rkvpu_nal_scan.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	libstagefright liblog libutils libbinder libstagefright_foundation \
@@ -10,7 +15,9 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_C_INCLUDES:= \
 	frameworks/av/media/libstagefright \
-	$(TOP)/frameworks/native/include/media/openmax
+	$(TOP)/frameworks/native/include/media/openmax \
+	$(LOCAL_PATH)/../rkvpu-codec \
+	$(LOCAL_PATH)/../rkvpu-codec/inc
 
 LOCAL_CFLAGS += -Wno-multichar -Wall
 
@@ -24,7 +31,9 @@ include $(BUILD_EXECUTABLE)
 
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES:= native_enc_test.cpp
+LOCAL_SRC_FILES:= \
+	native_enc_test.cpp \
+	../rkvpu-codec/rkvpu_async_writer.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	libstagefright liblog libutils libbinder libstagefright_foundation \
@@ -32,7 +41,8 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_C_INCLUDES:= \
 	frameworks/av/media/libstagefright \
-	$(TOP)/frameworks/native/include/media/openmax
+	$(TOP)/frameworks/native/include/media/openmax \
+	$(LOCAL_PATH)/../rkvpu-codec
 
 LOCAL_CFLAGS += -Wno-multichar -Wall
 
@@ -46,11 +46,16 @@
 #include <gui/Surface.h>
 #include <ui/DisplayInfo.h>
 
+#include "rkvpu_async_writer.h"
+#include "rkvpu_stream_probe.h"
+
 using namespace android;
 
 #define MAX_FILE_LEN 128
 
 static int64_t kTimeout = 500ll;
+// output frames queued to the writer thread at most
+static int32_t kWriteDepth = 8;
 
 typedef struct DecTestArgs_t {
     // src and dst
@@ -97,12 +102,12 @@ static void testUsage() {
         "    output bitstream files, if output file not specified,\n"
         "    will render surface on the screen\n"
         "--w\n"
-        "    the width of input picture\n"
+        "    the width of input picture, probed from raw stream if not set\n"
         "--h\n"
-        "    the height of input picture\n"
+        "    the height of input picture, probed from raw stream if not set\n"
         "--t\n"
         "    input type:\n"
-        "        1: raw 264 or 265 format, default\n"
+        "        1: raw 264 or 265 format, default, codec probed from the stream\n"
         "        2: with container, use extrator to get decode_input\n"
         "\n");
 }
@@ -225,16 +230,28 @@ status_t testSetupCodec(DecTestArgs cmd, CodecState *state) {
             break;
         }
     } else {
-        // h264 default
-        static const char* kMimeTypeAvc = "video/avc";
+        // h264 default, codec and size from the first sps if found
+        const char* mime = "video/avc";
+        StreamProbeInfo probe;
+
+        if (stream_probe_file(cmd.file_input, &probe) == 0) {
+            mime = stream_probe_mime(probe.coding);
+            if (cmd.input_width <= 0 || cmd.input_height <= 0) {
+                cmd.input_width = probe.sps.width;
+                cmd.input_height = probe.sps.height;
+            }
+            ALOGD("probe %s %dx%d %d bit", mime, probe.sps.width,
+                  probe.sps.height, probe.sps.bitDepth);
+        }
+
         format = new AMessage;
 
         format->setInt32("width", cmd.input_width);
         format->setInt32("height", cmd.input_height);
-        format->setString("mime", kMimeTypeAvc);
+        format->setString("mime", mime);
 
         state->mCodec = MediaCodec::CreateByType(
-                looper, kMimeTypeAvc, false /* encoder */);
+                looper, mime, false /* encoder */);
         CHECK(state->mCodec != NULL);
 
     }
@@ -272,7 +289,8 @@ status_t testDecRunRawInput(CodecState *state) {
     status_t err = OK;
     bool renderSurface = (state->mSurface != NULL);
 
-    FILE *fpInput = NULL, *fpOutput = NULL;
+    FILE *fpInput = NULL;
+    RKAsyncWriter writer;
     char *pktBuf = NULL;
     int32_t pktsize = 1000; // 1000 byte
 
@@ -291,8 +309,7 @@ status_t testDecRunRawInput(CodecState *state) {
     }
 
     if (!renderSurface) {
-        fpOutput = fopen(state->mFileOutput, "wb+");
-        if (fpOutput == NULL) {
+        if (writer.open(state->mFileOutput, kWriteDepth, false)) {
             fprintf(stderr, "failed to open output file %s\n", state->mFileOutput);
             err = BAD_VALUE;
             goto DECODE_OUT;
@@ -360,7 +377,7 @@ status_t testDecRunRawInput(CodecState *state) {
         size_t size;
         int64_t presentationTimeUs;
         uint32_t flags;
-        status_t err = state->mCodec->dequeueOutputBuffer(
+        err = state->mCodec->dequeueOutputBuffer(
                 &index, &offset, &size, &presentationTimeUs, &flags,
                 kTimeout);
         if (err == OK) {
@@ -372,9 +389,13 @@ status_t testDecRunRawInput(CodecState *state) {
             if (renderSurface) {
                 err = state->mCodec->renderOutputBufferAndRelease(index);
             } else {
+                // copied out, the codec gets the buffer back at once
                 const sp<ABuffer> &buffer = state->mOutBuffers.itemAt(index);
-                fwrite(buffer->base(), 1, buffer->size(), fpOutput);
-                fflush(fpOutput);
+                if (writer.queueCopy(buffer->base(), buffer->size())) {
+                    fprintf(stderr, "failed to write output file\n");
+                    err = UNKNOWN_ERROR;
+                    goto DECODE_OUT;
+                }
 
                 err = state->mCodec->releaseOutputBuffer(index);
             }
@@ -415,8 +436,7 @@ DECODE_OUT:
     if (fpInput != NULL)
         fclose(fpInput);
 
-    if (fpOutput != NULL)
-        fclose(fpOutput);
+    writer.close();
 
     return err;
 }
@@ -425,12 +445,11 @@ status_t testDecRunExtrator(CodecState *state) {
     status_t err = OK;
     bool renderSurface = (state->mSurface != NULL);
 
-    FILE *fpOutput = NULL;
+    RKAsyncWriter writer;
     bool sawInputEOS = false;
 
     if (!renderSurface) {
-        fpOutput = fopen(state->mFileOutput, "wb+");
-        if (fpOutput == NULL) {
+        if (writer.open(state->mFileOutput, kWriteDepth, false)) {
             fprintf(stderr, "failed to open output file %s\n", state->mFileOutput);
             err = BAD_VALUE;
             goto DECODE_OUT;
@@ -502,7 +521,7 @@ status_t testDecRunExtrator(CodecState *state) {
         size_t size;
         int64_t presentationTimeUs;
         uint32_t flags;
-        status_t err = state->mCodec->dequeueOutputBuffer(
+        err = state->mCodec->dequeueOutputBuffer(
                 &index, &offset, &size, &presentationTimeUs, &flags,
                 kTimeout);
         if (err == OK) {
@@ -514,9 +533,13 @@ status_t testDecRunExtrator(CodecState *state) {
             if (renderSurface) {
                 err = state->mCodec->renderOutputBufferAndRelease(index);
             } else {
+                // copied out, the codec gets the buffer back at once
                 const sp<ABuffer> &buffer = state->mOutBuffers.itemAt(index);
-                fwrite(buffer->base(), 1, buffer->size(), fpOutput);
-                fflush(fpOutput);
+                if (writer.queueCopy(buffer->base(), buffer->size())) {
+                    fprintf(stderr, "failed to write output file\n");
+                    err = UNKNOWN_ERROR;
+                    goto DECODE_OUT;
+                }
 
                 err = state->mCodec->releaseOutputBuffer(index);
             }
@@ -552,10 +575,9 @@ status_t testDecRunExtrator(CodecState *state) {
 DECODE_OUT:
     state->mCodec->release();
 
-    if (fpOutput)
-        fclose(fpOutput);
+    writer.close();
 
-    return OK;
+    return err;
 }
 
 int main(int argc, char **argv) {
@@ -563,6 +585,7 @@ int main(int argc, char **argv) {
     DecTestArgs cmd;
     CodecState state;
     int64_t startTimeUs, elapsedTimeUs;
+    int ret = 0;
 
     // parse the cmd option
     if (argc > 1)
@@ -629,6 +652,7 @@ int main(int argc, char **argv) {
     }
     if (err != OK) {
         fprintf(stderr, "ERROR: dec_test_run failed(err=%d)", err);
+        ret = 1;
     } else {
         elapsedTimeUs = ALooper::GetNowUs() - startTimeUs;
         printf("\ndec_test done, %lld frames decoded in %lld ms, %.2f fps\n",
@@ -640,6 +664,6 @@ int main(int argc, char **argv) {
         composerClient->dispose();
     }
 
-    return 0;
+    return ret;
 }
 
@@ -35,19 +35,23 @@
 #include <binder/IPCThreadState.h>
 #include <gui/Surface.h>
 
+#include "rkvpu_async_writer.h"
+
 using namespace android;
 
 #define MAX_FILE_LEN 128
 
 static const char* kMimeTypeAvc = "video/avc";
 static int64_t kTimeout = 20 * 1000; // 20ms
+static int32_t kWriteDepth = 16;       // output packets queued to writer
 
 typedef struct EncTestArgs_t {
     // src and dst
     char                 file_input[MAX_FILE_LEN];
     char                 file_output[MAX_FILE_LEN];
     FILE                 *fp_input;
-    FILE                 *fp_output;
+    RKAsyncWriter        writer;
+    bool                 has_output;
 
     // configure parameters of encoder
     sp<MediaCodec>       codec;
@@ -102,7 +106,7 @@ status_t testParseArgs(EncTestArgs *cmd, int argc, char **argv) {
     };
 
     cmd->fp_input = NULL;
-    cmd->fp_output = NULL;
+    cmd->has_output = false;
     cmd->width = 0;
     cmd->height = 0;
     cmd->frameRate = 0;
@@ -128,11 +132,11 @@ status_t testParseArgs(EncTestArgs *cmd, int argc, char **argv) {
             break;
         case 'o':
             strcpy(cmd->file_output, optarg);
-            cmd->fp_output = fopen(cmd->file_output, "wb+");
-            if (cmd->fp_output == NULL) {
+            if (cmd->writer.open(cmd->file_output, kWriteDepth, false)) {
                 fprintf(stderr, "failed to open output file %s\n", cmd->file_output);
                 return BAD_VALUE;
             }
+            cmd->has_output = true;
             break;
         case 'w':
             cmd->width = atoi(optarg);
@@ -152,7 +156,7 @@ status_t testParseArgs(EncTestArgs *cmd, int argc, char **argv) {
         }
     }
 
-    if (cmd->fp_input == NULL || cmd->fp_output == NULL
+    if (cmd->fp_input == NULL || !cmd->has_output
             || cmd->width == 0 || cmd->height == 0) {
         fprintf(stderr, "ERROR: test must specify input|output|width|height");
         return BAD_VALUE;
@@ -227,7 +231,7 @@ status_t testSetupCodec(EncTestArgs *data) {
 }
 
 status_t testEncRun(EncTestArgs *data) {
-    status_t err;
+    status_t err, ret = OK;
     int32_t pktsize, readsize;
     char *pktBuf = NULL;
     size_t index;
@@ -292,9 +296,13 @@ status_t testEncRun(EncTestArgs *data) {
             ALOGV("draining output buffer %zu, time = %lld us",
                   index, (long long)presentationTimeUs);
 
+            // copied out, the codec gets the buffer back at once
             const sp<ABuffer> &buffer = data->outBuffers.itemAt(index);
-            fwrite(buffer->base(), 1, buffer->size(), data->fp_output);
-            fflush(data->fp_output);
+            if (data->writer.queueCopy(buffer->base(), buffer->size())) {
+                fprintf(stderr, "failed to write output file\n");
+                ret = UNKNOWN_ERROR;
+                break;
+            }
 
             if (flags & MediaCodec::BUFFER_FLAG_EOS) {
                 signalledOutputEOS = true;
@@ -322,7 +330,7 @@ status_t testEncRun(EncTestArgs *data) {
 
     free(pktBuf);
 
-    return 0;
+    return ret;
 }
 
 int main(int argc, char **argv) {
@@ -372,9 +380,8 @@ ENCODE_OUT:
     if (cmd.fp_input != NULL)
         fclose(cmd.fp_input);
 
-    if (cmd.fp_output != NULL)
-        fclose(cmd.fp_output);
+    cmd.writer.close();
 
-    return 0;
+    return (err != OK) ? 1 : 0;
 }
 
@@ -1,5 +1,19 @@
 LOCAL_PATH:= $(call my-dir)
 
+# start code scanner, the neon kernel is built alone with neon enabled
+RKVPU_NAL_SCAN_SRC_FILES := \
+	rkvpu_nal_scan.cpp
+
+RKVPU_NAL_SCAN_SRC_FILES_arm := rkvpu_nal_scan_neon.cpp.neon
+RKVPU_NAL_SCAN_SRC_FILES_arm64 := rkvpu_nal_scan_neon.cpp
+
+# pixel format conversion, same layout as the scanner
+RKVPU_COLOR_CONVERT_SRC_FILES := \
+	rkvpu_color_convert.cpp
+
+RKVPU_COLOR_CONVERT_SRC_FILES_arm := rkvpu_color_convert_neon.cpp.neon
+RKVPU_COLOR_CONVERT_SRC_FILES_arm64 := rkvpu_color_convert_neon.cpp
+
 #
 # SECTION 1: build test for rkvpu-codec decoder
 #
@@ -8,7 +22,26 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	rkvpu_dec_api.cpp \
-	rkvpu_dec_test.cpp
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_stream_probe.cpp \
+	rkvpu_yuv_writer.cpp \
+	rkvpu_async_writer.cpp \
+	rkvpu_dec_test.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES) \
+	$(RKVPU_COLOR_CONVERT_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := \
+	$(RKVPU_NAL_SCAN_SRC_FILES_arm) \
+	$(RKVPU_COLOR_CONVERT_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := \
+	$(RKVPU_NAL_SCAN_SRC_FILES_arm64) \
+	$(RKVPU_COLOR_CONVERT_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DNAL_SCAN_NEON -DCOLOR_CONVERT_NEON
+LOCAL_CFLAGS_arm64 := -DNAL_SCAN_NEON -DCOLOR_CONVERT_NEON
 
 LOCAL_SHARED_LIBRARIES := \
 	liblog libvpu
@@ -38,7 +71,17 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	rkvpu_enc_api.cpp \
-	rkvpu_enc_test.cpp
+	rkvpu_packet_pool.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_async_writer.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_enc_test.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := $(RKVPU_NAL_SCAN_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := $(RKVPU_NAL_SCAN_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DNAL_SCAN_NEON
+LOCAL_CFLAGS_arm64 := -DNAL_SCAN_NEON
 
 LOCAL_SHARED_LIBRARIES := \
 	liblog libvpu
@@ -59,3 +102,310 @@ LOCAL_MODULE := rkvpu_enc_test
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+#
+# SECTION 3: build start code scanner benchmark
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_nal_scan_bench.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := $(RKVPU_NAL_SCAN_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := $(RKVPU_NAL_SCAN_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DNAL_SCAN_NEON
+LOCAL_CFLAGS_arm64 := -DNAL_SCAN_NEON
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc
+
+ifeq (1, $(strip $(shell expr $(PLATFORM_SDK_VERSION) \>= 29)))
+LOCAL_C_INCLUDES += \
+	$(TOP)/system/core/libutils/include
+else
+endif
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_MULTILIB := 32
+LOCAL_MODULE := rkvpu_nal_scan_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+#
+# SECTION 4: build multi-channel decoder farm
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_dec_api.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_dec_farm.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := $(RKVPU_NAL_SCAN_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := $(RKVPU_NAL_SCAN_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DNAL_SCAN_NEON
+LOCAL_CFLAGS_arm64 := -DNAL_SCAN_NEON
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog libvpu
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc
+
+ifeq (1, $(strip $(shell expr $(PLATFORM_SDK_VERSION) \>= 29)))
+LOCAL_C_INCLUDES += \
+	$(TOP)/system/core/libutils/include
+else
+endif
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_MULTILIB := 32
+LOCAL_MODULE := rkvpu_dec_farm
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+#
+# SECTION 5: build multi-channel decoder farm for host, libvpu is replaced
+#            by rkvpu_vpu_stub
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_dec_api.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_dec_farm.cpp \
+	rkvpu_vpu_stub.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc \
+	$(TOP)/system/core/libutils/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := rkvpu_dec_farm_host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#
+# SECTION 6: build pixel format conversion benchmark
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_convert_bench.cpp \
+	$(RKVPU_COLOR_CONVERT_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := $(RKVPU_COLOR_CONVERT_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := $(RKVPU_COLOR_CONVERT_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DCOLOR_CONVERT_NEON
+LOCAL_CFLAGS_arm64 := -DCOLOR_CONVERT_NEON
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc
+
+ifeq (1, $(strip $(shell expr $(PLATFORM_SDK_VERSION) \>= 29)))
+LOCAL_C_INCLUDES += \
+	$(TOP)/system/core/libutils/include
+else
+endif
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_MULTILIB := 32
+LOCAL_MODULE := rkvpu_convert_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+#
+# SECTION 7: build decoder and encoder tests for host, libvpu is replaced
+#            by rkvpu_vpu_stub
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_dec_api.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_stream_probe.cpp \
+	rkvpu_yuv_writer.cpp \
+	rkvpu_async_writer.cpp \
+	rkvpu_dec_test.cpp \
+	rkvpu_vpu_stub.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES) \
+	$(RKVPU_COLOR_CONVERT_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc \
+	$(TOP)/system/core/libutils/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := rkvpu_dec_test_host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_enc_api.cpp \
+	rkvpu_packet_pool.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_async_writer.cpp \
+	rkvpu_enc_test.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_vpu_stub.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc \
+	$(TOP)/system/core/libutils/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := rkvpu_enc_test_host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_packet_pool.cpp \
+	rkvpu_packet_pool_test.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc \
+	$(TOP)/system/core/libutils/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := rkvpu_packet_pool_test_host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#
+# SECTION 8: build encoder and decoder benchmark
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_dec_api.cpp \
+	rkvpu_enc_api.cpp \
+	rkvpu_packet_pool.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_bench.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_SRC_FILES_arm := $(RKVPU_NAL_SCAN_SRC_FILES_arm)
+LOCAL_SRC_FILES_arm64 := $(RKVPU_NAL_SCAN_SRC_FILES_arm64)
+LOCAL_CFLAGS_arm := -DNAL_SCAN_NEON
+LOCAL_CFLAGS_arm64 := -DNAL_SCAN_NEON
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog libvpu
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc
+
+ifeq (1, $(strip $(shell expr $(PLATFORM_SDK_VERSION) \>= 29)))
+LOCAL_C_INCLUDES += \
+	$(TOP)/system/core/libutils/include
+else
+endif
+
+LOCAL_PROPRIETARY_MODULE := true
+
+LOCAL_MULTILIB := 32
+LOCAL_MODULE := rkvpu_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+#
+# SECTION 9: build encoder and decoder benchmark for host, libvpu is
+#            replaced by rkvpu_vpu_stub
+#
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	rkvpu_dec_api.cpp \
+	rkvpu_enc_api.cpp \
+	rkvpu_packet_pool.cpp \
+	rkvpu_waiter.cpp \
+	rkvpu_latency.cpp \
+	rkvpu_sps.cpp \
+	rkvpu_stream_packer.cpp \
+	rkvpu_stream_index.cpp \
+	rkvpu_bench.cpp \
+	rkvpu_vpu_stub.cpp \
+	$(RKVPU_NAL_SCAN_SRC_FILES)
+
+LOCAL_STATIC_LIBRARIES := \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/inc \
+	$(TOP)/system/core/libutils/include
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := rkvpu_bench_host
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
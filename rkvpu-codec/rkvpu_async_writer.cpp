@@ -0,0 +1,455 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKAsyncWriter
+ * date  : 2021/03/26
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKAsyncWriter"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "rkvpu_async_writer.h"
+
+/* blocks written to file each time, split rows are gathered over the end */
+#define WRITER_BLOCK_SIZE       (4 * 1024 * 1024)
+#define WRITER_MAX_ROW          (16 * 1024)
+#define WRITER_ALIGN            4096
+
+static int64_t getNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * UVUV... row to U and V rows, @n is the number of pairs.
+ * the straight rows go by memcpy, which is vectorized by libc already.
+ */
+static void splitUVRow(const uint8_t *src, uint8_t *u, uint8_t *v, int32_t n)
+{
+    int32_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+
+        __m128i ua = _mm_and_si128(a, mask);
+        __m128i ub = _mm_and_si128(b, mask);
+        __m128i va = _mm_srli_epi16(a, 8);
+        __m128i vb = _mm_srli_epi16(b, 8);
+
+        _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(ua, ub));
+        _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(va, vb));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + i * 2);
+
+        vst1q_u8(u + i, uv.val[0]);
+        vst1q_u8(v + i, uv.val[1]);
+    }
+#endif
+
+    for (; i < n; i++) {
+        u[i] = src[i * 2];
+        v[i] = src[i * 2 + 1];
+    }
+}
+
+static void releaseCopy(void *opaque)
+{
+    free(opaque);
+}
+
+RKAsyncWriter::RKAsyncWriter()
+{
+    mFd = -1;
+    mDirectIo = false;
+    mStarted = false;
+    mQueue = NULL;
+    mDepth = 0;
+    mHead = 0;
+    mCount = 0;
+    mQuit = false;
+    mError = 0;
+    mBlock = NULL;
+    mBlockUsed = 0;
+    mPlaneV = NULL;
+    mPlaneVSize = 0;
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mNotEmpty, NULL);
+    pthread_cond_init(&mNotFull, NULL);
+
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+RKAsyncWriter::~RKAsyncWriter()
+{
+    close();
+
+    pthread_cond_destroy(&mNotFull);
+    pthread_cond_destroy(&mNotEmpty);
+    pthread_mutex_destroy(&mLock);
+}
+
+int32_t RKAsyncWriter::open(const char *file, int32_t depth, bool directIo)
+{
+    void *buf = NULL;
+    int32_t flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    if (depth <= 0)
+        return -1;
+
+    mDirectIo = false;
+    if (directIo) {
+        mFd = ::open(file, flags | O_DIRECT, 0644);
+        if (mFd >= 0)
+            mDirectIo = true;
+        else
+            ALOGW("O_DIRECT not supported on %s, buffered io", file);
+    }
+    if (mFd < 0)
+        mFd = ::open(file, flags, 0644);
+    if (mFd < 0) {
+        ALOGE("failed to open %s, %s", file, strerror(errno));
+        return -1;
+    }
+
+    // room for one more split row over the block end
+    if (posix_memalign(&buf, WRITER_ALIGN, WRITER_BLOCK_SIZE + WRITER_MAX_ROW)) {
+        ALOGE("failed to malloc write block");
+        goto OPEN_FAIL;
+    }
+    mBlock = (uint8_t *)buf;
+    mBlockUsed = 0;
+
+    mQueue = (WriterItem *)calloc(depth, sizeof(WriterItem));
+    if (mQueue == NULL) {
+        ALOGE("failed to malloc queue, depth %d", depth);
+        goto OPEN_FAIL;
+    }
+    mDepth = depth;
+    mHead = 0;
+    mCount = 0;
+    mQuit = false;
+    mError = 0;
+
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.capacity = depth;
+
+    if (pthread_create(&mThread, NULL, writerThread, this)) {
+        ALOGE("failed to create writer thread");
+        goto OPEN_FAIL;
+    }
+    mStarted = true;
+
+    return 0;
+
+OPEN_FAIL:
+    free(mQueue);
+    mQueue = NULL;
+    free(mBlock);
+    mBlock = NULL;
+    ::close(mFd);
+    mFd = -1;
+
+    return -1;
+}
+
+int32_t RKAsyncWriter::close()
+{
+    int32_t ret = 0;
+
+    if (mStarted) {
+        pthread_mutex_lock(&mLock);
+        mQuit = true;
+        pthread_cond_signal(&mNotEmpty);
+        pthread_mutex_unlock(&mLock);
+
+        pthread_join(mThread, NULL);
+        mStarted = false;
+
+        if (flushBlock(true))
+            mError = -1;
+        ret = mError;
+    }
+
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+
+    free(mQueue);
+    mQueue = NULL;
+    free(mBlock);
+    mBlock = NULL;
+    free(mPlaneV);
+    mPlaneV = NULL;
+    mPlaneVSize = 0;
+
+    return ret;
+}
+
+int32_t RKAsyncWriter::queuePlanes(const WriterPlane *planes, int32_t num,
+                                   ReleaseFunc release, void *opaque)
+{
+    WriterItem *item;
+
+    pthread_mutex_lock(&mLock);
+
+    if (!mStarted || mError || num <= 0 || num > WRITER_MAX_PLANES) {
+        pthread_mutex_unlock(&mLock);
+        if (release != NULL)
+            release(opaque);
+        return -1;
+    }
+
+    if (mCount >= mDepth) {
+        // storage is behind, the codec thread waits here only
+        int64_t startUs = getNowUs();
+
+        mStats.stalls++;
+        while (mCount >= mDepth && !mError)
+            pthread_cond_wait(&mNotFull, &mLock);
+        mStats.stallUs += getNowUs() - startUs;
+
+        if (mError) {
+            pthread_mutex_unlock(&mLock);
+            if (release != NULL)
+                release(opaque);
+            return -1;
+        }
+    }
+
+    item = &mQueue[(mHead + mCount) % mDepth];
+    memcpy(item->planes, planes, sizeof(WriterPlane) * num);
+    item->numPlanes = num;
+    item->release = release;
+    item->opaque = opaque;
+
+    mCount++;
+    if (mCount > mStats.maxDepth)
+        mStats.maxDepth = mCount;
+
+    pthread_cond_signal(&mNotEmpty);
+    pthread_mutex_unlock(&mLock);
+
+    return 0;
+}
+
+int32_t RKAsyncWriter::queueBuffer(const void *data, int32_t size,
+                                   ReleaseFunc release, void *opaque)
+{
+    WriterPlane plane;
+
+    plane.data = (const uint8_t *)data;
+    plane.width = size;
+    plane.height = 1;
+    plane.stride = size;
+    plane.splitUV = 0;
+
+    return queuePlanes(&plane, 1, release, opaque);
+}
+
+int32_t RKAsyncWriter::queueCopy(const void *data, int32_t size)
+{
+    void *copy = malloc(size > 0 ? size : 1);
+
+    if (copy == NULL) {
+        ALOGE("failed to malloc %d bytes", size);
+        return -1;
+    }
+    memcpy(copy, data, size);
+
+    return queueBuffer(copy, size, releaseCopy, copy);
+}
+
+void RKAsyncWriter::getStats(WriterStats *stats)
+{
+    pthread_mutex_lock(&mLock);
+    *stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+void *RKAsyncWriter::writerThread(void *arg)
+{
+    RKAsyncWriter *writer = (RKAsyncWriter *)arg;
+
+    writer->writerLoop();
+
+    return NULL;
+}
+
+void RKAsyncWriter::writerLoop()
+{
+    while (true) {
+        WriterItem item;
+        int32_t ret = 0;
+
+        pthread_mutex_lock(&mLock);
+        while (mCount == 0 && !mQuit)
+            pthread_cond_wait(&mNotEmpty, &mLock);
+        if (mCount == 0) {
+            // quit after all queued buffers are written
+            pthread_mutex_unlock(&mLock);
+            break;
+        }
+        item = mQueue[mHead];
+        pthread_mutex_unlock(&mLock);
+
+        // after a write error the buffers are released only
+        for (int32_t i = 0; i < item.numPlanes && !ret && !mError; i++)
+            ret = appendPlane(&item.planes[i]);
+
+        if (item.release != NULL)
+            item.release(item.opaque);
+
+        pthread_mutex_lock(&mLock);
+        mHead = (mHead + 1) % mDepth;
+        mCount--;
+        if (ret) {
+            mError = -1;
+        } else {
+            mStats.items++;
+        }
+        pthread_cond_signal(&mNotFull);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+int32_t RKAsyncWriter::flushBlock(bool all)
+{
+    int32_t size = all ? mBlockUsed : WRITER_BLOCK_SIZE;
+    int32_t pos = 0;
+    int64_t startUs = getNowUs();
+
+    if (size <= 0)
+        return 0;
+
+    if (all && mDirectIo && (size % WRITER_ALIGN)) {
+        // the file tail is not block aligned, write it buffered
+        fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL) & ~O_DIRECT);
+        mDirectIo = false;
+    }
+
+    while (pos < size) {
+        ssize_t len = ::write(mFd, mBlock + pos, size - pos);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("failed to write %d bytes, %s", size - pos, strerror(errno));
+            return -1;
+        }
+        pos += len;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mStats.bytes += size;
+    mStats.blocks++;
+    mStats.writeUs += getNowUs() - startUs;
+    pthread_mutex_unlock(&mLock);
+
+    // the part of last split row over the block end moves to the head
+    mBlockUsed -= size;
+    if (mBlockUsed > 0)
+        memmove(mBlock, mBlock + size, mBlockUsed);
+
+    return 0;
+}
+
+int32_t RKAsyncWriter::appendRow(const uint8_t *src, int32_t width, uint8_t *splitV)
+{
+    if (splitV != NULL) {
+        // half row of U, may go over the block end a little
+        splitUVRow(src, mBlock + mBlockUsed, splitV, width / 2);
+        mBlockUsed += width / 2;
+        if (mBlockUsed >= WRITER_BLOCK_SIZE)
+            return flushBlock(false);
+        return 0;
+    }
+
+    while (width > 0) {
+        int32_t len = WRITER_BLOCK_SIZE - mBlockUsed;
+        if (len > width)
+            len = width;
+
+        memcpy(mBlock + mBlockUsed, src, len);
+        mBlockUsed += len;
+        src += len;
+        width -= len;
+
+        if (mBlockUsed >= WRITER_BLOCK_SIZE && flushBlock(false))
+            return -1;
+    }
+
+    return 0;
+}
+
+int32_t RKAsyncWriter::appendPlane(const WriterPlane *plane)
+{
+    int32_t half = plane->width / 2;
+
+    if (!plane->splitUV) {
+        for (int32_t i = 0; i < plane->height; i++) {
+            if (appendRow(plane->data + (size_t)i * plane->stride, plane->width, NULL))
+                return -1;
+        }
+        return 0;
+    }
+
+    if (half > WRITER_MAX_ROW)
+        return -1;
+
+    if (mPlaneVSize < half * plane->height) {
+        uint8_t *buf = (uint8_t *)realloc(mPlaneV, half * plane->height);
+        if (buf == NULL) {
+            ALOGE("failed to malloc v plane");
+            return -1;
+        }
+        mPlaneV = buf;
+        mPlaneVSize = half * plane->height;
+    }
+
+    // u rows go to the block directly, v rows after all u rows
+    for (int32_t i = 0; i < plane->height; i++) {
+        if (appendRow(plane->data + (size_t)i * plane->stride, plane->width,
+                      mPlaneV + i * half))
+            return -1;
+    }
+
+    return appendRow(mPlaneV, half * plane->height, NULL);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKAsyncWriter
+ * date  : 2021/03/26
+ */
+
+#ifndef __RKVPU_ASYNC_WRITER_H__
+#define __RKVPU_ASYNC_WRITER_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Background file writer for the codec loops.
+ *
+ * The codec thread queues references of its buffers and goes on, a writer
+ * thread copies them into large aligned blocks and writes the file block
+ * by block, then hands each buffer back by its release callback. The codec
+ * thread only blocks when the bounded queue is full.
+ *
+ * A buffer is queued as up to WRITER_MAX_PLANES strided planes, so that a
+ * decoded frame can be cropped on the writer thread without copying in the
+ * codec thread. No dependency on libvpu, also used by native-codec tests.
+ */
+#define WRITER_MAX_PLANES       3
+
+class RKAsyncWriter
+{
+public:
+    RKAsyncWriter();
+    ~RKAsyncWriter();
+
+    typedef void (*ReleaseFunc)(void *opaque);
+
+    typedef struct WriterPlane {
+        const uint8_t *data;
+        int32_t width;          /* bytes of each row */
+        int32_t height;         /* rows */
+        int32_t stride;
+        int32_t splitUV;        /* UVUV rows written as U plane then V plane */
+    } WriterPlane_t;
+
+    typedef struct WriterStats {
+        int64_t items;          /* buffers written */
+        int64_t bytes;
+        int64_t blocks;         /* write calls */
+        int64_t writeUs;        /* time spent in write calls */
+        int64_t stalls;         /* queue calls blocked by a full queue */
+        int64_t stallUs;        /* time the codec thread was blocked */
+        int32_t maxDepth;
+        int32_t capacity;
+    } WriterStats_t;
+
+    /*
+     * @depth: max buffers queued
+     * @directIo: write with O_DIRECT, bypass page cache, falls back to
+     *            buffered io if the file system doesn't support it.
+     */
+    int32_t open(const char *file, int32_t depth, bool directIo);
+
+    /* write all queued buffers and close the file, the error of any write is returned */
+    int32_t close();
+
+    /*
+     * queue a buffer, @release(@opaque) is called on the writer thread when
+     * the data is not used anymore, also if the queue call fails.
+     */
+    int32_t queuePlanes(const WriterPlane *planes, int32_t num,
+                        ReleaseFunc release, void *opaque);
+    int32_t queueBuffer(const void *data, int32_t size,
+                        ReleaseFunc release, void *opaque);
+
+    /* for buffers which can't be held, the data is copied first */
+    int32_t queueCopy(const void *data, int32_t size);
+
+    void getStats(WriterStats *stats);
+
+private:
+    typedef struct WriterItem {
+        WriterPlane planes[WRITER_MAX_PLANES];
+        int32_t numPlanes;
+        ReleaseFunc release;
+        void *opaque;
+    } WriterItem;
+
+    static void *writerThread(void *arg);
+    void writerLoop();
+    int32_t appendPlane(const WriterPlane *plane);
+    int32_t appendRow(const uint8_t *src, int32_t width, uint8_t *splitV);
+    int32_t flushBlock(bool all);
+
+    int32_t mFd;
+    bool mDirectIo;
+
+    pthread_t mThread;
+    bool mStarted;
+    pthread_mutex_t mLock;
+    pthread_cond_t mNotEmpty;
+    pthread_cond_t mNotFull;
+    WriterItem *mQueue;
+    int32_t mDepth;
+    int32_t mHead;
+    int32_t mCount;
+    bool mQuit;
+    int32_t mError;
+
+    /* writer thread only */
+    uint8_t *mBlock;
+    int32_t mBlockUsed;
+    uint8_t *mPlaneV;
+    int32_t mPlaneVSize;
+
+    WriterStats mStats;
+};
+
+#endif  // __RKVPU_ASYNC_WRITER_H__
@@ -0,0 +1,993 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: rkvpu_bench
+ * date  : 2021/04/03
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rkvpu_bench"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <atomic>
+
+#include "rkvpu_dec_api.h"
+#include "rkvpu_enc_api.h"
+#include "rkvpu_latency.h"
+
+#define MAX_FILE_LEN            128
+#define BENCH_MAX_ITEMS         8       /* values of each axis of the matrix */
+#define BENCH_MAX_CHANNELS      64
+#define BENCH_MAX_CASES         (BENCH_MAX_ITEMS * BENCH_MAX_ITEMS * BENCH_MAX_ITEMS * \
+                                 BENCH_MAX_ITEMS * 2)
+#define BENCH_NAME_LEN          64
+#define BENCH_SRC_FRAMES        4       /* synthetic pictures encoded in turn */
+#define BENCH_MAX_INPUT_POOL    16
+#define BENCH_WAIT_MS           20
+#define BENCH_RSS_SAMPLE_US     10000
+#define BENCH_LINE_LEN          1024
+
+typedef enum BenchMode {
+    BENCH_MODE_ALL  = 0,
+    BENCH_MODE_ENC  = 1,
+    BENCH_MODE_DEC  = 2,
+} BenchMode;
+
+/* one case of the matrix, also one line of the json report */
+typedef struct BenchResult_t {
+    char name[BENCH_NAME_LEN];
+    int64_t frames;
+    double fps;
+    int64_t p50Us;
+    int64_t p95Us;
+    int64_t p99Us;
+    int64_t maxUs;
+    double cpuUsPerFrame;
+    int64_t rssKb;          /* peak while the case runs */
+} BenchResult;
+
+/* encoded packets in memory, the input of the decoder cases */
+typedef struct BenchStream_t {
+    uint8_t *data;
+    int64_t size;
+    int64_t capacity;
+    int64_t *offsets;       /* count + 1 entries */
+    int32_t count;
+    int32_t maxCount;
+} BenchStream;
+
+typedef struct BenchCtx_t {
+    int32_t widths[BENCH_MAX_ITEMS];
+    int32_t heights[BENCH_MAX_ITEMS];
+    int32_t numSizes;
+    OMX_RK_VIDEO_CODINGTYPE codings[BENCH_MAX_ITEMS];
+    int32_t numCodings;
+    int32_t bitRates[BENCH_MAX_ITEMS];
+    int32_t numBitRates;
+    int32_t channels[BENCH_MAX_ITEMS];
+    int32_t numChannels;
+
+    BenchMode mode;
+    int32_t frames;         /* per channel */
+    int32_t frameRate;
+    int32_t threshold;      /* percent worse than the baseline to fail */
+    int32_t inputPoolNum;   /* encoder input in vpu memory, 0 - copied by vpu */
+
+    char fileOutput[MAX_FILE_LEN];
+    bool hasOutput;
+    char fileBaseline[MAX_FILE_LEN];
+    bool hasBaseline;
+
+    BenchResult *results;
+    int32_t numResults;
+} BenchCtx;
+
+/* one channel of a case, runs on its own thread */
+typedef struct BenchChannel_t {
+    int32_t id;
+    int32_t width;
+    int32_t height;
+    OMX_RK_VIDEO_CODINGTYPE coding;
+    int32_t bitRate;
+    int32_t frameRate;
+    int32_t frames;
+    int32_t inputPoolNum;
+
+    uint8_t **srcFrames;    /* encoder input */
+    BenchStream *stream;    /* encoder output recorded, or decoder input */
+    RKLatencyTracker *latency;
+    std::atomic<int32_t> *finished;
+
+    int64_t framesOut;
+    VPU_RET ret;
+} BenchChannel;
+
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t cpu_time_us()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int64_t rss_kb()
+{
+    FILE *fp = fopen("/proc/self/statm", "r");
+    long pages = 0;
+
+    if (fp == NULL)
+        return 0;
+
+    if (fscanf(fp, "%*s %ld", &pages) != 1)
+        pages = 0;
+    fclose(fp);
+
+    return (int64_t)pages * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+/*
+ * Dumps usage on stderr.
+ */
+static void testUsage()
+{
+    fprintf(stderr,
+        "\nUsage: rkvpu_bench [options] \n"
+        "Rockchip VpuApiLegacy encoder and decoder benchmark.\n"
+        "  - rkvpu_bench --r 1280x720,1920x1080 --t 1,2 --n 1,4 --o result.json\n"
+        "  - rkvpu_bench --r 1920x1080 --n 1,4 --d baseline.json\n"
+        "\n"
+        "Options:\n"
+        "--u\n"
+        "    Show this message.\n"
+        "--r\n"
+        "    resolutions, comma separated, default 1280x720\n"
+        "--t\n"
+        "    codecs, comma separated(h264 default):\n"
+        "        1: h264\n"
+        "        2: h265\n"
+        "--b\n"
+        "    encoder bitrates, comma separated, default 3000000\n"
+        "--n\n"
+        "    channel counts, comma separated, default 1\n"
+        "--m\n"
+        "    cases to run:\n"
+        "        0: encoder and decoder(default)\n"
+        "        1: encoder only\n"
+        "        2: decoder only\n"
+        "--c\n"
+        "    frames of each channel, default 120\n"
+        "--f\n"
+        "    encoder framerate, default 30\n"
+        "--o\n"
+        "    json report file\n"
+        "--d\n"
+        "    baseline json report to diff with, exit 2 on regression\n"
+        "--p\n"
+        "    percent worse than the baseline for a regression, default 10\n"
+        "--i\n"
+        "    encoder input from a pool of N vpu buffers, no copy in the encoder,\n"
+        "    case names are the same, diff with a run without it for the gain\n"
+        "\n");
+}
+
+/* comma separated integers, return the number parsed, -1 if invalid */
+static int32_t parseList(const char *arg, int32_t *vals, int32_t max)
+{
+    int32_t num = 0;
+    char *end;
+
+    while (*arg != '\0') {
+        if (num >= max)
+            return -1;
+
+        vals[num++] = strtol(arg, &end, 10);
+        if (end == arg || (*end != ',' && *end != '\0'))
+            return -1;
+
+        arg = (*end == ',') ? end + 1 : end;
+    }
+
+    return num;
+}
+
+static int32_t parseSizes(const char *arg, int32_t *widths, int32_t *heights,
+                          int32_t max)
+{
+    int32_t num = 0;
+
+    while (*arg != '\0') {
+        int32_t len = 0;
+
+        if (num >= max ||
+            sscanf(arg, "%dx%d%n", &widths[num], &heights[num], &len) != 2 ||
+            widths[num] <= 0 || heights[num] <= 0)
+            return -1;
+
+        arg += len;
+        num++;
+        if (*arg == ',')
+            arg++;
+        else if (*arg != '\0')
+            return -1;
+    }
+
+    return num;
+}
+
+static VPU_RET testParseArgs(BenchCtx *ctx, int argc, char **argv)
+{
+    static const struct option longOptions[] = {
+        { "usage",              no_argument,        NULL, 'u' },
+        { "res",                required_argument,  NULL, 'r' },
+        { "type",               required_argument,  NULL, 't' },
+        { "bitrate",            required_argument,  NULL, 'b' },
+        { "num",                required_argument,  NULL, 'n' },
+        { "mode",               required_argument,  NULL, 'm' },
+        { "count",              required_argument,  NULL, 'c' },
+        { "fps",                required_argument,  NULL, 'f' },
+        { "output",             required_argument,  NULL, 'o' },
+        { "diff",               required_argument,  NULL, 'd' },
+        { "percent",            required_argument,  NULL, 'p' },
+        { "inpool",             required_argument,  NULL, 'i' },
+        { NULL,                 0,                  NULL, 0 }
+    };
+    int32_t types[BENCH_MAX_ITEMS];
+
+    ctx->widths[0] = 1280;
+    ctx->heights[0] = 720;
+    ctx->numSizes = 1;
+    ctx->codings[0] = OMX_RK_VIDEO_CodingAVC;
+    ctx->numCodings = 1;
+    ctx->bitRates[0] = 3000000;
+    ctx->numBitRates = 1;
+    ctx->channels[0] = 1;
+    ctx->numChannels = 1;
+    ctx->mode = BENCH_MODE_ALL;
+    ctx->frames = 120;
+    ctx->frameRate = 30;
+    ctx->threshold = 10;
+    ctx->inputPoolNum = 0;
+    ctx->hasOutput = false;
+    ctx->hasBaseline = false;
+    ctx->results = NULL;
+    ctx->numResults = 0;
+
+    while (true) {
+        int optionIndex = 0;
+        int ic = getopt_long(argc, argv, "", longOptions, &optionIndex);
+        if (ic == -1) {
+            break;
+        }
+
+        switch (ic) {
+        case 'u':
+            return VPU_ERR_UNKNOW;
+        case 'r':
+            ctx->numSizes = parseSizes(optarg, ctx->widths, ctx->heights,
+                                       BENCH_MAX_ITEMS);
+            break;
+        case 't':
+            ctx->numCodings = parseList(optarg, types, BENCH_MAX_ITEMS);
+            for (int32_t i = 0; i < ctx->numCodings; i++) {
+                ctx->codings[i] = (types[i] == 2) ? OMX_RK_VIDEO_CodingHEVC
+                                                  : OMX_RK_VIDEO_CodingAVC;
+            }
+            break;
+        case 'b':
+            ctx->numBitRates = parseList(optarg, ctx->bitRates, BENCH_MAX_ITEMS);
+            break;
+        case 'n':
+            ctx->numChannels = parseList(optarg, ctx->channels, BENCH_MAX_ITEMS);
+            break;
+        case 'm':
+            ctx->mode = (BenchMode)atoi(optarg);
+            break;
+        case 'c':
+            ctx->frames = atoi(optarg);
+            break;
+        case 'f':
+            ctx->frameRate = atoi(optarg);
+            break;
+        case 'o':
+            strncpy(ctx->fileOutput, optarg, MAX_FILE_LEN - 1);
+            ctx->fileOutput[MAX_FILE_LEN - 1] = '\0';
+            ctx->hasOutput = true;
+            break;
+        case 'd':
+            strncpy(ctx->fileBaseline, optarg, MAX_FILE_LEN - 1);
+            ctx->fileBaseline[MAX_FILE_LEN - 1] = '\0';
+            ctx->hasBaseline = true;
+            break;
+        case 'p':
+            ctx->threshold = atoi(optarg);
+            break;
+        case 'i':
+            ctx->inputPoolNum = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
+            return VPU_ERR_UNKNOW;
+        }
+    }
+
+    if (ctx->numSizes <= 0 || ctx->numCodings <= 0 || ctx->numBitRates <= 0 ||
+        ctx->numChannels <= 0) {
+        fprintf(stderr, "ERROR: invalid matrix, at most %d values each\n",
+                BENCH_MAX_ITEMS);
+        return VPU_ERR_UNKNOW;
+    }
+
+    for (int32_t i = 0; i < ctx->numChannels; i++) {
+        if (ctx->channels[i] <= 0 || ctx->channels[i] > BENCH_MAX_CHANNELS) {
+            fprintf(stderr, "ERROR: channels must be 1 to %d\n", BENCH_MAX_CHANNELS);
+            return VPU_ERR_UNKNOW;
+        }
+    }
+
+    if (ctx->mode < BENCH_MODE_ALL || ctx->mode > BENCH_MODE_DEC ||
+        ctx->frames <= 0 || ctx->frameRate <= 0 || ctx->threshold < 0 ||
+        ctx->inputPoolNum < 0 || ctx->inputPoolNum > BENCH_MAX_INPUT_POOL) {
+        fprintf(stderr, "ERROR: invalid bench settings\n");
+        return VPU_ERR_UNKNOW;
+    }
+
+    // dump cmd options
+    fprintf(stderr, "\ncmd parse result:\n"
+        "   resolutions          : %d\n"
+        "   codecs               : %d\n"
+        "   bitrates             : %d\n"
+        "   channel counts       : %d\n"
+        "   mode                 : %d\n"
+        "   frames per channel   : %d\n"
+        "   framerate            : %d\n"
+        "   input pool           : %d\n"
+        "   output report        : %s\n"
+        "   baseline report      : %s\n",
+        ctx->numSizes, ctx->numCodings, ctx->numBitRates, ctx->numChannels,
+        ctx->mode, ctx->frames, ctx->frameRate, ctx->inputPoolNum,
+        ctx->hasOutput ? ctx->fileOutput : "none",
+        ctx->hasBaseline ? ctx->fileBaseline : "none");
+
+    return VPU_OK;
+}
+
+static VPU_RET benchStreamAppend(BenchStream *stream, const uint8_t *data, int32_t size)
+{
+    if (stream->count == stream->maxCount) {
+        int32_t maxCount = (stream->maxCount > 0) ? stream->maxCount * 2 : 256;
+        int64_t *offsets = (int64_t *)realloc(stream->offsets,
+                                              (maxCount + 1) * sizeof(int64_t));
+        if (offsets == NULL)
+            return VPU_ERR_UNKNOW;
+        stream->offsets = offsets;
+        stream->maxCount = maxCount;
+    }
+
+    if (stream->size + size > stream->capacity) {
+        int64_t capacity = (stream->size + size) * 2;
+        uint8_t *buf = (uint8_t *)realloc(stream->data, capacity);
+        if (buf == NULL)
+            return VPU_ERR_UNKNOW;
+        stream->data = buf;
+        stream->capacity = capacity;
+    }
+
+    memcpy(stream->data + stream->size, data, size);
+    stream->offsets[stream->count] = stream->size;
+    stream->size += size;
+    stream->count++;
+    stream->offsets[stream->count] = stream->size;
+
+    return VPU_OK;
+}
+
+static void benchStreamFree(BenchStream *stream)
+{
+    free(stream->data);
+    free(stream->offsets);
+    memset(stream, 0, sizeof(BenchStream));
+}
+
+static void *benchEncodeChannel(void *arg)
+{
+    BenchChannel *ch = (BenchChannel *)arg;
+    RKHWEncApi encApi;
+    RKHWEncApi::EncCfgInfo cfg;
+    RKHWEncApi::InputBuffer *inBuf = NULL;
+    bool filled[BENCH_MAX_INPUT_POOL] = { false };
+    int32_t frameSize = ch->width * ch->height * 3 / 2;
+    int32_t sent = 0;
+    int64_t pts = 0;
+    bool signalledInputEOS = false;
+    VPU_RET ret;
+
+    cfg.width = ch->width;
+    cfg.height = ch->height;
+    cfg.coding = ch->coding;
+    cfg.format = ENC_INPUT_YUV420_SEMIPLANAR;
+    cfg.framerate = ch->frameRate;
+    cfg.bitRate = ch->bitRate;
+    cfg.IDRInterval = 1;
+    cfg.rc_mode = ENC_RC_MODE_CBR;
+    cfg.qp = 20;
+    cfg.inputPoolNum = ch->inputPoolNum;
+
+    ret = encApi.prepare(&cfg);
+    if (ret != VPU_OK) {
+        fprintf(stderr, "channel %d: encApi prepare failed(err=%d)\n", ch->id, ret);
+        goto ENCODE_OUT;
+    }
+
+    while (true) {
+        bool queued = false;
+
+        if (!signalledInputEOS) {
+            if (sent < ch->frames) {
+                // one pts for each picture, kept while the input queue is full
+                if (pts == 0)
+                    pts = ch->latency->nextPts();
+
+                if (ch->inputPoolNum == 0) {
+                    ret = encApi.sendFrame((char *)ch->srcFrames[sent % BENCH_SRC_FRAMES],
+                                           frameSize, pts, 0);
+                } else {
+                    if (inBuf == NULL && encApi.acquireInputBuffer(&inBuf) == VPU_OK &&
+                        !filled[inBuf->index]) {
+                        // written once, as a capture device fills the pool
+                        memcpy(inBuf->mem.vir_addr,
+                               ch->srcFrames[inBuf->index % BENCH_SRC_FRAMES], frameSize);
+                        filled[inBuf->index] = true;
+                    }
+                    // all buffers in the encoder, wait for a packet
+                    ret = (inBuf != NULL) ? encApi.sendFrame(inBuf, pts, 0) : VPU_EAGAIN;
+                }
+
+                if (ret == VPU_OK) {
+                    ch->latency->onSend(pts);
+                    inBuf = NULL;
+                    pts = 0;
+                    sent++;
+                    queued = true;
+                }
+            } else {
+                ret = encApi.sendFrame((char *)ch->srcFrames[0], 0, 0, OMX_BUFFERFLAG_EOS);
+                if (ret == VPU_OK)
+                    signalledInputEOS = true;
+            }
+
+            if (ret != VPU_OK && ret != VPU_EAGAIN) {
+                fprintf(stderr, "channel %d: send frame failed(err=%d)\n", ch->id, ret);
+                goto ENCODE_OUT;
+            }
+        }
+
+        EncodedPacket packet;
+        ret = encApi.getOutStream(&packet, (queued && !signalledInputEOS) ? 0 : BENCH_WAIT_MS);
+        if (ret == VPU_OK) {
+            ch->latency->onOutput(packet.pts());
+            ch->framesOut++;
+
+            if (ch->stream != NULL &&
+                benchStreamAppend(ch->stream, packet.data(), packet.size()) != VPU_OK) {
+                fprintf(stderr, "failed to malloc stream buffer\n");
+                ret = VPU_ERR_UNKNOW;
+                goto ENCODE_OUT;
+            }
+        } else if (ret == VPU_EOS_STREAM_REACHED) {
+            break;
+        } else if (ret != VPU_EAGAIN) {
+            fprintf(stderr, "channel %d: get stream failed(err=%d)\n", ch->id, ret);
+            goto ENCODE_OUT;
+        }
+    }
+
+    ret = VPU_OK;
+
+ENCODE_OUT:
+    ch->ret = ret;
+    (*ch->finished)++;
+
+    return NULL;
+}
+
+static void *benchDecodeChannel(void *arg)
+{
+    BenchChannel *ch = (BenchChannel *)arg;
+    BenchStream *stream = ch->stream;
+    RKHWDecApi decApi;
+    RKHWDecApi::DecCfgInfo cfg;
+    char eosBuf[1] = { 0 };
+    int32_t next = 0;
+    int64_t pts = 0;
+    bool signalledInputEOS = false;
+    VPU_RET ret;
+
+    cfg.width = ch->width;
+    cfg.height = ch->height;
+    cfg.coding = ch->coding;
+    cfg.splitMode = 0;  // one encoded packet each time
+    cfg.framePoolNum = 0;
+    cfg.framePoolSize = 0;
+    cfg.latencyMode = 0;
+
+    ret = decApi.prepare(&cfg);
+    if (ret != VPU_OK) {
+        fprintf(stderr, "channel %d: decApi prepare failed(err=%d)\n", ch->id, ret);
+        goto DECODE_OUT;
+    }
+
+    while (true) {
+        bool queued = false;
+
+        if (!signalledInputEOS) {
+            if (next < stream->count) {
+                if (pts == 0)
+                    pts = ch->latency->nextPts();
+
+                ret = decApi.sendStream((char *)stream->data + stream->offsets[next],
+                                        stream->offsets[next + 1] - stream->offsets[next],
+                                        pts, 0);
+                if (ret == VPU_OK) {
+                    ch->latency->onSend(pts);
+                    pts = 0;
+                    next++;
+                    queued = true;
+                }
+            } else {
+                ret = decApi.sendStream(eosBuf, 0, 0, OMX_BUFFERFLAG_EOS);
+                if (ret == VPU_OK)
+                    signalledInputEOS = true;
+            }
+
+            if (ret != VPU_OK && ret != VPU_EAGAIN) {
+                fprintf(stderr, "channel %d: send stream failed(err=%d)\n", ch->id, ret);
+                goto DECODE_OUT;
+            }
+        }
+
+        VPU_FRAME vframe;
+        ret = decApi.getOutFrame(&vframe, (queued && !signalledInputEOS) ? 0 : BENCH_WAIT_MS);
+        if (ret == VPU_OK) {
+            ch->latency->onOutput(((int64_t)vframe.ShowTime.TimeHigh << 32) |
+                                  vframe.ShowTime.TimeLow);
+            ch->framesOut++;
+            decApi.deinitOutFrame(&vframe);
+        } else if (ret == VPU_EOS_STREAM_REACHED) {
+            break;
+        } else if (ret != VPU_EAGAIN && ret != VPU_FORMAT_CHANGED) {
+            fprintf(stderr, "channel %d: get frame failed(err=%d)\n", ch->id, ret);
+            goto DECODE_OUT;
+        }
+    }
+
+    ret = VPU_OK;
+
+DECODE_OUT:
+    ch->ret = ret;
+    (*ch->finished)++;
+
+    return NULL;
+}
+
+static const char *codingName(OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    return (coding == OMX_RK_VIDEO_CodingHEVC) ? "h265" : "h264";
+}
+
+/*
+ * run one case of the matrix on @numChannels threads. With @record the
+ * encoder output of channel 0 is kept for the decoder cases, with @result
+ * the case is measured and reported.
+ */
+static VPU_RET benchRunCase(BenchCtx *bench, bool encode, int32_t width, int32_t height,
+                            OMX_RK_VIDEO_CODINGTYPE coding, int32_t bitRate,
+                            int32_t numChannels, uint8_t **srcFrames,
+                            BenchStream *stream, bool record, BenchResult *result)
+{
+    BenchChannel channels[BENCH_MAX_CHANNELS];
+    pthread_t threads[BENCH_MAX_CHANNELS];
+    RKLatencyTracker latency;
+    RKLatencyTracker::LatencyStats stats;
+    std::atomic<int32_t> finished(0);
+    int32_t numThreads = 0;
+    int64_t startUs, elapsedUs, startCpuUs, cpuUs, frames = 0, expected, rssKb = 0;
+    VPU_RET ret = VPU_OK;
+
+    for (int32_t i = 0; i < numChannels; i++) {
+        BenchChannel *ch = &channels[i];
+
+        ch->id = i;
+        ch->width = width;
+        ch->height = height;
+        ch->coding = coding;
+        ch->bitRate = bitRate;
+        ch->frameRate = bench->frameRate;
+        ch->frames = bench->frames;
+        ch->inputPoolNum = bench->inputPoolNum;
+        ch->srcFrames = srcFrames;
+        ch->stream = (encode && !(record && i == 0)) ? NULL : stream;
+        ch->latency = &latency;
+        ch->finished = &finished;
+        ch->framesOut = 0;
+        ch->ret = VPU_OK;
+    }
+
+    startUs = time_now_us();
+    startCpuUs = cpu_time_us();
+
+    for (int32_t i = 0; i < numChannels; i++) {
+        if (pthread_create(&threads[i], NULL,
+                           encode ? benchEncodeChannel : benchDecodeChannel,
+                           &channels[i])) {
+            fprintf(stderr, "failed to create channel %d\n", i);
+            ret = VPU_ERR_UNKNOW;
+            break;
+        }
+        numThreads++;
+    }
+
+    // the peak of the case, the process peak is kept by earlier cases
+    while (finished.load() < numThreads) {
+        int64_t rss = rss_kb();
+        if (rss > rssKb)
+            rssKb = rss;
+        usleep(BENCH_RSS_SAMPLE_US);
+    }
+
+    for (int32_t i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+        if (channels[i].ret != VPU_OK)
+            ret = channels[i].ret;
+        frames += channels[i].framesOut;
+    }
+
+    elapsedUs = time_now_us() - startUs;
+    cpuUs = cpu_time_us() - startCpuUs;
+
+    if (ret != VPU_OK || result == NULL)
+        return ret;
+
+    expected = (int64_t)numChannels * (encode ? bench->frames : stream->count);
+    if (frames != expected) {
+        fprintf(stderr, "warning: %lld frames out of %lld\n",
+                (long long)frames, (long long)expected);
+    }
+
+    latency.getStats(&stats);
+
+    snprintf(result->name, sizeof(result->name), "%s_%s_%dx%d_%dk_%dch",
+             encode ? "enc" : "dec", codingName(coding), width, height,
+             bitRate / 1000, numChannels);
+    result->frames = frames;
+    result->fps = (elapsedUs > 0) ? frames * 1E6 / elapsedUs : 0.0;
+    result->p50Us = stats.p50Us;
+    result->p95Us = stats.p95Us;
+    result->p99Us = stats.p99Us;
+    result->maxUs = stats.maxUs;
+    result->cpuUsPerFrame = frames ? (double)cpuUs / frames : 0.0;
+    result->rssKb = rssKb;
+
+    printf("%-32s %6lld frames, %9.2f fps, latency p50 %7.2f p95 %7.2f p99 %7.2f "
+           "max %7.2f ms, cpu %8.1f us/frame, rss %lld KB\n",
+           result->name, (long long)frames, result->fps, stats.p50Us / 1E3,
+           stats.p95Us / 1E3, stats.p99Us / 1E3, stats.maxUs / 1E3,
+           result->cpuUsPerFrame, (long long)rssKb);
+
+    return VPU_OK;
+}
+
+/* synthetic nv12 pictures, a gradient moving a little each picture */
+static uint8_t **benchMakeFrames(int32_t width, int32_t height)
+{
+    uint8_t **frames = (uint8_t **)calloc(BENCH_SRC_FRAMES, sizeof(uint8_t *));
+
+    if (frames == NULL)
+        return NULL;
+
+    for (int32_t n = 0; n < BENCH_SRC_FRAMES; n++) {
+        uint8_t *buf = (uint8_t *)malloc(width * height * 3 / 2);
+        if (buf == NULL)
+            return frames;
+
+        for (int32_t y = 0; y < height; y++) {
+            for (int32_t x = 0; x < width; x++)
+                buf[y * width + x] = (uint8_t)(x + y + n * 4);
+        }
+        memset(buf + width * height, 128, width * height / 2);
+        frames[n] = buf;
+    }
+
+    return frames;
+}
+
+static void benchFreeFrames(uint8_t **frames)
+{
+    if (frames == NULL)
+        return;
+
+    for (int32_t n = 0; n < BENCH_SRC_FRAMES; n++)
+        free(frames[n]);
+    free(frames);
+}
+
+static VPU_RET benchRunMatrix(BenchCtx *bench)
+{
+    VPU_RET ret = VPU_OK;
+
+    for (int32_t s = 0; s < bench->numSizes && ret == VPU_OK; s++) {
+        int32_t width = bench->widths[s];
+        int32_t height = bench->heights[s];
+        uint8_t **srcFrames = benchMakeFrames(width, height);
+
+        if (srcFrames == NULL || srcFrames[BENCH_SRC_FRAMES - 1] == NULL) {
+            fprintf(stderr, "failed to malloc %dx%d input pictures\n", width, height);
+            benchFreeFrames(srcFrames);
+            return VPU_ERR_UNKNOW;
+        }
+
+        for (int32_t c = 0; c < bench->numCodings && ret == VPU_OK; c++) {
+            for (int32_t b = 0; b < bench->numBitRates && ret == VPU_OK; b++) {
+                OMX_RK_VIDEO_CODINGTYPE coding = bench->codings[c];
+                int32_t bitRate = bench->bitRates[b];
+                BenchStream stream;
+
+                memset(&stream, 0, sizeof(stream));
+
+                for (int32_t n = 0; n < bench->numChannels && ret == VPU_OK; n++) {
+                    if (bench->mode == BENCH_MODE_DEC)
+                        break;
+                    ret = benchRunCase(bench, true, width, height, coding, bitRate,
+                                       bench->channels[n], srcFrames, NULL, false,
+                                       &bench->results[bench->numResults++]);
+                }
+
+                if (bench->mode != BENCH_MODE_ENC && ret == VPU_OK) {
+                    // the decoder input, encoded once and not measured
+                    ret = benchRunCase(bench, true, width, height, coding, bitRate, 1,
+                                       srcFrames, &stream, true, NULL);
+                }
+
+                for (int32_t n = 0; n < bench->numChannels && ret == VPU_OK; n++) {
+                    if (bench->mode == BENCH_MODE_ENC)
+                        break;
+                    ret = benchRunCase(bench, false, width, height, coding, bitRate,
+                                       bench->channels[n], srcFrames, &stream, false,
+                                       &bench->results[bench->numResults++]);
+                }
+
+                benchStreamFree(&stream);
+            }
+        }
+
+        benchFreeFrames(srcFrames);
+    }
+
+    return ret;
+}
+
+/* one case per line, so the reports diff line by line as well */
+static VPU_RET benchWriteReport(BenchCtx *bench)
+{
+    FILE *fp = fopen(bench->fileOutput, "w");
+
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open output file %s\n", bench->fileOutput);
+        return VPU_ERR_INIT;
+    }
+
+    fprintf(fp, "{\n  \"frames\": %d,\n  \"framerate\": %d,\n  \"cases\": [\n",
+            bench->frames, bench->frameRate);
+    for (int32_t i = 0; i < bench->numResults; i++) {
+        BenchResult *r = &bench->results[i];
+
+        fprintf(fp, "    { \"name\": \"%s\", \"frames\": %lld, \"fps\": %.2f, "
+                "\"p50Us\": %lld, \"p95Us\": %lld, \"p99Us\": %lld, \"maxUs\": %lld, "
+                "\"cpuUsPerFrame\": %.2f, \"rssKb\": %lld }%s\n",
+                r->name, (long long)r->frames, r->fps, (long long)r->p50Us,
+                (long long)r->p95Us, (long long)r->p99Us, (long long)r->maxUs,
+                r->cpuUsPerFrame, (long long)r->rssKb,
+                (i + 1 < bench->numResults) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    if (fclose(fp)) {
+        fprintf(stderr, "failed to write output file %s\n", bench->fileOutput);
+        return VPU_ERR_UNKNOW;
+    }
+
+    return VPU_OK;
+}
+
+/* value of "@key": in a report line, only what benchWriteReport writes */
+static const char *jsonFind(const char *line, const char *key)
+{
+    char pattern[BENCH_NAME_LEN];
+    const char *pos;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    pos = strstr(line, pattern);
+    if (pos == NULL)
+        return NULL;
+
+    pos += strlen(pattern);
+    while (*pos == ' ')
+        pos++;
+
+    return pos;
+}
+
+static bool jsonGetNumber(const char *line, const char *key, double *val)
+{
+    const char *pos = jsonFind(line, key);
+
+    if (pos == NULL)
+        return false;
+
+    *val = strtod(pos, NULL);
+    return true;
+}
+
+static bool jsonGetString(const char *line, const char *key, char *buf, int32_t len)
+{
+    const char *pos = jsonFind(line, key);
+    const char *end;
+
+    if (pos == NULL || *pos != '"')
+        return false;
+
+    end = strchr(++pos, '"');
+    if (end == NULL || end - pos >= len)
+        return false;
+
+    memcpy(buf, pos, end - pos);
+    buf[end - pos] = '\0';
+
+    return true;
+}
+
+/* percent worse than the baseline, positive is a regression */
+static double benchChange(double base, double cur, bool higherIsBetter)
+{
+    if (base <= 0)
+        return 0;
+
+    return (higherIsBetter ? base - cur : cur - base) * 100 / base;
+}
+
+/*
+ * compare the results with the cases of the same name in the baseline,
+ * the number of regressed cases is returned in @regressions.
+ */
+static VPU_RET benchDiffBaseline(BenchCtx *bench, int32_t *regressions)
+{
+    char line[BENCH_LINE_LEN];
+    int32_t matched = 0;
+    FILE *fp;
+
+    *regressions = 0;
+
+    fp = fopen(bench->fileBaseline, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open baseline file %s\n", bench->fileBaseline);
+        return VPU_ERR_INIT;
+    }
+
+    printf("\ndiff with %s, regression over %d%%:\n", bench->fileBaseline,
+           bench->threshold);
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char name[BENCH_NAME_LEN];
+        double fps, p95Us, cpuUs, rssKb;
+        BenchResult *r = NULL;
+
+        if (!jsonGetString(line, "name", name, sizeof(name)) ||
+            !jsonGetNumber(line, "fps", &fps) ||
+            !jsonGetNumber(line, "p95Us", &p95Us) ||
+            !jsonGetNumber(line, "cpuUsPerFrame", &cpuUs) ||
+            !jsonGetNumber(line, "rssKb", &rssKb))
+            continue;
+
+        for (int32_t i = 0; i < bench->numResults; i++) {
+            if (!strcmp(bench->results[i].name, name)) {
+                r = &bench->results[i];
+                break;
+            }
+        }
+        if (r == NULL)
+            continue;
+
+        double fpsChange = benchChange(fps, r->fps, true);
+        double p95Change = benchChange(p95Us, r->p95Us, false);
+        double cpuChange = benchChange(cpuUs, r->cpuUsPerFrame, false);
+        double rssChange = benchChange(rssKb, r->rssKb, false);
+        bool regressed = fpsChange > bench->threshold || p95Change > bench->threshold ||
+                         cpuChange > bench->threshold || rssChange > bench->threshold;
+
+        printf("%-32s fps %+6.1f%% p95 %+6.1f%% cpu %+6.1f%% rss %+6.1f%%%s\n",
+               name, -fpsChange, p95Change, cpuChange, rssChange,
+               regressed ? "  REGRESSION" : "");
+
+        matched++;
+        if (regressed)
+            (*regressions)++;
+    }
+
+    fclose(fp);
+
+    printf("%d cases compared, %d not in baseline, %d regressions\n",
+           matched, bench->numResults - matched, *regressions);
+
+    return VPU_OK;
+}
+
+int main(int argc, char **argv)
+{
+    VPU_RET ret = VPU_OK;
+    BenchCtx *bench = new BenchCtx;
+    int32_t regressions = 0;
+
+    // parse the cmd option
+    if (argc > 0)
+        ret = testParseArgs(bench, argc, argv);
+
+    if (ret != VPU_OK) {
+        testUsage();
+        delete bench;
+        return 1;
+    }
+
+    bench->results = (BenchResult *)calloc(BENCH_MAX_CASES, sizeof(BenchResult));
+    if (bench->results == NULL) {
+        delete bench;
+        return 1;
+    }
+
+    printf("\n");
+    ret = benchRunMatrix(bench);
+    if (ret != VPU_OK)
+        fprintf(stderr, "ERROR: bench failed(err=%d)\n", ret);
+
+    if (ret == VPU_OK && bench->hasOutput)
+        ret = benchWriteReport(bench);
+
+    if (ret == VPU_OK && bench->hasBaseline)
+        ret = benchDiffBaseline(bench, &regressions);
+
+    free(bench->results);
+    delete bench;
+
+    if (ret != VPU_OK)
+        return 1;
+
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,926 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: color_convert
+ * date  : 2021/03/29
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "color_convert"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define COLOR_CONVERT_X86
+#endif
+
+#if defined(__arm__) && defined(COLOR_CONVERT_NEON)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON  (1 << 12)
+#endif
+#endif
+
+#include "rkvpu_color_convert.h"
+
+#define COLOR_MAX_THREADS   16
+/* chroma row of I010 goes through the stack */
+#define COLOR_MAX_WIDTH     8192
+
+/* UVUV row to U and V rows, @n is the number of pairs */
+typedef void (*SplitUVFunc)(const uint8_t *uv, uint8_t *u, uint8_t *v, int32_t n);
+
+/* one row of NV12 to packed rgb, @uv is the chroma row shared by two rows */
+typedef void (*RgbRowFunc)(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                           int32_t width, const ColorCoeffs *c);
+
+/*
+ * @n samples of 10bit compact row to 16bit, @msb selects P010 layout,
+ * otherwise the value is in the low 10 bits.
+ */
+typedef void (*Unpack10Func)(const uint8_t *src, uint16_t *dst, int32_t n, int32_t msb);
+
+/*
+ * @n samples of 10bit compact row to 8bit, (v + pattern[i & 7]) >> 2,
+ * the pattern holds the dither of the row or the rounding.
+ */
+typedef void (*Down10Func)(const uint8_t *src, uint8_t *dst, int32_t n,
+                           const uint16_t *pattern);
+
+typedef struct ColorKernelFuncs {
+    SplitUVFunc splitUV;
+    RgbRowFunc toRgba;
+    RgbRowFunc toBgr;
+    Unpack10Func unpack10;
+    Down10Func down10;
+} ColorKernelFuncs;
+
+#ifdef COLOR_CONVERT_NEON
+/* rkvpu_color_convert_neon.cpp, built with neon enabled */
+extern void color_split_uv_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int32_t n);
+extern void color_nv12_to_rgba_neon(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                                    int32_t width, const ColorCoeffs *c);
+extern void color_nv12_to_bgr_neon(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                                   int32_t width, const ColorCoeffs *c);
+extern void color_unpack10_neon(const uint8_t *src, uint16_t *dst, int32_t n, int32_t msb);
+extern void color_down10_neon(const uint8_t *src, uint8_t *dst, int32_t n,
+                              const uint16_t *pattern);
+#endif
+
+static pthread_once_t sKernelOnce = PTHREAD_ONCE_INIT;
+static const ColorKernelFuncs *sFuncs = NULL;
+static ColorKernel sKernel = COLOR_KERNEL_SCALAR;
+
+static inline int32_t mulQ13(int32_t val, int32_t coeff)
+{
+    return (val * 128 * coeff) >> 16;
+}
+
+static inline uint8_t clampPixel(int32_t val)
+{
+    val = (val + 8) >> 4;
+    return (val < 0) ? 0 : ((val > 255) ? 255 : val);
+}
+
+static void splitUVScalar(const uint8_t *uv, uint8_t *u, uint8_t *v, int32_t n)
+{
+    for (int32_t i = 0; i < n; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+/*
+ * shared by the tails of simd kernels, @rIdx and @bIdx place the channels
+ * for RGBA and BGR.
+ */
+static inline void rgbRowScalar(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                                int32_t width, const ColorCoeffs *c,
+                                int32_t bpp, int32_t rIdx, int32_t bIdx)
+{
+    for (int32_t i = 0; i < width; i++) {
+        int32_t uu = uv[i & ~1] - 128;
+        int32_t vv = uv[i | 1] - 128;
+        int32_t yy = mulQ13(y[i] - c->yOffset, c->cy);
+        uint8_t *p = dst + i * bpp;
+
+        p[rIdx] = clampPixel(yy + mulQ13(vv, c->crv));
+        p[1] = clampPixel(yy - mulQ13(uu, c->cgu) - mulQ13(vv, c->cgv));
+        p[bIdx] = clampPixel(yy + mulQ13(uu, c->cbu));
+        if (bpp == 4)
+            p[3] = 0xff;
+    }
+}
+
+static void toRgbaScalar(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                         int32_t width, const ColorCoeffs *c)
+{
+    rgbRowScalar(y, uv, dst, width, c, 4, 0, 2);
+}
+
+static void toBgrScalar(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                        int32_t width, const ColorCoeffs *c)
+{
+    rgbRowScalar(y, uv, dst, width, c, 3, 2, 0);
+}
+
+/* sample k starts at bit 10 * k, little endian */
+static inline uint16_t getSample10(const uint8_t *src, int32_t k)
+{
+    int32_t bit = k * 10;
+    const uint8_t *p = src + (bit >> 3);
+
+    return ((p[0] | (p[1] << 8)) >> (bit & 7)) & 0x3ff;
+}
+
+static void unpack10Scalar(const uint8_t *src, uint16_t *dst, int32_t n, int32_t msb)
+{
+    int32_t shift = msb ? 6 : 0;
+
+    for (int32_t i = 0; i < n; i++)
+        dst[i] = getSample10(src, i) << shift;
+}
+
+static void down10Scalar(const uint8_t *src, uint8_t *dst, int32_t n,
+                         const uint16_t *pattern)
+{
+    for (int32_t i = 0; i < n; i++) {
+        int32_t val = (getSample10(src, i) + pattern[i & 7]) >> 2;
+        dst[i] = (val > 255) ? 255 : val;
+    }
+}
+
+static const ColorKernelFuncs sScalarFuncs = {
+    splitUVScalar, toRgbaScalar, toBgrScalar, unpack10Scalar, down10Scalar,
+};
+
+#ifdef COLOR_CONVERT_X86
+__attribute__((target("ssse3")))
+static void splitUVSsse3(const uint8_t *uv, uint8_t *u, uint8_t *v, int32_t n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(uv + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(uv + i * 2 + 16));
+
+        _mm_storeu_si128((__m128i *)(u + i),
+                         _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(v + i),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    splitUVScalar(uv + i * 2, u + i, v + i, n - i);
+}
+
+/*
+ * 16 pixels of one row to R, G, B bytes. The chroma terms are computed
+ * once for 8 pairs and duplicated, (x << 7) * coeff >> 16 is mulhi.
+ */
+__attribute__((target("ssse3")))
+static inline void yuvToRgbSsse3(const uint8_t *y, const uint8_t *uv,
+                                 const ColorCoeffs *c,
+                                 __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(8);
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i yOffset = _mm_set1_epi16(c->yOffset);
+
+    __m128i yv = _mm_loadu_si128((const __m128i *)y);
+    __m128i cv = _mm_loadu_si128((const __m128i *)uv);
+
+    __m128i uu = _mm_slli_epi16(_mm_sub_epi16(_mm_and_si128(cv, _mm_set1_epi16(0x00ff)), bias), 7);
+    __m128i vv = _mm_slli_epi16(_mm_sub_epi16(_mm_srli_epi16(cv, 8), bias), 7);
+
+    __m128i rc = _mm_mulhi_epi16(vv, _mm_set1_epi16(c->crv));
+    __m128i gc = _mm_add_epi16(_mm_mulhi_epi16(uu, _mm_set1_epi16(c->cgu)),
+                               _mm_mulhi_epi16(vv, _mm_set1_epi16(c->cgv)));
+    __m128i bc = _mm_mulhi_epi16(uu, _mm_set1_epi16(c->cbu));
+
+    __m128i cy = _mm_set1_epi16(c->cy);
+    __m128i yl = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(
+                     _mm_unpacklo_epi8(yv, zero), yOffset), 7), cy);
+    __m128i yh = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(
+                     _mm_unpackhi_epi8(yv, zero), yOffset), 7), cy);
+    yl = _mm_add_epi16(yl, round);
+    yh = _mm_add_epi16(yh, round);
+
+    *r = _mm_packus_epi16(
+             _mm_srai_epi16(_mm_add_epi16(yl, _mm_unpacklo_epi16(rc, rc)), 4),
+             _mm_srai_epi16(_mm_add_epi16(yh, _mm_unpackhi_epi16(rc, rc)), 4));
+    *g = _mm_packus_epi16(
+             _mm_srai_epi16(_mm_sub_epi16(yl, _mm_unpacklo_epi16(gc, gc)), 4),
+             _mm_srai_epi16(_mm_sub_epi16(yh, _mm_unpackhi_epi16(gc, gc)), 4));
+    *b = _mm_packus_epi16(
+             _mm_srai_epi16(_mm_add_epi16(yl, _mm_unpacklo_epi16(bc, bc)), 4),
+             _mm_srai_epi16(_mm_add_epi16(yh, _mm_unpackhi_epi16(bc, bc)), 4));
+}
+
+__attribute__((target("ssse3")))
+static void toRgbaSsse3(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                        int32_t width, const ColorCoeffs *c)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    int32_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        __m128i r, g, b;
+
+        yuvToRgbSsse3(y + i, uv + i, c, &r, &g, &b);
+
+        __m128i rgl = _mm_unpacklo_epi8(r, g);
+        __m128i rgh = _mm_unpackhi_epi8(r, g);
+        __m128i bal = _mm_unpacklo_epi8(b, alpha);
+        __m128i bah = _mm_unpackhi_epi8(b, alpha);
+        __m128i *p = (__m128i *)(dst + i * 4);
+
+        _mm_storeu_si128(p + 0, _mm_unpacklo_epi16(rgl, bal));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(rgl, bal));
+        _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(rgh, bah));
+        _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(rgh, bah));
+    }
+
+    rgbRowScalar(y + i, uv + i, dst + i * 4, width - i, c, 4, 0, 2);
+}
+
+__attribute__((target("ssse3")))
+static void toBgrSsse3(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                       int32_t width, const ColorCoeffs *c)
+{
+    // BGRx to BGR in each 4 pixels, the top 4 bytes cleared
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                                       -1, -1, -1, -1);
+    const __m128i zero = _mm_setzero_si128();
+    int32_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        __m128i r, g, b;
+
+        yuvToRgbSsse3(y + i, uv + i, c, &r, &g, &b);
+
+        __m128i bgl = _mm_unpacklo_epi8(b, g);
+        __m128i bgh = _mm_unpackhi_epi8(b, g);
+        __m128i rl = _mm_unpacklo_epi8(r, zero);
+        __m128i rh = _mm_unpackhi_epi8(r, zero);
+
+        __m128i p0 = _mm_shuffle_epi8(_mm_unpacklo_epi16(bgl, rl), shuf);
+        __m128i p1 = _mm_shuffle_epi8(_mm_unpackhi_epi16(bgl, rl), shuf);
+        __m128i p2 = _mm_shuffle_epi8(_mm_unpacklo_epi16(bgh, rh), shuf);
+        __m128i p3 = _mm_shuffle_epi8(_mm_unpackhi_epi16(bgh, rh), shuf);
+        __m128i *p = (__m128i *)(dst + i * 3);
+
+        // 4 x 12 bytes joined to 3 x 16 bytes
+        _mm_storeu_si128(p + 0, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+        _mm_storeu_si128(p + 1, _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+        _mm_storeu_si128(p + 2, _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+    }
+
+    rgbRowScalar(y + i, uv + i, dst + i * 3, width - i, c, 3, 2, 0);
+}
+
+/*
+ * 8 samples from 10 bytes, each 16bit lane gets the two bytes holding its
+ * sample by pshufb, the multiply moves the sample to bits 6..15, which is
+ * P010 already, the variable shift of 0/2/4/6 bits is not needed.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i load10Ssse3(const uint8_t *src)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+    const __m128i mul = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), shuf);
+
+    return _mm_mullo_epi16(x, mul);
+}
+
+__attribute__((target("ssse3")))
+static void unpack10Ssse3(const uint8_t *src, uint16_t *dst, int32_t n, int32_t msb)
+{
+    const __m128i mask = _mm_set1_epi16((short)0xffc0);
+    int32_t bytes = (n * 10 + 7) / 8;
+    int32_t i = 0;
+
+    // 16 bytes loaded for 10, stop before reading over the row
+    for (; i + 8 <= n && i / 4 * 5 + 16 <= bytes; i += 8) {
+        __m128i x = load10Ssse3(src + i / 4 * 5);
+
+        x = msb ? _mm_and_si128(x, mask) : _mm_srli_epi16(x, 6);
+        _mm_storeu_si128((__m128i *)(dst + i), x);
+    }
+
+    for (; i < n; i++)
+        dst[i] = getSample10(src, i) << (msb ? 6 : 0);
+}
+
+__attribute__((target("ssse3")))
+static void down10Ssse3(const uint8_t *src, uint8_t *dst, int32_t n,
+                        const uint16_t *pattern)
+{
+    const __m128i pat = _mm_loadu_si128((const __m128i *)pattern);
+    int32_t bytes = (n * 10 + 7) / 8;
+    int32_t i = 0;
+
+    for (; i + 8 <= n && i / 4 * 5 + 16 <= bytes; i += 8) {
+        __m128i x = _mm_srli_epi16(load10Ssse3(src + i / 4 * 5), 6);
+
+        x = _mm_srli_epi16(_mm_add_epi16(x, pat), 2);
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(x, x));
+    }
+
+    for (; i < n; i++) {
+        int32_t val = (getSample10(src, i) + pattern[i & 7]) >> 2;
+        dst[i] = (val > 255) ? 255 : val;
+    }
+}
+
+static const ColorKernelFuncs sSsse3Funcs = {
+    splitUVSsse3, toRgbaSsse3, toBgrSsse3, unpack10Ssse3, down10Ssse3,
+};
+#endif
+
+#ifdef COLOR_CONVERT_NEON
+static const ColorKernelFuncs sNeonFuncs = {
+    color_split_uv_neon, color_nv12_to_rgba_neon, color_nv12_to_bgr_neon,
+    color_unpack10_neon, color_down10_neon,
+};
+#endif
+
+static const ColorKernelFuncs *kernelFuncs(ColorKernel kernel)
+{
+    switch (kernel) {
+    case COLOR_KERNEL_SCALAR:
+        return &sScalarFuncs;
+#ifdef COLOR_CONVERT_X86
+    case COLOR_KERNEL_SSSE3:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") ? &sSsse3Funcs : NULL;
+#endif
+#ifdef COLOR_CONVERT_NEON
+    case COLOR_KERNEL_NEON:
+#if defined(__arm__)
+        return (getauxval(AT_HWCAP) & HWCAP_NEON) ? &sNeonFuncs : NULL;
+#else
+        return &sNeonFuncs;
+#endif
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static void initKernel()
+{
+    static const ColorKernel order[] = {
+        COLOR_KERNEL_NEON,
+        COLOR_KERNEL_SSSE3,
+        COLOR_KERNEL_SCALAR,
+    };
+
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        const ColorKernelFuncs *funcs = kernelFuncs(order[i]);
+        if (funcs != NULL) {
+            sKernel = order[i];
+            sFuncs = funcs;
+            break;
+        }
+    }
+
+    ALOGD("color convert kernel %s", color_kernel_name(sKernel));
+}
+
+int32_t color_convert_set_kernel(ColorKernel kernel)
+{
+    const ColorKernelFuncs *funcs;
+
+    pthread_once(&sKernelOnce, initKernel);
+
+    if (kernel == COLOR_KERNEL_AUTO) {
+        initKernel();
+        return 1;
+    }
+
+    funcs = kernelFuncs(kernel);
+    if (funcs == NULL)
+        return 0;
+
+    sKernel = kernel;
+    sFuncs = funcs;
+
+    return 1;
+}
+
+ColorKernel color_convert_get_kernel()
+{
+    pthread_once(&sKernelOnce, initKernel);
+
+    return sKernel;
+}
+
+const char *color_kernel_name(ColorKernel kernel)
+{
+    switch (kernel) {
+    case COLOR_KERNEL_AUTO:     return "auto";
+    case COLOR_KERNEL_SCALAR:   return "scalar";
+    case COLOR_KERNEL_SSSE3:    return "ssse3";
+    case COLOR_KERNEL_NEON:     return "neon";
+    default:                    return "unknown";
+    }
+}
+
+const char *color_format_name(ColorFormat format)
+{
+    switch (format) {
+    case COLOR_FORMAT_NV12:     return "nv12";
+    case COLOR_FORMAT_I420:     return "i420";
+    case COLOR_FORMAT_RGBA8888: return "rgba";
+    case COLOR_FORMAT_BGR888:   return "bgr";
+    case COLOR_FORMAT_NV12_10:  return "nv12_10";
+    case COLOR_FORMAT_P010:     return "p010";
+    case COLOR_FORMAT_I010:     return "i010";
+    default:                    return "unknown";
+    }
+}
+
+int32_t color_frame_bit_depth(const VPU_FRAME *frame)
+{
+    if ((frame->ColorType & VPU_OUTPUT_FORMAT_TYPE_MASK) != VPU_OUTPUT_FORMAT_YUV420_SEMIPLANAR)
+        return 0;
+
+    switch (frame->ColorType & VPU_OUTPUT_FORMAT_BIT_MASK) {
+    case VPU_OUTPUT_FORMAT_BIT_8:
+        return 8;
+    case VPU_OUTPUT_FORMAT_BIT_10:
+        return 10;
+    default:
+        return 0;
+    }
+}
+
+int32_t color_image_from_frame(ColorImage *img, const VPU_FRAME *frame)
+{
+    uint8_t *base = (uint8_t *)frame->vpumem.vir_addr;
+    int32_t depth = color_frame_bit_depth(frame);
+    // the stride is in bytes, 10bit rows are 5 / 4 of the width
+    uint32_t rowBytes = (depth == 10) ? (frame->DisplayWidth * 10 + 7) / 8 :
+                        frame->DisplayWidth;
+
+    if (base == NULL || depth == 0 ||
+        rowBytes > frame->FrameWidth ||
+        frame->DisplayHeight > frame->FrameHeight) {
+        ALOGE("unsupported frame 0x%x %dx%d(%dx%d)", frame->ColorType,
+              frame->DisplayWidth, frame->DisplayHeight,
+              frame->FrameWidth, frame->FrameHeight);
+        return -1;
+    }
+
+    memset(img, 0, sizeof(*img));
+    img->plane[0] = base;
+    img->plane[1] = base + frame->FrameWidth * frame->FrameHeight;
+    img->stride[0] = frame->FrameWidth;
+    img->stride[1] = frame->FrameWidth;
+    img->width = frame->DisplayWidth;
+    img->height = frame->DisplayHeight;
+    img->format = (depth == 10) ? COLOR_FORMAT_NV12_10 : COLOR_FORMAT_NV12;
+
+    return 0;
+}
+
+ColorMatrix color_matrix_from_frame(const VPU_FRAME *frame, int32_t *fullRange)
+{
+    if (fullRange != NULL)
+        *fullRange = frame->ColorRange;
+
+    switch (frame->ColorType & VPU_OUTPUT_FORMAT_COLORSPACE_MASK) {
+    case VPU_OUTPUT_FORMAT_COLORSPACE_BT709:
+        return COLOR_MATRIX_BT709;
+    case VPU_OUTPUT_FORMAT_COLORSPACE_BT2020:
+        return COLOR_MATRIX_BT2020;
+    default:
+        return COLOR_MATRIX_BT601;
+    }
+}
+
+int32_t color_image_size(ColorFormat format, int32_t width, int32_t height)
+{
+    int32_t chroma = ((width + 1) / 2) * ((height + 1) / 2);
+
+    switch (format) {
+    case COLOR_FORMAT_NV12:
+    case COLOR_FORMAT_I420:
+        return width * height + chroma * 2;
+    case COLOR_FORMAT_RGBA8888:
+        return width * height * 4;
+    case COLOR_FORMAT_BGR888:
+        return width * height * 3;
+    case COLOR_FORMAT_NV12_10:
+        return (width * 10 + 7) / 8 * (height + (height + 1) / 2);
+    case COLOR_FORMAT_P010:
+    case COLOR_FORMAT_I010:
+        return (width * height + chroma * 2) * 2;
+    default:
+        return 0;
+    }
+}
+
+void color_image_setup(ColorImage *img, uint8_t *buf, ColorFormat format,
+                       int32_t width, int32_t height)
+{
+    int32_t cw = (width + 1) / 2;
+    int32_t ch = (height + 1) / 2;
+
+    memset(img, 0, sizeof(*img));
+    img->width = width;
+    img->height = height;
+    img->format = format;
+    img->plane[0] = buf;
+
+    switch (format) {
+    case COLOR_FORMAT_NV12:
+        img->stride[0] = width;
+        img->plane[1] = buf + width * height;
+        img->stride[1] = cw * 2;
+        break;
+    case COLOR_FORMAT_I420:
+        img->stride[0] = width;
+        img->plane[1] = buf + width * height;
+        img->stride[1] = cw;
+        img->plane[2] = img->plane[1] + cw * ch;
+        img->stride[2] = cw;
+        break;
+    case COLOR_FORMAT_RGBA8888:
+        img->stride[0] = width * 4;
+        break;
+    case COLOR_FORMAT_BGR888:
+        img->stride[0] = width * 3;
+        break;
+    case COLOR_FORMAT_NV12_10:
+        img->stride[0] = (width * 10 + 7) / 8;
+        img->plane[1] = buf + img->stride[0] * height;
+        img->stride[1] = img->stride[0];
+        break;
+    case COLOR_FORMAT_P010:
+        img->stride[0] = width * 2;
+        img->plane[1] = buf + width * 2 * height;
+        img->stride[1] = cw * 4;
+        break;
+    case COLOR_FORMAT_I010:
+        img->stride[0] = width * 2;
+        img->plane[1] = buf + width * 2 * height;
+        img->stride[1] = cw * 2;
+        img->plane[2] = img->plane[1] + cw * 2 * ch;
+        img->stride[2] = cw * 2;
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * (1 - Kr - Kb) is the green weight, limited range scales luma by 255/219
+ * and chroma by 255/224 and removes the 16 offset.
+ */
+void color_coeffs_init(ColorCoeffs *coeffs, ColorMatrix matrix, int32_t fullRange)
+{
+    static const double kr[COLOR_MATRIX_BUTT] = { 0.299,  0.2126, 0.2627 };
+    static const double kb[COLOR_MATRIX_BUTT] = { 0.114,  0.0722, 0.0593 };
+    double r = kr[(matrix < COLOR_MATRIX_BUTT) ? matrix : COLOR_MATRIX_BT601];
+    double b = kb[(matrix < COLOR_MATRIX_BUTT) ? matrix : COLOR_MATRIX_BT601];
+    double g = 1.0 - r - b;
+    double ys = fullRange ? 1.0 : 255.0 / 219.0;
+    double cs = fullRange ? 1.0 : 255.0 / 224.0;
+
+    coeffs->yOffset = fullRange ? 0 : 16;
+    coeffs->cy = (int16_t)(ys * 8192 + 0.5);
+    coeffs->crv = (int16_t)(2 * (1 - r) * cs * 8192 + 0.5);
+    coeffs->cgu = (int16_t)(2 * (1 - b) * b / g * cs * 8192 + 0.5);
+    coeffs->cgv = (int16_t)(2 * (1 - r) * r / g * cs * 8192 + 0.5);
+    coeffs->cbu = (int16_t)(2 * (1 - b) * cs * 8192 + 0.5);
+}
+
+RKColorConvert::RKColorConvert()
+{
+    mThreads = 1;
+    mDither = false;
+    mWorkers = NULL;
+    mGeneration = 0;
+    mNextBand = 0;
+    mPending = 0;
+    mQuit = false;
+
+    memset(&mJob, 0, sizeof(mJob));
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mStartCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+}
+
+RKColorConvert::~RKColorConvert()
+{
+    deinit();
+
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mStartCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+int32_t RKColorConvert::init(int32_t threads)
+{
+    if (threads < 1)
+        threads = 1;
+    if (threads > COLOR_MAX_THREADS)
+        threads = COLOR_MAX_THREADS;
+
+    deinit();
+
+    // kernel chosen before any worker runs
+    color_convert_get_kernel();
+
+    mQuit = false;
+    mThreads = 1;
+
+    if (threads > 1) {
+        mWorkers = (pthread_t *)calloc(threads - 1, sizeof(pthread_t));
+        if (mWorkers == NULL)
+            return -1;
+
+        for (int32_t i = 0; i < threads - 1; i++) {
+            if (pthread_create(&mWorkers[i], NULL, workerThread, this)) {
+                ALOGE("failed to create convert worker %d", i);
+                break;
+            }
+            mThreads++;
+        }
+    }
+
+    ALOGV("color convert with %d threads", mThreads);
+
+    return 0;
+}
+
+void RKColorConvert::deinit()
+{
+    if (mWorkers == NULL)
+        return;
+
+    pthread_mutex_lock(&mLock);
+    mQuit = true;
+    pthread_cond_broadcast(&mStartCond);
+    pthread_mutex_unlock(&mLock);
+
+    for (int32_t i = 0; i < mThreads - 1; i++)
+        pthread_join(mWorkers[i], NULL);
+
+    free(mWorkers);
+    mWorkers = NULL;
+    mThreads = 1;
+}
+
+void *RKColorConvert::workerThread(void *arg)
+{
+    RKColorConvert *convert = (RKColorConvert *)arg;
+
+    convert->workerLoop();
+
+    return NULL;
+}
+
+void RKColorConvert::workerLoop()
+{
+    int32_t generation = 0;
+
+    pthread_mutex_lock(&mLock);
+    while (true) {
+        while (!mQuit && (generation == mGeneration || mNextBand >= mThreads))
+            pthread_cond_wait(&mStartCond, &mLock);
+        if (mQuit)
+            break;
+
+        generation = mGeneration;
+        while (mNextBand < mThreads) {
+            int32_t band = mNextBand++;
+
+            pthread_mutex_unlock(&mLock);
+            convertBand(band);
+            pthread_mutex_lock(&mLock);
+
+            if (--mPending == 0)
+                pthread_cond_signal(&mDoneCond);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * rows are split on even lines, so that each band owns its chroma rows.
+ */
+void RKColorConvert::convertBand(int32_t band)
+{
+    const ColorImage *src = mJob.src;
+    ColorImage *dst = mJob.dst;
+    const ColorKernelFuncs *funcs = sFuncs;
+    int32_t rows = ((src->height + 1) / 2 + mThreads - 1) / mThreads * 2;
+    int32_t top = band * rows;
+    int32_t bottom = top + rows;
+    int32_t cw = (src->width + 1) / 2;
+
+    if (bottom > src->height)
+        bottom = src->height;
+
+    if (src->format == COLOR_FORMAT_NV12_10) {
+        convertBand10(top, bottom);
+        return;
+    }
+
+    for (int32_t i = top; i < bottom; i++) {
+        const uint8_t *y = src->plane[0] + (size_t)i * src->stride[0];
+        const uint8_t *uv = src->plane[1] + (size_t)(i / 2) * src->stride[1];
+
+        switch (dst->format) {
+        case COLOR_FORMAT_NV12:
+        case COLOR_FORMAT_I420:
+            memcpy(dst->plane[0] + (size_t)i * dst->stride[0], y, src->width);
+            if (i & 1)
+                break;
+            if (dst->format == COLOR_FORMAT_NV12) {
+                memcpy(dst->plane[1] + (size_t)(i / 2) * dst->stride[1], uv, cw * 2);
+            } else {
+                funcs->splitUV(uv, dst->plane[1] + (size_t)(i / 2) * dst->stride[1],
+                               dst->plane[2] + (size_t)(i / 2) * dst->stride[2], cw);
+            }
+            break;
+        case COLOR_FORMAT_RGBA8888:
+            funcs->toRgba(y, uv, dst->plane[0] + (size_t)i * dst->stride[0],
+                          src->width, &mJob.coeffs);
+            break;
+        case COLOR_FORMAT_BGR888:
+            funcs->toBgr(y, uv, dst->plane[0] + (size_t)i * dst->stride[0],
+                         src->width, &mJob.coeffs);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * 2x2 ordered dither for the two dropped bits, the chroma pattern repeats
+ * each value for the U V pair. Without dither +2 rounds.
+ */
+void RKColorConvert::convertBand10(int32_t top, int32_t bottom)
+{
+    static const uint16_t kDitherY[2][8] = {
+        { 0, 2, 0, 2, 0, 2, 0, 2 },
+        { 3, 1, 3, 1, 3, 1, 3, 1 },
+    };
+    static const uint16_t kDitherUV[2][8] = {
+        { 0, 0, 2, 2, 0, 0, 2, 2 },
+        { 3, 3, 1, 1, 3, 3, 1, 1 },
+    };
+    static const uint16_t kRound[8] = { 2, 2, 2, 2, 2, 2, 2, 2 };
+    const ColorImage *src = mJob.src;
+    ColorImage *dst = mJob.dst;
+    const ColorKernelFuncs *funcs = sFuncs;
+    int32_t cw = (src->width + 1) / 2;
+    uint16_t line[COLOR_MAX_WIDTH];
+    uint8_t *line8 = (uint8_t *)line;
+
+    for (int32_t i = top; i < bottom; i++) {
+        const uint8_t *y = src->plane[0] + (size_t)i * src->stride[0];
+        const uint8_t *uv = src->plane[1] + (size_t)(i / 2) * src->stride[1];
+        uint8_t *dy = dst->plane[0] + (size_t)i * dst->stride[0];
+        uint8_t *duv = dst->plane[1] + (size_t)(i / 2) * dst->stride[1];
+
+        switch (dst->format) {
+        case COLOR_FORMAT_P010:
+            funcs->unpack10(y, (uint16_t *)dy, src->width, 1);
+            if (!(i & 1))
+                funcs->unpack10(uv, (uint16_t *)duv, cw * 2, 1);
+            break;
+        case COLOR_FORMAT_I010:
+            funcs->unpack10(y, (uint16_t *)dy, src->width, 0);
+            if (!(i & 1)) {
+                uint16_t *du = (uint16_t *)duv;
+                uint16_t *dv = (uint16_t *)(dst->plane[2] + (size_t)(i / 2) * dst->stride[2]);
+
+                funcs->unpack10(uv, line, cw * 2, 0);
+                for (int32_t j = 0; j < cw; j++) {
+                    du[j] = line[j * 2];
+                    dv[j] = line[j * 2 + 1];
+                }
+            }
+            break;
+        case COLOR_FORMAT_NV12:
+            funcs->down10(y, dy, src->width, mDither ? kDitherY[i & 1] : kRound);
+            if (!(i & 1))
+                funcs->down10(uv, duv, cw * 2, mDither ? kDitherUV[(i / 2) & 1] : kRound);
+            break;
+        case COLOR_FORMAT_I420:
+            funcs->down10(y, dy, src->width, mDither ? kDitherY[i & 1] : kRound);
+            if (!(i & 1)) {
+                funcs->down10(uv, line8, cw * 2, mDither ? kDitherUV[(i / 2) & 1] : kRound);
+                funcs->splitUV(line8, duv, dst->plane[2] + (size_t)(i / 2) * dst->stride[2], cw);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+int32_t RKColorConvert::convert(const ColorImage *src, ColorImage *dst,
+                                ColorMatrix matrix, int32_t fullRange)
+{
+    bool supported = false;
+
+    if (src != NULL && dst != NULL) {
+        if (src->format == COLOR_FORMAT_NV12) {
+            supported = (dst->format <= COLOR_FORMAT_BGR888);
+        } else if (src->format == COLOR_FORMAT_NV12_10) {
+            supported = (dst->format == COLOR_FORMAT_P010 ||
+                         dst->format == COLOR_FORMAT_I010 ||
+                         dst->format == COLOR_FORMAT_NV12 ||
+                         dst->format == COLOR_FORMAT_I420) &&
+                        src->width <= COLOR_MAX_WIDTH;
+        }
+    }
+
+    if (!supported || src->width != dst->width || src->height != dst->height) {
+        ALOGE("invalid convert %s to %s",
+              src ? color_format_name(src->format) : "null",
+              dst ? color_format_name(dst->format) : "null");
+        return -1;
+    }
+
+    if (src->width <= 0 || src->height <= 0)
+        return 0;
+
+    mJob.src = src;
+    mJob.dst = dst;
+    color_coeffs_init(&mJob.coeffs, matrix, fullRange);
+
+    if (mThreads == 1) {
+        color_convert_get_kernel();
+        convertBand(0);
+        return 0;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mGeneration++;
+    mNextBand = 1;
+    mPending = mThreads;
+    pthread_cond_broadcast(&mStartCond);
+    pthread_mutex_unlock(&mLock);
+
+    convertBand(0);
+
+    pthread_mutex_lock(&mLock);
+    if (--mPending > 0) {
+        // help with the bands not taken yet, then wait for the others
+        while (mNextBand < mThreads) {
+            int32_t band = mNextBand++;
+
+            pthread_mutex_unlock(&mLock);
+            convertBand(band);
+            pthread_mutex_lock(&mLock);
+            mPending--;
+        }
+        while (mPending > 0)
+            pthread_cond_wait(&mDoneCond, &mLock);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return 0;
+}
+
+int32_t RKColorConvert::convertFrame(const VPU_FRAME *frame, ColorImage *dst)
+{
+    ColorImage src;
+    ColorMatrix matrix;
+    int32_t fullRange = 0;
+
+    if (color_image_from_frame(&src, frame))
+        return -1;
+
+    matrix = color_matrix_from_frame(frame, &fullRange);
+
+    return convert(&src, dst, matrix, fullRange);
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: color_convert
+ * date  : 2021/03/29
+ */
+
+#ifndef __RKVPU_COLOR_CONVERT_H__
+#define __RKVPU_COLOR_CONVERT_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vpu_api.h"
+
+/*
+ * Pixel format conversion of decoder output, NV12 to I420, RGBA8888 or
+ * BGR888, and the 10bit compact NV12 to P010, I010 or 8bit NV12 / I420. The
+ * kernel is chosen at runtime by cpu features as nal_scan, NEON on arm,
+ * SSSE3 on x86, plain c on others. All kernels share the same fixed point
+ * math, so the results are bit exact between them.
+ */
+typedef enum ColorKernel {
+    COLOR_KERNEL_AUTO,
+    COLOR_KERNEL_SCALAR,
+    COLOR_KERNEL_SSSE3,
+    COLOR_KERNEL_NEON,
+    COLOR_KERNEL_BUTT,
+} ColorKernel;
+
+typedef enum ColorFormat {
+    COLOR_FORMAT_NV12,
+    COLOR_FORMAT_I420,
+    COLOR_FORMAT_RGBA8888,      /* bytes R G B A */
+    COLOR_FORMAT_BGR888,        /* bytes B G R */
+    COLOR_FORMAT_NV12_10,       /* vpu 10bit compact, 4 samples in 5 bytes, stride in bytes */
+    COLOR_FORMAT_P010,          /* NV12 in 16bit, msb aligned */
+    COLOR_FORMAT_I010,          /* I420 in 16bit, lsb aligned */
+    COLOR_FORMAT_BUTT,
+} ColorFormat;
+
+typedef enum ColorMatrix {
+    COLOR_MATRIX_BT601,
+    COLOR_MATRIX_BT709,
+    COLOR_MATRIX_BT2020,
+    COLOR_MATRIX_BUTT,
+} ColorMatrix;
+
+typedef struct ColorImage {
+    uint8_t *plane[3];          /* only plane[0] used by packed rgb */
+    int32_t stride[3];
+    int32_t width;
+    int32_t height;
+    ColorFormat format;
+} ColorImage;
+
+/*
+ * yuv to rgb coefficients in Q13, applied as
+ *   y' = ((y - yOffset) << 7) * cy >> 16, u' = ((u - 128) << 7) * cu >> 16
+ * which leaves 4 fraction bits in 16 bit lanes.
+ */
+typedef struct ColorCoeffs {
+    int16_t yOffset;
+    int16_t cy;
+    int16_t crv;
+    int16_t cgu;
+    int16_t cgv;
+    int16_t cbu;
+} ColorCoeffs;
+
+/*
+ * the display region of a NV12 VPU_FRAME with buffer strides, NV12_10 if
+ * ColorType has VPU_OUTPUT_FORMAT_BIT_10, FrameWidth is the byte stride.
+ */
+int32_t color_image_from_frame(ColorImage *img, const VPU_FRAME *frame);
+
+/* 8 or 10 by ColorType, 0 if not NV12 */
+int32_t color_frame_bit_depth(const VPU_FRAME *frame);
+
+/* colorspace bits of ColorType and ColorRange, BT.601 if not set */
+ColorMatrix color_matrix_from_frame(const VPU_FRAME *frame, int32_t *fullRange);
+
+/* contiguous buffer size of @format, and the planes set up on @buf */
+int32_t color_image_size(ColorFormat format, int32_t width, int32_t height);
+void color_image_setup(ColorImage *img, uint8_t *buf, ColorFormat format,
+                       int32_t width, int32_t height);
+
+void color_coeffs_init(ColorCoeffs *coeffs, ColorMatrix matrix, int32_t fullRange);
+
+/*
+ * Force a specific kernel, used by benchmark and verification.
+ * Return 0 if the kernel is not supported by the cpu.
+ */
+int32_t color_convert_set_kernel(ColorKernel kernel);
+ColorKernel color_convert_get_kernel();
+const char *color_kernel_name(ColorKernel kernel);
+const char *color_format_name(ColorFormat format);
+
+/*
+ * Converts a frame with worker threads, each thread takes a band of rows,
+ * the calling thread takes the first band.
+ */
+class RKColorConvert
+{
+public:
+    RKColorConvert();
+    ~RKColorConvert();
+
+    /* @threads: threads working on one frame, the calling one included */
+    int32_t init(int32_t threads);
+    void deinit();
+
+    /*
+     * @src NV12: @dst NV12 / I420 / RGBA8888 / BGR888 of the same size
+     * @src NV12_10: @dst P010 / I010 / NV12 / I420
+     */
+    int32_t convert(const ColorImage *src, ColorImage *dst,
+                    ColorMatrix matrix, int32_t fullRange);
+
+    /* colorspace and range are taken from the frame */
+    int32_t convertFrame(const VPU_FRAME *frame, ColorImage *dst);
+
+    /* ordered dither in 10bit to 8bit, rounding if off */
+    void setDither(bool dither) { mDither = dither; }
+
+private:
+    typedef struct ConvertJob {
+        const ColorImage *src;
+        ColorImage *dst;
+        ColorCoeffs coeffs;
+    } ConvertJob;
+
+    static void *workerThread(void *arg);
+    void workerLoop();
+    void convertBand(int32_t band);
+    void convertBand10(int32_t top, int32_t bottom);
+
+    int32_t mThreads;
+    bool mDither;
+    pthread_t *mWorkers;
+    pthread_mutex_t mLock;
+    pthread_cond_t mStartCond;
+    pthread_cond_t mDoneCond;
+    int32_t mGeneration;    /* bumped for each job */
+    int32_t mNextBand;
+    int32_t mPending;       /* bands not finished */
+    bool mQuit;
+
+    ConvertJob mJob;
+};
+
+#endif  // __RKVPU_COLOR_CONVERT_H__
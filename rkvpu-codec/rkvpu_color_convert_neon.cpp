@@ -0,0 +1,218 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: color_convert neon kernel
+ * date  : 2021/03/29
+ */
+
+#include <stdint.h>
+
+#include "rkvpu_color_convert.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+/*
+ * Built as a separate file so that only these kernels need neon enabled
+ * on armv7, the math matches the scalar and ssse3 kernels bit by bit.
+ */
+static inline int32_t mulQ13(int32_t val, int32_t coeff)
+{
+    return (val * 128 * coeff) >> 16;
+}
+
+static inline uint8_t clampPixel(int32_t val)
+{
+    val = (val + 8) >> 4;
+    return (val < 0) ? 0 : ((val > 255) ? 255 : val);
+}
+
+static void rgbTail(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                    int32_t width, const ColorCoeffs *c,
+                    int32_t bpp, int32_t rIdx, int32_t bIdx)
+{
+    for (int32_t i = 0; i < width; i++) {
+        int32_t uu = uv[i & ~1] - 128;
+        int32_t vv = uv[i | 1] - 128;
+        int32_t yy = mulQ13(y[i] - c->yOffset, c->cy);
+        uint8_t *p = dst + i * bpp;
+
+        p[rIdx] = clampPixel(yy + mulQ13(vv, c->crv));
+        p[1] = clampPixel(yy - mulQ13(uu, c->cgu) - mulQ13(vv, c->cgv));
+        p[bIdx] = clampPixel(yy + mulQ13(uu, c->cbu));
+        if (bpp == 4)
+            p[3] = 0xff;
+    }
+}
+
+/* (x << 7) * coeff >> 16 in 16 bit lanes */
+static inline int16x8_t mulhi(int16x8_t x, int16_t coeff)
+{
+    x = vshlq_n_s16(x, 7);
+
+    return vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(x), coeff), 16),
+                        vshrn_n_s32(vmull_n_s16(vget_high_s16(x), coeff), 16));
+}
+
+static inline uint8x16_t packPixel(int16x8_t lo, int16x8_t hi)
+{
+    return vcombine_u8(vqmovun_s16(vshrq_n_s16(lo, 4)),
+                       vqmovun_s16(vshrq_n_s16(hi, 4)));
+}
+
+/* 16 pixels of one row to R, G, B bytes */
+static inline void yuvToRgb(const uint8_t *y, const uint8_t *uv,
+                            const ColorCoeffs *c,
+                            uint8x16_t *r, uint8x16_t *g, uint8x16_t *b)
+{
+    const int16x8_t bias = vdupq_n_s16(128);
+    const int16x8_t yOffset = vdupq_n_s16(c->yOffset);
+    const int16x8_t round = vdupq_n_s16(8);
+
+    uint8x16_t yv = vld1q_u8(y);
+    uint8x8x2_t cv = vld2_u8(uv);
+
+    int16x8_t uu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cv.val[0])), bias);
+    int16x8_t vv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cv.val[1])), bias);
+
+    int16x8x2_t rc = vzipq_s16(mulhi(vv, c->crv), mulhi(vv, c->crv));
+    int16x8_t gt = vaddq_s16(mulhi(uu, c->cgu), mulhi(vv, c->cgv));
+    int16x8x2_t gc = vzipq_s16(gt, gt);
+    int16x8x2_t bc = vzipq_s16(mulhi(uu, c->cbu), mulhi(uu, c->cbu));
+
+    int16x8_t yl = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv))), yOffset);
+    int16x8_t yh = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv))), yOffset);
+    yl = vaddq_s16(mulhi(yl, c->cy), round);
+    yh = vaddq_s16(mulhi(yh, c->cy), round);
+
+    *r = packPixel(vaddq_s16(yl, rc.val[0]), vaddq_s16(yh, rc.val[1]));
+    *g = packPixel(vsubq_s16(yl, gc.val[0]), vsubq_s16(yh, gc.val[1]));
+    *b = packPixel(vaddq_s16(yl, bc.val[0]), vaddq_s16(yh, bc.val[1]));
+}
+
+void color_split_uv_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int32_t n)
+{
+    int32_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t pair = vld2q_u8(uv + i * 2);
+
+        vst1q_u8(u + i, pair.val[0]);
+        vst1q_u8(v + i, pair.val[1]);
+    }
+
+    for (; i < n; i++) {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+}
+
+void color_nv12_to_rgba_neon(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                             int32_t width, const ColorCoeffs *c)
+{
+    int32_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t px;
+
+        yuvToRgb(y + i, uv + i, c, &px.val[0], &px.val[1], &px.val[2]);
+        px.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + i * 4, px);
+    }
+
+    rgbTail(y + i, uv + i, dst + i * 4, width - i, c, 4, 0, 2);
+}
+
+void color_nv12_to_bgr_neon(const uint8_t *y, const uint8_t *uv, uint8_t *dst,
+                            int32_t width, const ColorCoeffs *c)
+{
+    int32_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x3_t px;
+
+        yuvToRgb(y + i, uv + i, c, &px.val[2], &px.val[1], &px.val[0]);
+        vst3q_u8(dst + i * 3, px);
+    }
+
+    rgbTail(y + i, uv + i, dst + i * 3, width - i, c, 3, 2, 0);
+}
+
+/* sample k starts at bit 10 * k, little endian */
+static inline uint16_t getSample10(const uint8_t *src, int32_t k)
+{
+    int32_t bit = k * 10;
+    const uint8_t *p = src + (bit >> 3);
+
+    return ((p[0] | (p[1] << 8)) >> (bit & 7)) & 0x3ff;
+}
+
+/*
+ * 8 samples from 10 bytes, vtbl gives each lane the two bytes holding its
+ * sample and the multiply moves the sample to bits 6..15.
+ */
+static inline uint16x8_t load10(const uint8_t *src)
+{
+    static const uint8_t kShuf[16] = { 0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9 };
+    static const uint16_t kMul[8] = { 64, 16, 4, 1, 64, 16, 4, 1 };
+    uint8x16_t x = vld1q_u8(src);
+    uint8x8x2_t tbl;
+
+    tbl.val[0] = vget_low_u8(x);
+    tbl.val[1] = vget_high_u8(x);
+
+    uint8x8_t lo = vtbl2_u8(tbl, vld1_u8(kShuf));
+    uint8x8_t hi = vtbl2_u8(tbl, vld1_u8(kShuf + 8));
+
+    return vmulq_u16(vreinterpretq_u16_u8(vcombine_u8(lo, hi)), vld1q_u16(kMul));
+}
+
+void color_unpack10_neon(const uint8_t *src, uint16_t *dst, int32_t n, int32_t msb)
+{
+    const uint16x8_t mask = vdupq_n_u16(0xffc0);
+    int32_t bytes = (n * 10 + 7) / 8;
+    int32_t i = 0;
+
+    for (; i + 8 <= n && i / 4 * 5 + 16 <= bytes; i += 8) {
+        uint16x8_t x = load10(src + i / 4 * 5);
+
+        vst1q_u16(dst + i, msb ? vandq_u16(x, mask) : vshrq_n_u16(x, 6));
+    }
+
+    for (; i < n; i++)
+        dst[i] = getSample10(src, i) << (msb ? 6 : 0);
+}
+
+void color_down10_neon(const uint8_t *src, uint8_t *dst, int32_t n,
+                       const uint16_t *pattern)
+{
+    const uint16x8_t pat = vld1q_u16(pattern);
+    int32_t bytes = (n * 10 + 7) / 8;
+    int32_t i = 0;
+
+    for (; i + 8 <= n && i / 4 * 5 + 16 <= bytes; i += 8) {
+        uint16x8_t x = vshrq_n_u16(load10(src + i / 4 * 5), 6);
+
+        vst1_u8(dst + i, vqmovn_u16(vshrq_n_u16(vaddq_u16(x, pat), 2)));
+    }
+
+    for (; i < n; i++) {
+        int32_t val = (getSample10(src, i) + pattern[i & 7]) >> 2;
+        dst[i] = (val > 255) ? 255 : val;
+    }
+}
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: rkvpu_convert_bench sample code
+ * date  : 2021/03/29
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rkvpu_convert_bench"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "rkvpu_color_convert.h"
+
+typedef struct ConvertBenchCtx_t {
+    int32_t width;
+    int32_t height;
+    int32_t frames;         /* frames converted for each case */
+    int32_t threads;
+    ColorMatrix matrix;
+    int32_t fullRange;
+} ConvertBenchCtx;
+
+typedef struct ConvertBenchCase {
+    ColorFormat srcFormat;
+    ColorFormat dstFormat;
+    bool dither;
+} ConvertBenchCase;
+
+static const ConvertBenchCase kCases[] = {
+    { COLOR_FORMAT_NV12,    COLOR_FORMAT_I420,      false },
+    { COLOR_FORMAT_NV12,    COLOR_FORMAT_RGBA8888,  false },
+    { COLOR_FORMAT_NV12,    COLOR_FORMAT_BGR888,    false },
+    { COLOR_FORMAT_NV12_10, COLOR_FORMAT_P010,      false },
+    { COLOR_FORMAT_NV12_10, COLOR_FORMAT_I010,      false },
+    { COLOR_FORMAT_NV12_10, COLOR_FORMAT_NV12,      false },
+    { COLOR_FORMAT_NV12_10, COLOR_FORMAT_NV12,      true  },
+    { COLOR_FORMAT_NV12_10, COLOR_FORMAT_I420,      true  },
+};
+
+#define BENCH_CASE_NUM  (int32_t)(sizeof(kCases) / sizeof(kCases[0]))
+
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Dumps usage on stderr.
+ */
+static void testUsage()
+{
+    fprintf(stderr,
+        "\nUsage: rkvpu_convert_bench [options] \n"
+        "Pixel format conversion benchmark, NV12 and 10bit NV12 to each output format.\n"
+        "  - rkvpu_convert_bench --w 1920 --h 1080 --j 4\n"
+        "\n"
+        "Options:\n"
+        "--u\n"
+        "    Show this message.\n"
+        "--w\n"
+        "    the width of picture, default 1920\n"
+        "--h\n"
+        "    the height of picture, default 1080\n"
+        "--n\n"
+        "    frames converted for each case, default 200\n"
+        "--j\n"
+        "    threads working on one frame, default 1\n"
+        "--c\n"
+        "    color matrix:\n"
+        "        0: bt601(default)\n"
+        "        1: bt709\n"
+        "        2: bt2020\n"
+        "--r\n"
+        "    full range yuv, limited range if not set\n"
+        "\n");
+}
+
+static int32_t testParseArgs(ConvertBenchCtx *ctx, int argc, char **argv)
+{
+    static const struct option longOptions[] = {
+        { "usage",              no_argument,        NULL, 'u' },
+        { "width",              required_argument,  NULL, 'w' },
+        { "height",             required_argument,  NULL, 'h' },
+        { "number",             required_argument,  NULL, 'n' },
+        { "jobs",               required_argument,  NULL, 'j' },
+        { "color",              required_argument,  NULL, 'c' },
+        { "range",              no_argument,        NULL, 'r' },
+        { NULL,                 0,                  NULL, 0 }
+    };
+
+    ctx->width = 1920;
+    ctx->height = 1080;
+    ctx->frames = 200;
+    ctx->threads = 1;
+    ctx->matrix = COLOR_MATRIX_BT601;
+    ctx->fullRange = 0;
+
+    while (true) {
+        int optionIndex = 0;
+        int ic = getopt_long(argc, argv, "", longOptions, &optionIndex);
+        if (ic == -1) {
+            break;
+        }
+
+        switch (ic) {
+        case 'u':
+            return -1;
+        case 'w':
+            ctx->width = atoi(optarg);
+            break;
+        case 'h':
+            ctx->height = atoi(optarg);
+            break;
+        case 'n':
+            ctx->frames = atoi(optarg);
+            break;
+        case 'j':
+            ctx->threads = atoi(optarg);
+            break;
+        case 'c':
+            ctx->matrix = (ColorMatrix)atoi(optarg);
+            break;
+        case 'r':
+            ctx->fullRange = 1;
+            break;
+        default:
+            fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
+            return -1;
+        }
+    }
+
+    if (ctx->width <= 0 || ctx->height <= 0 || ctx->frames <= 0 ||
+        ctx->threads <= 0 || ctx->matrix >= COLOR_MATRIX_BUTT) {
+        fprintf(stderr, "ERROR: invalid bench parameters\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int32_t genFrameSize(int32_t width, int32_t height)
+{
+    return ((width * 10 / 8 + 16) & ~15) * ((height + 15) & ~15) * 3 / 2;
+}
+
+/*
+ * NV12 or 10bit compact NV12 in a decoder like buffer, 16 aligned byte
+ * strides with gradients and noise so that the clamping paths are taken
+ * as well.
+ */
+static void genSyntheticFrame(ColorImage *img, uint8_t *buf, ColorFormat format,
+                              int32_t width, int32_t height)
+{
+    int32_t rowBytes = (format == COLOR_FORMAT_NV12_10) ? (width * 10 + 7) / 8 : width;
+    int32_t stride = (rowBytes + 15) & ~15;
+    int32_t vstride = (height + 15) & ~15;
+    uint32_t seed = 0x12345678;
+
+    memset(img, 0, sizeof(*img));
+    img->plane[0] = buf;
+    img->plane[1] = buf + stride * vstride;
+    img->stride[0] = stride;
+    img->stride[1] = stride;
+    img->width = width;
+    img->height = height;
+    img->format = format;
+
+    for (int32_t i = 0; i < stride * vstride * 3 / 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)((i % stride) + (i / stride) + ((seed >> 24) & 0x1f));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ConvertBenchCtx ctx;
+    RKColorConvert convert;
+    ColorImage src8, src10;
+    uint8_t *srcBuf8 = NULL;
+    uint8_t *srcBuf10 = NULL;
+    uint8_t *dstBuf = NULL;
+    uint8_t *refBuf[BENCH_CASE_NUM] = { NULL };
+    int32_t ret;
+
+    ret = testParseArgs(&ctx, argc, argv);
+    if (ret != 0) {
+        testUsage();
+        return 1;
+    }
+
+    srcBuf8 = (uint8_t *)malloc(genFrameSize(ctx.width, ctx.height));
+    srcBuf10 = (uint8_t *)malloc(genFrameSize(ctx.width, ctx.height));
+    dstBuf = (uint8_t *)malloc(color_image_size(COLOR_FORMAT_RGBA8888, ctx.width, ctx.height));
+    if (srcBuf8 == NULL || srcBuf10 == NULL || dstBuf == NULL) {
+        fprintf(stderr, "ERROR: failed to malloc frame buffers\n");
+        ret = -1;
+        goto BENCH_OUT;
+    }
+
+    genSyntheticFrame(&src8, srcBuf8, COLOR_FORMAT_NV12, ctx.width, ctx.height);
+    genSyntheticFrame(&src10, srcBuf10, COLOR_FORMAT_NV12_10, ctx.width, ctx.height);
+
+    if (convert.init(ctx.threads)) {
+        fprintf(stderr, "ERROR: failed to init convert threads\n");
+        ret = -1;
+        goto BENCH_OUT;
+    }
+
+    printf("\nconvert %dx%d %d frames, %d threads, matrix %d %s range\n",
+           ctx.width, ctx.height, ctx.frames, ctx.threads, ctx.matrix,
+           ctx.fullRange ? "full" : "limited");
+
+    for (int32_t k = COLOR_KERNEL_SCALAR; k < COLOR_KERNEL_BUTT; k++) {
+        ColorKernel kernel = (ColorKernel)k;
+
+        if (!color_convert_set_kernel(kernel)) {
+            printf("  %-8s: not supported\n", color_kernel_name(kernel));
+            continue;
+        }
+
+        for (int32_t f = 0; f < BENCH_CASE_NUM; f++) {
+            const ConvertBenchCase *bc = &kCases[f];
+            const ColorImage *src = (bc->srcFormat == COLOR_FORMAT_NV12_10) ? &src10 : &src8;
+            int32_t size = color_image_size(bc->dstFormat, ctx.width, ctx.height);
+            ColorImage dst;
+            int64_t startUs, elapsedUs;
+
+            color_image_setup(&dst, dstBuf, bc->dstFormat, ctx.width, ctx.height);
+            convert.setDither(bc->dither);
+
+            startUs = time_now_us();
+            for (int32_t i = 0; i < ctx.frames; i++)
+                convert.convert(src, &dst, ctx.matrix, ctx.fullRange);
+            elapsedUs = time_now_us() - startUs;
+            if (elapsedUs <= 0)
+                elapsedUs = 1;
+
+            // the scalar output is the reference of others
+            if (refBuf[f] == NULL) {
+                refBuf[f] = (uint8_t *)malloc(size);
+                if (refBuf[f] != NULL)
+                    memcpy(refBuf[f], dstBuf, size);
+            } else if (memcmp(refBuf[f], dstBuf, size)) {
+                fprintf(stderr, "ERROR: kernel %s %s to %s mismatch\n",
+                        color_kernel_name(kernel), color_format_name(bc->srcFormat),
+                        color_format_name(bc->dstFormat));
+                ret = -1;
+            }
+
+            printf("  %-8s: %-7s -> %-4s %-6s %8.1f fps %8.1f MPix/s %7.3f GB/s out\n",
+                   color_kernel_name(kernel), color_format_name(bc->srcFormat),
+                   color_format_name(bc->dstFormat), bc->dither ? "dither" : "",
+                   ctx.frames * 1E6 / elapsedUs,
+                   (double)ctx.width * ctx.height * ctx.frames / elapsedUs,
+                   (double)size * ctx.frames / 1E3 / elapsedUs);
+        }
+    }
+
+    color_convert_set_kernel(COLOR_KERNEL_AUTO);
+    printf("runtime selected kernel: %s\n",
+           color_kernel_name(color_convert_get_kernel()));
+
+BENCH_OUT:
+    convert.deinit();
+
+    free(srcBuf8);
+    free(srcBuf10);
+    free(dstBuf);
+    for (int32_t f = 0; f < BENCH_CASE_NUM; f++)
+        free(refBuf[f]);
+
+    return (ret == 0) ? 0 : 1;
+}
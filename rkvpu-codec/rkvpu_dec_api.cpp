@@ -25,8 +25,95 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <new>
 
 #include "rkvpu_dec_api.h"
+#include "rkvpu_stream_index.h"
+
+/* max wait of the worker threads, so that quit is checked in time */
+#define THREAD_WAIT_MS          100
+
+#define DEC_ALIGN(x, a)         (((x) + (a) - 1) & ~((a) - 1))
+
+/* frames out after the seek target is sent at most, the max dpb size */
+#define DEC_SEEK_LATE_MAX       16
+
+static int64_t getNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const char *dynamicRangeName(int32_t colorType)
+{
+    switch (colorType & VPU_OUTPUT_FORMAT_DYNCRANGE_MASK) {
+    case VPU_OUTPUT_FORMAT_DYNCRANGE_SDR:
+        return "sdr";
+    case VPU_OUTPUT_FORMAT_DYNCRANGE_HDR10:
+        return "hdr10";
+    case VPU_OUTPUT_FORMAT_DYNCRANGE_HDR_HLG:
+        return "hlg";
+    case VPU_OUTPUT_FORMAT_DYNCRANGE_HDR_DOLBY:
+        return "dolby";
+    default:
+        return "unknown";
+    }
+}
+
+DecodedFrame::DecodedFrame()
+    : mRef(NULL)
+{
+}
+
+DecodedFrame::~DecodedFrame()
+{
+    reset();
+}
+
+DecodedFrame::DecodedFrame(DecodedFrame &&other)
+    : mRef(other.mRef)
+{
+    other.mRef = NULL;
+}
+
+DecodedFrame &DecodedFrame::operator=(DecodedFrame &&other)
+{
+    if (this != &other) {
+        reset();
+        mRef = other.mRef;
+        other.mRef = NULL;
+    }
+
+    return *this;
+}
+
+DecodedFrame DecodedFrame::share() const
+{
+    DecodedFrame frame;
+
+    if (mRef != NULL) {
+        mRef->refs.fetch_add(1, std::memory_order_relaxed);
+        frame.mRef = mRef;
+    }
+
+    return frame;
+}
+
+void DecodedFrame::reset()
+{
+    if (mRef == NULL)
+        return;
+
+    // the last reference gives the buffer back to the decoder
+    if (mRef->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        mRef->owner->deinitOutFrame(&mRef->frame);
+        delete mRef;
+    }
+    mRef = NULL;
+}
 
 RKHWDecApi::RKHWDecApi()
 {
@@ -35,22 +122,107 @@ RKHWDecApi::RKHWDecApi()
     mVpuCtx = NULL;
     mInitOK = 0;
     mFrameCount = 0;
+    mColorType = -1;
+
+    mFramePool = NULL;
+    mFramePoolNum = 0;
+    mFramePoolSize = 0;
+    memset(mRetiredPools, 0, sizeof(mRetiredPools));
+    mPoolBuffers = NULL;
+    mPoolBufferNum = 0;
+    pthread_mutex_init(&mPoolLock, NULL);
+
+    mCoding = OMX_RK_VIDEO_CodingUnused;
+    mStreamWidth = 0;
+    mStreamHeight = 0;
+    mSpsChangeUs = 0;
+    memset(&mOutFormat, 0, sizeof(mOutFormat));
+    memset(&mHeldFrame, 0, sizeof(mHeldFrame));
+    mHasHeldFrame = false;
+    memset(&mInfoStats, 0, sizeof(mInfoStats));
+
+    mRetryPts = 0;
+
+    mStreamIndex = NULL;
+    mSeeking = false;
+    mSeekFrames = -1;
+    mSeekPts = -1;
+    mSeekLate = 0;
+    mSkipRasl = false;
+
+    mSplitMode = 0;
+    mDecodeMode = DECODE_MODE_ALL;
+    mKeyInterval = 0;
+    mLastKeyPts = -1;
+    mWaitKey = false;
+    memset(&mModeStats, 0, sizeof(mModeStats));
+
+    mErrorPolicy = ERROR_POLICY_PASS;
+    mRecovering = false;
+    mRecoverKeyPts = -1;
+    memset(&mErrorStats, 0, sizeof(mErrorStats));
+
+    pthread_mutex_init(&mCtxLock, NULL);
+    pthread_mutex_init(&mStatsLock, NULL);
+    mThreaded = false;
+    mThreadQuit = false;
+    memset(&mThreadStats, 0, sizeof(mThreadStats));
 }
 
 RKHWDecApi::~RKHWDecApi()
 {
     ALOGV("RKHWDecApi destructor");
 
-    mVpuCtx->flush(mVpuCtx);
+    stopThreads();
+
+    if (mHasHeldFrame) {
+        deinitOutFrame(&mHeldFrame);
+        mHasHeldFrame = false;
+    }
+
     if (mVpuCtx != NULL) {
+        mVpuCtx->flush(mVpuCtx);
         vpu_close_context(&mVpuCtx);
         free(mVpuCtx);
         mVpuCtx = NULL;
     }
+
+    // all frames are back, the decoder is closed, pool can go now
+    if (mFramePool != NULL) {
+        release_vpu_memory_pool_allocator(mFramePool);
+        mFramePool = NULL;
+    }
+    for (int32_t i = 0; i < DEC_RETIRED_POOL_MAX; i++) {
+        if (mRetiredPools[i] != NULL) {
+            release_vpu_memory_pool_allocator(mRetiredPools[i]);
+            mRetiredPools[i] = NULL;
+        }
+    }
+    free(mPoolBuffers);
+    mPoolBuffers = NULL;
+
+    pthread_mutex_destroy(&mPoolLock);
+    pthread_mutex_destroy(&mCtxLock);
+    pthread_mutex_destroy(&mStatsLock);
 }
 
 VPU_RET RKHWDecApi::prepare(int32_t width, int32_t height,
                             OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    DecCfgInfo cfg;
+
+    cfg.width = width;
+    cfg.height = height;
+    cfg.coding = coding;
+    cfg.splitMode = 1;
+    cfg.framePoolNum = 0;
+    cfg.framePoolSize = 0;
+    cfg.latencyMode = 0;
+
+    return prepare(&cfg);
+}
+
+VPU_RET RKHWDecApi::prepare(DecCfgInfo *cfg)
 {
     int32_t ret;
 
@@ -62,16 +234,41 @@ VPU_RET RKHWDecApi::prepare(int32_t width, int32_t height,
     }
 
     mVpuCtx->codecType = CODEC_DECODER;
-    mVpuCtx->videoCoding = coding;
-    mVpuCtx->width = width;
-    mVpuCtx->height = height;
+    mVpuCtx->videoCoding = cfg->coding;
+    mVpuCtx->width = cfg->width;
+    mVpuCtx->height = cfg->height;
     mVpuCtx->extradata = NULL;
     mVpuCtx->extradata_size = 0;
 
+    mCoding = cfg->coding;
+    mStreamWidth = cfg->width;
+    mStreamHeight = cfg->height;
+    mOutFormat.width = cfg->width;
+    mOutFormat.height = cfg->height;
+
     // keep the vpu split mode open if we can't make sure a complete
     // frame will be sent each time.
-    int32_t split = 1;
+    int32_t split = (cfg->splitMode && !cfg->latencyMode) ? 1 : 0;
     mVpuCtx->control(mVpuCtx, VPU_API_SET_PARSER_SPLIT_MODE, (void*)&split);
+    mSplitMode = split;
+
+    /*
+     * latency mode, the parser takes each packet as a whole frame, and the
+     * frame is output once decoded in packet order, no wait for the dpb
+     * to fill up for display order. Set before init as split mode.
+     */
+    if (cfg->latencyMode) {
+        RK_U32 enable = 1;
+
+        if (mVpuCtx->control(mVpuCtx, VPU_API_USE_FAST_MODE, (void*)&enable))
+            ALOGW("fast mode not supported");
+        if (mVpuCtx->control(mVpuCtx, VPU_API_SET_IMMEDIATE_OUT, (void*)&enable))
+            ALOGW("immediate out not supported");
+        if (mVpuCtx->control(mVpuCtx, VPU_API_USE_PRESENT_TIME_ORDER, (void*)&enable))
+            ALOGW("present time order not supported");
+
+        ALOGD("latency mode, split mode off");
+    }
 
     ret = mVpuCtx->init(mVpuCtx, NULL, 0);
     if (ret) {
@@ -79,6 +276,44 @@ VPU_RET RKHWDecApi::prepare(int32_t width, int32_t height,
         return VPU_ERR_INIT;
     }
 
+    /*
+     * fixed output buffers allocated once, the decoder outputs into them
+     * instead of allocating on the fly, memory use is bounded for long run.
+     */
+    if (cfg->framePoolNum > 0) {
+        int32_t size = cfg->framePoolSize;
+        if (size <= 0) {
+            // 64 aligned and room for 10bit output
+            size = DEC_ALIGN(cfg->width, 64) * DEC_ALIGN(cfg->height, 64) * 2;
+        }
+
+        ret = create_vpu_memory_pool_allocator(&mFramePool, cfg->framePoolNum, size);
+        if (ret || mFramePool == NULL) {
+            ALOGE("ERROR: faild to create frame pool %d x %d(err=%d)",
+                  cfg->framePoolNum, size, ret);
+            mFramePool = NULL;
+            return VPU_ERR_INIT;
+        }
+
+        ret = mVpuCtx->control(mVpuCtx, VPU_API_SET_VPUMEM_CONTEXT, (void*)mFramePool);
+        if (ret) {
+            ALOGE("ERROR: faild to set frame pool(err=%d)", ret);
+            return VPU_ERR_INIT;
+        }
+
+        // the buffers of the current pool and of the retired ones
+        mPoolBufferNum = cfg->framePoolNum * (DEC_RETIRED_POOL_MAX + 1);
+        mPoolBuffers = (PoolBuffer *)calloc(mPoolBufferNum, sizeof(PoolBuffer));
+        if (mPoolBuffers == NULL) {
+            ALOGE("ERROR: faild to malloc pool buffer table");
+            return VPU_ERR_INIT;
+        }
+
+        mFramePoolNum = cfg->framePoolNum;
+        mFramePoolSize = size;
+        ALOGD("frame pool %d x %d bytes", mFramePoolNum, mFramePoolSize);
+    }
+
     mInitOK = 1;
 
     return VPU_OK;
@@ -87,6 +322,8 @@ VPU_RET RKHWDecApi::prepare(int32_t width, int32_t height,
 VPU_RET RKHWDecApi::sendStream(char *data, int32_t size, int64_t pts, int32_t flag)
 {
     int32_t ret;
+    int32_t type = -1;
+    int32_t dropSize = 0;
     VideoPacket_t pkt;
 
     if (!mInitOK) {
@@ -99,26 +336,52 @@ VPU_RET RKHWDecApi::sendStream(char *data, int32_t size, int64_t pts, int32_t fl
         return VPU_ERR_UNKNOW;
     }
 
+    // a synthetic pts links the output frame back to this packet, a
+    // packet resent on VPU_EAGAIN keeps the one it got first
+    if (pts <= 0) {
+        if (mRetryPts <= 0)
+            mRetryPts = mLatency.nextPts();
+        pts = mRetryPts;
+    }
+
+    if (size > 0 && dropPacket(data, size, pts, &type)) {
+        // the eos still goes to the vpu, without the frame
+        if (!(flag & OMX_BUFFERFLAG_EOS)) {
+            commitPacket(type, size, pts, true);
+            mRetryPts = 0;
+            return VPU_OK;
+        }
+        dropSize = size;
+        size = 0;
+    }
+
     pkt.data = (unsigned char*)data;
     pkt.size = size;
-    if (pts > 0) {
-        pkt.pts = pts;
-        pkt.dts = pts;
-    } else {
-        pkt.pts = VPU_API_NOPTS_VALUE;
-        pkt.dts = VPU_API_NOPTS_VALUE;
-    }
+    pkt.pts = pts;
+    pkt.dts = pts;
     pkt.nFlags = flag;
 
+    pthread_mutex_lock(&mCtxLock);
     ret = mVpuCtx->decode_sendstream(mVpuCtx, &pkt);
+    pthread_mutex_unlock(&mCtxLock);
     if (ret < 0) {
         ALOGE("failed to send pkt(err=%d)", ret);
+        mRetryPts = 0;
         return VPU_ERR_UNKNOW;
     } else if (pkt.size != 0) {
         return VPU_EAGAIN;
     }
 
-    ALOGD("send pkt size %d pts %lld flag %d", size, pts, flag);
+    mRetryPts = 0;
+    mLatency.onSend(pts);
+    checkStreamInfo(data, size);
+    if (size > 0 || dropSize > 0)
+        commitPacket(type, size > 0 ? size : dropSize, pts, dropSize > 0);
+
+    // new input queued, the output may be ready soon
+    mWaiter.signal();
+
+    ALOGD("send pkt size %d pts %lld flag %d", size, (long long)pts, flag);
 
     return VPU_OK;
 }
@@ -127,18 +390,31 @@ VPU_RET RKHWDecApi::getOutFrame(VPU_FRAME *vframe)
 {
     int32_t ret;
     DecoderOut_t decOut;
+    int64_t pts;
+    bool skip, drop;
 
     if (!mInitOK) {
         ALOGW("W - prepare RKHWDecApi first");
         return VPU_ERR_UNKNOW;
     }
 
+    // the first frame in the new size, held when the change was reported
+    if (mHasHeldFrame) {
+        *vframe = mHeldFrame;
+        mHasHeldFrame = false;
+        return VPU_OK;
+    }
+
+    releaseRetiredPools();
+
     memset(&decOut, 0, sizeof(DecoderOut_t));
     memset(vframe, 0, sizeof(VPU_FRAME));
 
     decOut.data = (unsigned char*)vframe;
 
+    pthread_mutex_lock(&mCtxLock);
     ret = mVpuCtx->decode_getframe(mVpuCtx, &decOut);
+    pthread_mutex_unlock(&mCtxLock);
     if (ret < 0) {
         if (ret == VPU_API_EOS_STREAM_REACHED && !vframe->ErrorInfo) {
             return VPU_EOS_STREAM_REACHED;
@@ -149,22 +425,928 @@ VPU_RET RKHWDecApi::getOutFrame(VPU_FRAME *vframe)
     }
 
     if (decOut.size > 0) {
+        // no buffer, the decoder reports the new info and waits for the ack
+        if (vframe->vpumem.phy_addr == 0 && vframe->vpumem.vir_addr == NULL)
+            return handleInfoChange(vframe);
+
+        if (mFramePoolNum > 0)
+            trackPoolBuffer(vframe);
+
         mFrameCount++;
         ALOGD("get frame_num %d fd 0x%x dimen %dx%d(%dx%d) errinfo %x pts %lld",
               mFrameCount, vframe->vpumem.phy_addr, vframe->FrameWidth,
               vframe->FrameHeight, vframe->DisplayWidth, vframe->DisplayHeight,
               vframe->ErrorInfo, (long long)vframe->ShowTime.TimeLow);
 
+        pts = ((int64_t)vframe->ShowTime.TimeHigh << 32) | vframe->ShowTime.TimeLow;
+        mLatency.onOutput(pts);
+
+        if ((int32_t)vframe->ColorType != mColorType) {
+            mColorType = vframe->ColorType;
+            ALOGI("output color type 0x%x, %d bit %s", mColorType,
+                  (mColorType & VPU_OUTPUT_FORMAT_BIT_10) ? 10 : 8,
+                  dynamicRangeName(mColorType));
+        }
+
+        // out before the seek target, checked first as the target ends it
+        skip = seekSkip(pts);
+
+        // broken, or refers to a broken one
+        drop = mErrorPolicy == ERROR_POLICY_DROP_TO_KEY && dropErrorFrame(vframe);
+
+        pthread_mutex_lock(&mStatsLock);
+        if (vframe->ErrorInfo)
+            mErrorStats.errorFrames++;
+        if (drop)
+            mErrorStats.droppedFrames++;
+        else if (vframe->ErrorInfo)
+            mErrorStats.concealedFrames++;
+        pthread_mutex_unlock(&mStatsLock);
+
+        if (drop) {
+            deinitOutFrame(vframe);
+            return getOutFrame(vframe);
+        }
+
+        // decoded only as reference of the seek target
+        if (skip) {
+            deinitOutFrame(vframe);
+            // the next one may be ready already, don't wait for it
+            return getOutFrame(vframe);
+        }
+
+        // decoders without the info change handshake just output the new size
+        if (mOutFormat.stride > 0 &&
+            ((int32_t)vframe->DisplayWidth != mOutFormat.width ||
+             (int32_t)vframe->DisplayHeight != mOutFormat.height)) {
+            mHeldFrame = *vframe;
+            mHasHeldFrame = true;
+            return changeOutFormat(vframe);
+        }
+
+        if (mOutFormat.stride == 0) {
+            mOutFormat.width = vframe->DisplayWidth;
+            mOutFormat.height = vframe->DisplayHeight;
+            mOutFormat.stride = vframe->FrameWidth;
+            mOutFormat.vstride = vframe->FrameHeight;
+            mOutFormat.colorType = vframe->ColorType;
+        }
+
         return VPU_OK;
     }
 
     return VPU_EAGAIN;
 }
 
+VPU_RET RKHWDecApi::getOutFrame(VPU_FRAME *vframe, int32_t timeoutMs)
+{
+    VPU_RET ret;
+
+    mWaiter.begin(timeoutMs);
+    while (true) {
+        ret = getOutFrame(vframe);
+        if (ret != VPU_EAGAIN)
+            break;
+
+        if (!mWaiter.wait())
+            return VPU_EAGAIN;
+    }
+    mWaiter.done();
+
+    return ret;
+}
+
+VPU_RET RKHWDecApi::getOutFrame(DecodedFrame *frame, int32_t timeoutMs)
+{
+    VPU_FRAME vframe;
+    VPU_RET ret;
+
+    ret = getOutFrame(&vframe, timeoutMs);
+    if (ret != VPU_OK)
+        return ret;
+
+    return attachFrame(frame, &vframe);
+}
+
+VPU_RET RKHWDecApi::attachFrame(DecodedFrame *frame, VPU_FRAME *vframe)
+{
+    DecodedFrame::FrameRef *ref = new (std::nothrow) DecodedFrame::FrameRef;
+
+    if (ref == NULL) {
+        ALOGE("failed to malloc frame handle");
+        deinitOutFrame(vframe);
+        return VPU_ERR_UNKNOW;
+    }
+
+    ref->frame = *vframe;
+    ref->refs.store(1, std::memory_order_relaxed);
+    ref->owner = this;
+
+    frame->reset();
+    frame->mRef = ref;
+
+    return VPU_OK;
+}
+
+void RKHWDecApi::getWaitStats(RKPollWaiter::WaitStats *stats)
+{
+    mWaiter.getStats(stats);
+}
+
+void RKHWDecApi::getLatencyStats(RKLatencyTracker::LatencyStats *stats)
+{
+    mLatency.getStats(stats);
+}
+
+void RKHWDecApi::getOutputFormat(OutputFormat *fmt)
+{
+    *fmt = mOutFormat;
+}
+
+void RKHWDecApi::getInfoChangeStats(InfoChangeStats *stats)
+{
+    pthread_mutex_lock(&mStatsLock);
+    *stats = mInfoStats;
+    pthread_mutex_unlock(&mStatsLock);
+}
+
+VPU_RET RKHWDecApi::flush()
+{
+    int32_t inDepth = 0, outDepth = 0;
+    bool threaded = mThreaded;
+
+    if (!mInitOK) {
+        ALOGW("W - prepare RKHWDecApi first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    // rings hold packets and frames of the old position
+    if (threaded) {
+        inDepth = mInRing.capacity();
+        outDepth = mOutRing.capacity();
+        stopThreads();
+    }
+
+    if (mHasHeldFrame) {
+        deinitOutFrame(&mHeldFrame);
+        mHasHeldFrame = false;
+    }
+
+    pthread_mutex_lock(&mCtxLock);
+    mVpuCtx->flush(mVpuCtx);
+    mSpsChangeUs = 0;
+    pthread_mutex_unlock(&mCtxLock);
+
+    mLatency.flush();
+    mRetryPts = 0;
+    mSeeking = false;
+    mSeekFrames = -1;
+    mSeekPts = -1;
+    mSeekLate = 0;
+    mSkipRasl = false;
+    mRecovering = false;
+    mRecoverKeyPts = -1;
+
+    ALOGD("decoder flushed");
+
+    if (threaded)
+        return startThreads(inDepth, outDepth);
+
+    return VPU_OK;
+}
+
+void RKHWDecApi::setStreamIndex(const RKStreamIndex *index)
+{
+    mStreamIndex = index;
+}
+
+VPU_RET RKHWDecApi::seekTo(int32_t frame, int64_t *offset)
+{
+    RKStreamIndex::KeyFrame key;
+    VPU_RET ret;
+
+    if (mStreamIndex == NULL) {
+        ALOGW("W - setStreamIndex first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (frame < 0 || frame >= mStreamIndex->frameCount()) {
+        ALOGE("seek to frame %d out of %d frames", frame, mStreamIndex->frameCount());
+        return VPU_ERR_STREAM;
+    }
+
+    if (mStreamIndex->findKeyFrame(frame, &key) != VPU_OK) {
+        ALOGE("no key frame before frame %d", frame);
+        return VPU_ERR_STREAM;
+    }
+
+    ret = flush();
+    if (ret != VPU_OK)
+        return ret;
+
+    pthread_mutex_lock(&mCtxLock);
+    mSeeking = true;
+    mSeekFrames = frame - key.frame;
+    mSeekPts = -1;
+    mSeekLate = 0;
+    mSkipRasl = true;
+    pthread_mutex_unlock(&mCtxLock);
+    *offset = key.offset;
+
+    ALOGD("seek to frame %d, key frame %d type %d at %lld", frame, key.frame,
+          key.nalType, (long long)key.offset);
+
+    return VPU_OK;
+}
+
+/*
+ * the frames come out in display order, all the ones before the target
+ * are dropped. A target never out, e.g. discarded by the decoder, ends
+ * the seek once the dpb must have been emptied.
+ */
+bool RKHWDecApi::seekSkip(int64_t pts)
+{
+    bool skip = false;
+
+    pthread_mutex_lock(&mCtxLock);
+    if (mSeeking) {
+        if (mSeekPts >= 0 && pts == mSeekPts) {
+            mSeeking = false;
+        } else if (mSeekPts >= 0 && ++mSeekLate > DEC_SEEK_LATE_MAX) {
+            ALOGW("seek target pts %lld not out, output from pts %lld",
+                  (long long)mSeekPts, (long long)pts);
+            mSeeking = false;
+        } else {
+            skip = true;
+        }
+    }
+    pthread_mutex_unlock(&mCtxLock);
+
+    return skip;
+}
+
+void RKHWDecApi::setDecodeMode(DecodeMode mode, int64_t keyInterval)
+{
+    if (mode != DECODE_MODE_ALL && mSplitMode)
+        ALOGW("decode mode %d needs one frame per packet, split mode is on", mode);
+
+    pthread_mutex_lock(&mCtxLock);
+    // the frames after a key only run refer to the ones dropped
+    if (mDecodeMode == DECODE_MODE_KEY_ONLY && mode != DECODE_MODE_KEY_ONLY)
+        mWaitKey = true;
+    mDecodeMode = mode;
+    mKeyInterval = keyInterval;
+    mLastKeyPts = -1;
+    pthread_mutex_unlock(&mCtxLock);
+
+    ALOGD("decode mode %d key interval %lld", mode, (long long)keyInterval);
+}
+
+void RKHWDecApi::getDecodeModeStats(DecodeModeStats *stats)
+{
+    pthread_mutex_lock(&mStatsLock);
+    *stats = mModeStats;
+    pthread_mutex_unlock(&mStatsLock);
+}
+
+/*
+ * only a check, the packet may come again on VPU_EAGAIN. The state moves
+ * on in commitPacket once the packet is sent or dropped for good.
+ * @type: nal type of the first slice, -1 if not looked at
+ */
+bool RKHWDecApi::dropPacket(const char *data, int32_t size, int64_t pts,
+                            int32_t *type)
+{
+    const uint8_t *nal;
+    bool drop = false;
+
+    *type = -1;
+
+    pthread_mutex_lock(&mCtxLock);
+
+    if (mDecodeMode == DECODE_MODE_ALL && !mWaitKey && !mSkipRasl)
+        goto DROP_OUT;
+
+    nal = sps_find_slice((const uint8_t *)data, size, mCoding);
+    if (nal == NULL)
+        goto DROP_OUT;
+
+    *type = sps_nal_type(nal, mCoding);
+
+    if (sps_is_irap(*type, mCoding)) {
+        // too close to the last key frame sent
+        if (mDecodeMode == DECODE_MODE_KEY_ONLY && mKeyInterval > 0 && pts > 0 &&
+            mLastKeyPts >= 0 && pts - mLastKeyPts < mKeyInterval)
+            drop = true;
+    } else if (mSkipRasl && sps_is_rasl(*type, mCoding)) {
+        // the references of RASL frames are before the seek key frame
+        drop = true;
+    } else if (mWaitKey || mDecodeMode == DECODE_MODE_KEY_ONLY) {
+        drop = true;
+    } else if (mDecodeMode == DECODE_MODE_REF_ONLY) {
+        drop = !sps_is_reference(nal, mCoding);
+    }
+
+DROP_OUT:
+    pthread_mutex_unlock(&mCtxLock);
+    return drop;
+}
+
+/*
+ * the packet of @size bytes with a slice of @type is accepted by the vpu,
+ * or @dropped for good. Not called for VPU_EAGAIN.
+ */
+void RKHWDecApi::commitPacket(int32_t type, int32_t size, int64_t pts, bool dropped)
+{
+    pthread_mutex_lock(&mCtxLock);
+
+    pthread_mutex_lock(&mStatsLock);
+    if (dropped) {
+        mModeStats.droppedFrames++;
+        mModeStats.droppedBytes += size;
+        if (mRecovering)
+            mErrorStats.droppedPackets++;
+    } else {
+        mModeStats.sentFrames++;
+        mModeStats.sentBytes += size;
+    }
+    pthread_mutex_unlock(&mStatsLock);
+
+    if (!dropped) {
+        if (type >= 0 && sps_is_irap(type, mCoding)) {
+            if (mWaitKey && mRecovering && mRecoverKeyPts < 0)
+                mRecoverKeyPts = pts;
+            mWaitKey = false;
+            if (mDecodeMode == DECODE_MODE_KEY_ONLY && mKeyInterval > 0 && pts > 0)
+                mLastKeyPts = pts;
+        } else if (type >= 0 && mSkipRasl && !sps_is_leading(type, mCoding)) {
+            mSkipRasl = false;
+        }
+    }
+
+    if (mSeekFrames == 0 && !dropped) {
+        // the seek target, or the first one sent after it if it was dropped
+        mSeekPts = pts;
+        mSeekFrames = -1;
+    } else if (mSeekFrames > 0) {
+        mSeekFrames--;
+    }
+
+    pthread_mutex_unlock(&mCtxLock);
+}
+
+void RKHWDecApi::setErrorPolicy(ErrorPolicy policy)
+{
+    pthread_mutex_lock(&mCtxLock);
+    mErrorPolicy = policy;
+    if (policy != ERROR_POLICY_DROP_TO_KEY)
+        mRecovering = false;
+    pthread_mutex_unlock(&mCtxLock);
+}
+
+void RKHWDecApi::getErrorStats(ErrorStats *stats)
+{
+    pthread_mutex_lock(&mStatsLock);
+    *stats = mErrorStats;
+    pthread_mutex_unlock(&mStatsLock);
+}
+
+bool RKHWDecApi::dropErrorFrame(VPU_FRAME *vframe)
+{
+    int64_t pts = ((int64_t)vframe->ShowTime.TimeHigh << 32) | vframe->ShowTime.TimeLow;
+    bool drop = false;
+
+    pthread_mutex_lock(&mCtxLock);
+
+    if (vframe->ErrorInfo) {
+        // a broken frame sent before the key frame changes nothing
+        if (!mRecovering || mRecoverKeyPts < 0 || pts >= mRecoverKeyPts) {
+            if (!mRecovering)
+                ALOGW("frame error 0x%x pts %lld, drop to the next key frame",
+                      vframe->ErrorInfo, (long long)pts);
+            mRecovering = true;
+            mRecoverKeyPts = -1;
+            mWaitKey = true;
+        }
+        drop = true;
+    } else if (mRecovering) {
+        // the frames before the key frame in display order refer to the
+        // broken ones too
+        if (mRecoverKeyPts >= 0 && pts >= mRecoverKeyPts) {
+            mRecovering = false;
+            pthread_mutex_lock(&mStatsLock);
+            mErrorStats.recoveries++;
+            pthread_mutex_unlock(&mStatsLock);
+            ALOGD("recovered at pts %lld", (long long)pts);
+        } else {
+            drop = true;
+        }
+    }
+
+    pthread_mutex_unlock(&mCtxLock);
+
+    return drop;
+}
+
+void RKHWDecApi::checkStreamInfo(const char *data, int32_t size)
+{
+    SpsInfo info;
+
+    if (size <= 0 || !sps_find_in_packet((const uint8_t *)data, size, mCoding, &info))
+        return;
+
+    if (info.width == mStreamWidth && info.height == mStreamHeight)
+        return;
+
+    ALOGI("stream size change %dx%d -> %dx%d, %d bit", mStreamWidth,
+          mStreamHeight, info.width, info.height, info.bitDepth);
+
+    mStreamWidth = info.width;
+    mStreamHeight = info.height;
+
+    pthread_mutex_lock(&mStatsLock);
+    mInfoStats.inputChanges++;
+    pthread_mutex_unlock(&mStatsLock);
+
+    pthread_mutex_lock(&mCtxLock);
+    if (mSpsChangeUs == 0)
+        mSpsChangeUs = getNowUs();
+    pthread_mutex_unlock(&mCtxLock);
+}
+
+/*
+ * new output size, the frame pool grows to fit it first. No ack to the
+ * decoder, see handleInfoChange.
+ */
+VPU_RET RKHWDecApi::changeOutFormat(VPU_FRAME *vframe)
+{
+    int32_t width = vframe->DisplayWidth;
+    int32_t height = vframe->DisplayHeight;
+    int64_t switchUs = 0;
+    VPU_RET ret;
+
+    ALOGI("info change %dx%d -> %dx%d(%dx%d)", mOutFormat.width, mOutFormat.height,
+          width, height, vframe->FrameWidth, vframe->FrameHeight);
+
+    // the new frames need to fit in the pool before the decoder goes on
+    if (mFramePoolNum > 0) {
+        int32_t size = DEC_ALIGN(width, 64) * DEC_ALIGN(height, 64) * 2;
+
+        if (size > mFramePoolSize) {
+            ret = resizeFramePool(size);
+            if (ret != VPU_OK)
+                return ret;
+        }
+    }
+
+    pthread_mutex_lock(&mCtxLock);
+    if (mSpsChangeUs > 0) {
+        switchUs = getNowUs() - mSpsChangeUs;
+        mSpsChangeUs = 0;
+    }
+    pthread_mutex_unlock(&mCtxLock);
+
+    mOutFormat.width = width;
+    mOutFormat.height = height;
+    mOutFormat.stride = vframe->FrameWidth;
+    mOutFormat.vstride = vframe->FrameHeight;
+    mOutFormat.colorType = vframe->ColorType;
+
+    pthread_mutex_lock(&mStatsLock);
+    mInfoStats.outputChanges++;
+    mInfoStats.lastSwitchUs = switchUs;
+    if (switchUs > mInfoStats.maxSwitchUs)
+        mInfoStats.maxSwitchUs = switchUs;
+    pthread_mutex_unlock(&mStatsLock);
+
+    return VPU_FORMAT_CHANGED;
+}
+
+/* the info change handshake, the decoder waits for the ack to go on */
+VPU_RET RKHWDecApi::handleInfoChange(VPU_FRAME *vframe)
+{
+    VPU_RET ret = changeOutFormat(vframe);
+
+    if (ret != VPU_FORMAT_CHANGED)
+        return ret;
+
+    pthread_mutex_lock(&mCtxLock);
+    mVpuCtx->control(mVpuCtx, VPU_API_SET_INFO_CHANGE, NULL);
+    pthread_mutex_unlock(&mCtxLock);
+
+    return ret;
+}
+
+VPU_RET RKHWDecApi::resizeFramePool(int32_t size)
+{
+    vpu_display_mem_pool *pool = NULL;
+    int32_t slot, ret;
+
+    // only resized on the thread getting frames, the slot stays free
+    pthread_mutex_lock(&mPoolLock);
+    for (slot = 0; slot < DEC_RETIRED_POOL_MAX; slot++) {
+        if (mRetiredPools[slot] == NULL)
+            break;
+    }
+    pthread_mutex_unlock(&mPoolLock);
+    if (slot == DEC_RETIRED_POOL_MAX) {
+        ALOGE("ERROR: too many frame pools not returned");
+        return VPU_ERR_UNKNOW;
+    }
+
+    ret = create_vpu_memory_pool_allocator(&pool, mFramePoolNum, size);
+    if (ret || pool == NULL) {
+        ALOGE("ERROR: faild to create frame pool %d x %d(err=%d)",
+              mFramePoolNum, size, ret);
+        return VPU_ERR_UNKNOW;
+    }
+
+    pthread_mutex_lock(&mCtxLock);
+    ret = mVpuCtx->control(mVpuCtx, VPU_API_SET_VPUMEM_CONTEXT, (void*)pool);
+    pthread_mutex_unlock(&mCtxLock);
+    if (ret) {
+        ALOGE("ERROR: faild to set frame pool(err=%d)", ret);
+        release_vpu_memory_pool_allocator(pool);
+        return VPU_ERR_UNKNOW;
+    }
+
+    // frames still held by the caller keep the old pool alive
+    pthread_mutex_lock(&mPoolLock);
+    mRetiredPools[slot] = mFramePool;
+    mFramePool = pool;
+    pthread_mutex_unlock(&mPoolLock);
+
+    pthread_mutex_lock(&mStatsLock);
+    mInfoStats.poolResizes++;
+    pthread_mutex_unlock(&mStatsLock);
+
+    ALOGD("frame pool resize %d -> %d bytes", mFramePoolSize, size);
+    mFramePoolSize = size;
+
+    return VPU_OK;
+}
+
+void RKHWDecApi::releaseRetiredPools()
+{
+    pthread_mutex_lock(&mPoolLock);
+    for (int32_t i = 0; i < DEC_RETIRED_POOL_MAX; i++) {
+        vpu_display_mem_pool *pool = mRetiredPools[i];
+
+        if (pool != NULL && pool->get_unused_num(pool) == mFramePoolNum) {
+            for (int32_t j = 0; j < mPoolBufferNum; j++) {
+                if (mPoolBuffers[j].pool == pool)
+                    memset(&mPoolBuffers[j], 0, sizeof(PoolBuffer));
+            }
+            release_vpu_memory_pool_allocator(pool);
+            mRetiredPools[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&mPoolLock);
+}
+
+/*
+ * the frames come out of the pool set to the decoder at the time, record
+ * it for the buffer, so that the frame goes back there after a resize.
+ */
+void RKHWDecApi::trackPoolBuffer(VPU_FRAME *vframe)
+{
+    PoolBuffer *empty = NULL;
+    int32_t i;
+
+    pthread_mutex_lock(&mPoolLock);
+    for (i = 0; i < mPoolBufferNum; i++) {
+        if (mPoolBuffers[i].addr == vframe->vpumem.vir_addr)
+            break;
+        if (empty == NULL && mPoolBuffers[i].addr == NULL)
+            empty = &mPoolBuffers[i];
+    }
+
+    if (i < mPoolBufferNum) {
+        mPoolBuffers[i].pool = mFramePool;
+    } else if (empty != NULL) {
+        empty->addr = vframe->vpumem.vir_addr;
+        empty->pool = mFramePool;
+    } else {
+        ALOGW("pool buffer %p not tracked", vframe->vpumem.vir_addr);
+    }
+    pthread_mutex_unlock(&mPoolLock);
+}
+
+/* called with mPoolLock */
+vpu_display_mem_pool *RKHWDecApi::framePoolOf(VPU_FRAME *vframe)
+{
+    for (int32_t i = 0; i < mPoolBufferNum; i++) {
+        if (mPoolBuffers[i].addr == vframe->vpumem.vir_addr)
+            return mPoolBuffers[i].pool;
+    }
+
+    return mFramePool;
+}
+
 void RKHWDecApi::deinitOutFrame(VPU_FRAME *vframe)
 {
     if (vframe->vpumem.phy_addr > 0) {
-        VPUMemLink(&vframe->vpumem);
-        VPUFreeLinear(&vframe->vpumem);
+        if (mFramePoolNum > 0) {
+            // back to its own pool, nothing freed
+            pthread_mutex_lock(&mPoolLock);
+            vpu_display_mem_pool *pool = framePoolOf(vframe);
+            pool->put_used(pool, &vframe->vpumem);
+            pthread_mutex_unlock(&mPoolLock);
+        } else {
+            VPUMemLink(&vframe->vpumem);
+            VPUFreeLinear(&vframe->vpumem);
+        }
+    }
+}
+
+void RKHWDecApi::refOutFrame(VPU_FRAME *vframe)
+{
+    if (vframe->vpumem.phy_addr > 0) {
+        if (mFramePoolNum > 0) {
+            pthread_mutex_lock(&mPoolLock);
+            vpu_display_mem_pool *pool = framePoolOf(vframe);
+            pool->inc_used(pool, &vframe->vpumem);
+            pthread_mutex_unlock(&mPoolLock);
+        } else {
+            VPUMemLinear_t dup;
+            VPUMemLink(&vframe->vpumem);
+            VPUMemDuplicate(&dup, &vframe->vpumem);
+        }
+    }
+}
+
+void RKHWDecApi::getFramePoolInfo(FramePoolInfo *info)
+{
+    pthread_mutex_lock(&mPoolLock);
+    info->num = mFramePoolNum;
+    info->size = mFramePoolSize;
+    info->unused = (mFramePool != NULL) ? mFramePool->get_unused_num(mFramePool) : 0;
+    pthread_mutex_unlock(&mPoolLock);
+}
+
+VPU_RET RKHWDecApi::startThreads(int32_t inDepth, int32_t outDepth)
+{
+    if (!mInitOK) {
+        ALOGW("W - prepare RKHWDecApi first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (mThreaded)
+        return VPU_OK;
+
+    if (!mInRing.init(inDepth) || !mOutRing.init(outDepth)) {
+        ALOGE("failed to init rings, depth %d/%d", inDepth, outDepth);
+        mInRing.deinit();
+        mOutRing.deinit();
+        return VPU_ERR_INIT;
+    }
+
+    pthread_mutex_lock(&mStatsLock);
+    memset(&mThreadStats, 0, sizeof(mThreadStats));
+    pthread_mutex_unlock(&mStatsLock);
+    mThreadQuit = false;
+
+    if (pthread_create(&mFeedThread, NULL, feedThread, this)) {
+        ALOGE("failed to create feed thread");
+        mInRing.deinit();
+        mOutRing.deinit();
+        return VPU_ERR_FATAL_THREAD;
+    }
+    if (pthread_create(&mDrainThread, NULL, drainThread, this)) {
+        ALOGE("failed to create drain thread");
+        mThreadQuit = true;
+        mFeedWaiter.signal();
+        pthread_join(mFeedThread, NULL);
+        mInRing.deinit();
+        mOutRing.deinit();
+        return VPU_ERR_FATAL_THREAD;
+    }
+
+    mThreaded = true;
+
+    ALOGD("threaded mode start, ring depth in %d out %d",
+          mInRing.capacity(), mOutRing.capacity());
+
+    return VPU_OK;
+}
+
+void RKHWDecApi::stopThreads()
+{
+    if (!mThreaded)
+        return;
+
+    mThreadQuit = true;
+    mFeedWaiter.signal();
+    mDrainWaiter.signal();
+    pthread_join(mFeedThread, NULL);
+    pthread_join(mDrainThread, NULL);
+
+    // frames not popped go back to the decoder
+    FrameSlot *frame;
+    while ((frame = mOutRing.readSlot()) != NULL) {
+        if (frame->ret == VPU_OK)
+            deinitOutFrame(&frame->frame);
+        mOutRing.pop();
+    }
+
+    for (uint32_t i = 0; i < mInRing.capacity(); i++) {
+        free(mInRing.slotAt(i)->data);
+    }
+
+    mInRing.deinit();
+    mOutRing.deinit();
+    mThreaded = false;
+}
+
+VPU_RET RKHWDecApi::pushPacket(char *data, int32_t size, int64_t pts,
+                               int32_t flag, int32_t timeoutMs)
+{
+    PacketSlot *pkt;
+
+    if (!mThreaded) {
+        ALOGW("W - startThreads first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    pkt = mInRing.writeSlot();
+    if (pkt == NULL) {
+        pthread_mutex_lock(&mStatsLock);
+        mThreadStats.pushStalls++;
+        pthread_mutex_unlock(&mStatsLock);
+
+        mPushWaiter.begin(timeoutMs);
+        while ((pkt = mInRing.writeSlot()) == NULL) {
+            if (!mPushWaiter.wait())
+                return VPU_EAGAIN;
+        }
+        mPushWaiter.done();
+    }
+
+    if (pkt->data == NULL || pkt->capacity < size) {
+        char *buf = (char *)realloc(pkt->data, size > 0 ? size : 1);
+        if (buf == NULL) {
+            ALOGE("failed to malloc packet, size %d", size);
+            return VPU_ERR_UNKNOW;
+        }
+        pkt->data = buf;
+        pkt->capacity = size > 0 ? size : 1;
+    }
+
+    if (size > 0)
+        memcpy(pkt->data, data, size);
+    pkt->size = size;
+    pkt->pts = pts;
+    pkt->flag = flag;
+
+    mInRing.push();
+    mFeedWaiter.signal();
+
+    return VPU_OK;
+}
+
+VPU_RET RKHWDecApi::popFrame(VPU_FRAME *vframe, int32_t timeoutMs)
+{
+    FrameSlot *frame;
+    VPU_RET ret;
+
+    if (!mThreaded) {
+        ALOGW("W - startThreads first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    frame = mOutRing.readSlot();
+    if (frame == NULL) {
+        mPopWaiter.begin(timeoutMs);
+        while ((frame = mOutRing.readSlot()) == NULL) {
+            if (!mPopWaiter.wait()) {
+                pthread_mutex_lock(&mStatsLock);
+                mThreadStats.popStalls++;
+                pthread_mutex_unlock(&mStatsLock);
+                return VPU_EAGAIN;
+            }
+        }
+        mPopWaiter.done();
+    }
+
+    ret = frame->ret;
+    if (ret == VPU_EOS_STREAM_REACHED) {
+        // keep the eos slot, the later calls get eos too
+        return ret;
+    }
+
+    *vframe = frame->frame;
+    mOutRing.pop();
+    mDrainWaiter.signal();
+
+    return ret;
+}
+
+VPU_RET RKHWDecApi::popFrame(DecodedFrame *frame, int32_t timeoutMs)
+{
+    VPU_FRAME vframe;
+    VPU_RET ret;
+
+    ret = popFrame(&vframe, timeoutMs);
+    if (ret != VPU_OK)
+        return ret;
+
+    return attachFrame(frame, &vframe);
+}
+
+void RKHWDecApi::getThreadStats(ThreadStats *stats)
+{
+    pthread_mutex_lock(&mStatsLock);
+    *stats = mThreadStats;
+    pthread_mutex_unlock(&mStatsLock);
+    stats->inDepth = mInRing.size();
+    stats->inCapacity = mInRing.capacity();
+    stats->outDepth = mOutRing.size();
+    stats->outCapacity = mOutRing.capacity();
+}
+
+void *RKHWDecApi::feedThread(void *arg)
+{
+    ((RKHWDecApi *)arg)->feedLoop();
+    return NULL;
+}
+
+void *RKHWDecApi::drainThread(void *arg)
+{
+    ((RKHWDecApi *)arg)->drainLoop();
+    return NULL;
+}
+
+void RKHWDecApi::feedLoop()
+{
+    while (!mThreadQuit) {
+        PacketSlot *pkt = NULL;
+        VPU_RET ret = VPU_EAGAIN;
+
+        /*
+         * wait for a packet from caller, or for room in the vpu input
+         * queue, the drain thread signals after each frame got.
+         */
+        mFeedWaiter.begin(THREAD_WAIT_MS);
+        while (!mThreadQuit) {
+            pkt = mInRing.readSlot();
+            if (pkt != NULL) {
+                ret = sendStream(pkt->data, pkt->size, pkt->pts, pkt->flag);
+                if (ret != VPU_EAGAIN)
+                    break;
+                pthread_mutex_lock(&mStatsLock);
+                mThreadStats.feedStalls++;
+                pthread_mutex_unlock(&mStatsLock);
+            }
+            if (!mFeedWaiter.wait())
+                break;
+        }
+
+        if (pkt == NULL || ret == VPU_EAGAIN)
+            continue;
+
+        mFeedWaiter.done();
+        if (ret != VPU_OK)
+            ALOGE("feeder dropped packet size %d(err=%d)", pkt->size, ret);
+
+        mInRing.pop();
+        mPushWaiter.signal();
+    }
+}
+
+void RKHWDecApi::drainLoop()
+{
+    while (!mThreadQuit) {
+        FrameSlot *frame = mOutRing.writeSlot();
+        VPU_RET ret;
+
+        if (frame == NULL) {
+            // caller is slow, hold the decoder until a frame popped
+            pthread_mutex_lock(&mStatsLock);
+            mThreadStats.drainStalls++;
+            pthread_mutex_unlock(&mStatsLock);
+
+            mDrainWaiter.begin(THREAD_WAIT_MS);
+            while (!mThreadQuit && (frame = mOutRing.writeSlot()) == NULL) {
+                if (!mDrainWaiter.wait())
+                    break;
+            }
+            if (frame == NULL)
+                continue;
+            mDrainWaiter.done();
+        }
+
+        ret = getOutFrame(&frame->frame, THREAD_WAIT_MS);
+        if (ret == VPU_EAGAIN)
+            continue;
+
+        frame->ret = ret;
+        mOutRing.push();
+        mPopWaiter.signal();
+        mFeedWaiter.signal();
+
+        if (ret == VPU_EOS_STREAM_REACHED) {
+            ALOGD("drain thread saw output eos");
+            break;
+        }
     }
 }
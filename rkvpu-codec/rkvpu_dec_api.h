@@ -21,22 +21,64 @@
 #ifndef __RKVPU_DEC_API_H__
 #define __RKVPU_DEC_API_H__
 
+#include <pthread.h>
+#include <atomic>
+
 #include "vpu_api.h"
+#include "rkvpu_ret.h"
+#include "rkvpu_waiter.h"
+#include "rkvpu_latency.h"
+#include "rkvpu_sps.h"
+#include "rkvpu_spsc_queue.h"
+
+/* frame pools replaced by info change and not released yet */
+#define DEC_RETIRED_POOL_MAX    4
+
+class RKHWDecApi;
+class RKStreamIndex;
+
+/*
+ * Handle of a decoded frame, owns one reference of the frame buffer.
+ *
+ * The handle is move-only, so a frame has a single owner unless share() is
+ * called explicitly. share() returns another handle of the same buffer
+ * without copying the pixels, the buffer goes back to the decoder when the
+ * last handle is released, from any thread. The RKHWDecApi the frame comes
+ * from must outlive all of its handles.
+ */
+class DecodedFrame
+{
+public:
+    DecodedFrame();
+    ~DecodedFrame();
+
+    DecodedFrame(DecodedFrame &&other);
+    DecodedFrame &operator=(DecodedFrame &&other);
+
+    /* another reference of the same frame, invalid handle if none */
+    DecodedFrame share() const;
+
+    /* drop this reference, the handle turns invalid */
+    void reset();
 
-#define OMX_BUFFERFLAG_EOS              0x00000001
-
-typedef enum VPU_RET {
-    VPU_OK                      = 0,
-    VPU_ERR_UNKNOW              = -1,
-    VPU_ERR_BASE                = -1000,
-    VPU_ERR_LIST_STREAM         = VPU_API_ERR_BASE - 1,
-    VPU_ERR_INIT                = VPU_API_ERR_BASE - 2,
-    VPU_ERR_VPU_CODEC_INIT      = VPU_API_ERR_BASE - 3,
-    VPU_ERR_STREAM              = VPU_API_ERR_BASE - 4,
-    VPU_ERR_FATAL_THREAD        = VPU_API_ERR_BASE - 5,
-    VPU_EAGAIN                  = VPU_API_ERR_BASE - 6,
-    VPU_EOS_STREAM_REACHED      = VPU_API_ERR_BASE - 11,
-} VPU_RET;
+    bool valid() const { return mRef != NULL; }
+    VPU_FRAME *get() const { return (mRef != NULL) ? &mRef->frame : NULL; }
+    int32_t refCount() const { return (mRef != NULL) ? mRef->refs.load() : 0; }
+
+private:
+    friend class RKHWDecApi;
+
+    typedef struct FrameRef {
+        VPU_FRAME frame;
+        std::atomic<int32_t> refs;
+        RKHWDecApi *owner;
+    } FrameRef;
+
+    DecodedFrame(const DecodedFrame &);
+    DecodedFrame &operator=(const DecodedFrame &);
+
+    FrameRef *mRef;
+};
 
 class RKHWDecApi
 {
@@ -44,29 +86,324 @@ public:
     RKHWDecApi();
     ~RKHWDecApi();
 
+    typedef struct DecCfgInfo {
+        int32_t width;
+        int32_t height;
+        OMX_RK_VIDEO_CODINGTYPE coding;
+        int32_t splitMode;    /* 1 - vpu split frames inside; 0 - one frame per sendStream */
+        int32_t framePoolNum; /* output frames pre-allocated, 0 - vpu internal allocator */
+        int32_t framePoolSize;/* bytes of each frame, 0 - max size of the resolution */
+        int32_t latencyMode;  /* 1 - frames out in decode order as soon as decoded,
+                                     split mode is closed, one frame per sendStream */
+    } DecCfgInfo_t;
+
+    typedef struct OutputFormat {
+        int32_t width;        /* display size */
+        int32_t height;
+        int32_t stride;       /* buffer size, 0 before the first frame */
+        int32_t vstride;
+        int32_t colorType;
+    } OutputFormat_t;
+
+    typedef struct InfoChangeStats {
+        int32_t inputChanges;   /* sps of a new size sent */
+        int32_t outputChanges;  /* VPU_FORMAT_CHANGED returned */
+        int32_t poolResizes;
+        int64_t lastSwitchUs;   /* new sps sent to VPU_FORMAT_CHANGED out */
+        int64_t maxSwitchUs;
+    } InfoChangeStats_t;
+
+    typedef enum DecodeMode {
+        DECODE_MODE_ALL = 0,
+        DECODE_MODE_KEY_ONLY,   /* idr / irap frames only */
+        DECODE_MODE_REF_ONLY,   /* non-reference frames dropped */
+    } DecodeMode_t;
+
+    typedef struct DecodeModeStats {
+        int64_t sentFrames;     /* packets with slices sent to vpu */
+        int64_t sentBytes;
+        int64_t droppedFrames;  /* filtered out before vpu */
+        int64_t droppedBytes;
+    } DecodeModeStats_t;
+
+    typedef enum ErrorPolicy {
+        ERROR_POLICY_PASS = 0,      /* frames with errors output as concealed */
+        ERROR_POLICY_DROP_TO_KEY,   /* drop from the broken frame to the next key */
+    } ErrorPolicy_t;
+
+    typedef struct ErrorStats {
+        int64_t errorFrames;    /* decoded with ErrorInfo set */
+        int64_t concealedFrames;/* with errors, output anyway */
+        int64_t droppedFrames;  /* not output, recovering */
+        int64_t droppedPackets; /* not sent, recovering */
+        int64_t recoveries;     /* output resumed at a key frame */
+    } ErrorStats_t;
+
+    typedef struct FramePoolInfo {
+        int32_t num;          /* 0 if no frame pool */
+        int32_t size;
+        int32_t unused;       /* frames free for the decoder to output into */
+    } FramePoolInfo_t;
+
+    VPU_RET prepare(DecCfgInfo *cfg);
+
+    /*
+     * split mode on, stream data can be sent in any size
+     */
     VPU_RET prepare(int32_t width, int32_t height, OMX_RK_VIDEO_CODINGTYPE coding);
 
     /*
      * send video stream packet to decoder only, async interface
+     * @pts: returned in ShowTime of the frame, <= 0 to use a synthetic one
+     * Note: data is handed to vpu directly without copy, keep it valid
+     *       and send the same data again on VPU_EAGAIN.
      */
     VPU_RET sendStream(char *data, int32_t size, int64_t pts, int32_t flag);
 
     /*
      * get video frame from decoder only, async interface
      * Note: @deinitOutFrame if we has done everything with VPU_FRAME
+     *       VPU_FORMAT_CHANGED is returned once without frame when the
+     *       picture size changes, the frames after it are in the new size.
      */
     VPU_RET getOutFrame(VPU_FRAME *vframe);
 
+    /*
+     * get video frame, wait until a frame is ready or timeout.
+     * @timeoutMs: 0 - no wait, < 0 - wait forever
+     * Note: VPU_EAGAIN is returned if timeout.
+     */
+    VPU_RET getOutFrame(VPU_FRAME *vframe, int32_t timeoutMs);
+
+    /*
+     * same as above, the frame is returned in a handle which releases the
+     * buffer by itself, no deinitOutFrame.
+     */
+    VPU_RET getOutFrame(DecodedFrame *frame, int32_t timeoutMs);
+
     /*
      * VPU_FRAME buffers used recycled inside decoder, so release
      * that buffer which has been display success.
      */
     void deinitOutFrame(VPU_FRAME *vframe);
 
+    /*
+     * hold one more reference of the frame buffer, every reference is
+     * released by its own deinitOutFrame.
+     */
+    void refOutFrame(VPU_FRAME *vframe);
+
+    /*
+     * occupancy of the frame pool set by DecCfgInfo.framePoolNum.
+     */
+    void getFramePoolInfo(FramePoolInfo *info);
+
+    /*
+     * wakeup statistics of the timeout getOutFrame.
+     */
+    void getWaitStats(RKPollWaiter::WaitStats *stats);
+
+    /*
+     * decode latency from sendStream to getOutFrame of each frame, matched
+     * by pts. Packets sent with pts 0 get a synthetic one.
+     */
+    void getLatencyStats(RKLatencyTracker::LatencyStats *stats);
+
+    /*
+     * resolution change in place, the context is kept. The sps sent is
+     * checked for a new size, and the info change of the decoder is acked
+     * with VPU_API_SET_INFO_CHANGE after the frame pool grows if needed.
+     */
+    void getOutputFormat(OutputFormat *fmt);
+    void getInfoChangeStats(InfoChangeStats *stats);
+
+    /*
+     * drop all packets and frames inside the decoder, the frames held by
+     * caller are still valid. Threads of the threaded mode are restarted.
+     */
+    VPU_RET flush();
+
+    /*
+     * random access with the key frame index of the stream, the index is
+     * kept by caller and must outlive the decoder.
+     */
+    void setStreamIndex(const RKStreamIndex *index);
+
+    /*
+     * flush and get ready to decode from the last key frame before @frame,
+     * @frame is the first frame output. The frames out before it in display
+     * order are decoded as references but dropped.
+     * @frame: in decode order, as numbered by the index
+     * @offset: the stream offset to send data from, see RKStreamPacker::seek
+     * Note: the target is matched by pts, send each packet with a pts of
+     *       its own or <= 0 for a synthetic one. The RASL frames after a
+     *       CRA key frame can't be decoded and are not sent.
+     */
+    VPU_RET seekTo(int32_t frame, int64_t *offset);
+
+    /*
+     * frames filtered by the nal header in sendStream, the ones dropped
+     * never reach the vpu and sendStream returns VPU_OK for them. Packets
+     * without slices, e.g. parameter sets, are always sent.
+     * @keyInterval: key only mode, a key frame with pts closer than this
+     *               to the last one sent is dropped too, 0 - no limit
+     * Note: one frame per sendStream, split mode off. After key only mode
+     *       frames are dropped until the next key frame.
+     */
+    void setDecodeMode(DecodeMode mode, int64_t keyInterval);
+    void getDecodeModeStats(DecodeModeStats *stats);
+
+    /*
+     * what to do with the frames decoded with errors. With
+     * ERROR_POLICY_DROP_TO_KEY the broken frame and the ones refer to it
+     * are not output, and the packets are not sent until the next key
+     * frame, the output goes on from that key frame.
+     */
+    void setErrorPolicy(ErrorPolicy policy);
+    void getErrorStats(ErrorStats *stats);
+
+    typedef struct ThreadStats {
+        int32_t inDepth;        /* packets pushed, not sent to vpu yet */
+        int32_t inCapacity;
+        int32_t outDepth;       /* frames decoded, not popped yet */
+        int32_t outCapacity;
+        int64_t pushStalls;     /* pushPacket waited for the input ring */
+        int64_t feedStalls;     /* vpu input full, feeder thread retried */
+        int64_t drainStalls;    /* output ring full, drain thread waited */
+        int64_t popStalls;      /* popFrame timeout on empty output ring */
+    } ThreadStats_t;
+
+    /*
+     * threaded mode, the decoder owns a feeder thread and a drain thread
+     * connected to the caller by lock-free rings, so feeding and draining
+     * the vpu never stall each other. Call it after prepare, then use
+     * pushPacket/popFrame instead of sendStream/getOutFrame.
+     */
+    VPU_RET startThreads(int32_t inDepth, int32_t outDepth);
+    void stopThreads();
+
+    /*
+     * queue a packet to the feeder thread, the data is copied.
+     * Note: VPU_EAGAIN is returned if the input ring is still full at timeout.
+     */
+    VPU_RET pushPacket(char *data, int32_t size, int64_t pts, int32_t flag,
+                       int32_t timeoutMs);
+
+    /*
+     * get a decoded frame from the drain thread.
+     * Note: @deinitOutFrame if we has done everything with VPU_FRAME
+     */
+    VPU_RET popFrame(VPU_FRAME *vframe, int32_t timeoutMs);
+    VPU_RET popFrame(DecodedFrame *frame, int32_t timeoutMs);
+
+    void getThreadStats(ThreadStats *stats);
+
 private:
+    typedef struct PacketSlot {
+        char *data;
+        int32_t size;
+        int32_t capacity;
+        int64_t pts;
+        int32_t flag;
+    } PacketSlot;
+
+    typedef struct FrameSlot {
+        VPU_FRAME frame;
+        VPU_RET ret;
+    } FrameSlot;
+
+    /* a frame pool buffer and the pool it belongs to */
+    typedef struct PoolBuffer {
+        RK_U32 *addr;
+        vpu_display_mem_pool *pool;
+    } PoolBuffer;
+
+    VPU_RET attachFrame(DecodedFrame *frame, VPU_FRAME *vframe);
+
+    void checkStreamInfo(const char *data, int32_t size);
+    VPU_RET changeOutFormat(VPU_FRAME *vframe);
+    VPU_RET handleInfoChange(VPU_FRAME *vframe);
+    VPU_RET resizeFramePool(int32_t size);
+    void releaseRetiredPools();
+    void trackPoolBuffer(VPU_FRAME *vframe);
+    vpu_display_mem_pool *framePoolOf(VPU_FRAME *vframe);
+    bool dropPacket(const char *data, int32_t size, int64_t pts, int32_t *type);
+    void commitPacket(int32_t type, int32_t size, int64_t pts, bool dropped);
+    bool seekSkip(int64_t pts);
+    bool dropErrorFrame(VPU_FRAME *vframe);
+
+    static void *feedThread(void *arg);
+    static void *drainThread(void *arg);
+    void feedLoop();
+    void drainLoop();
+
     VpuCodecContext *mVpuCtx;
     int32_t mInitOK;
     int32_t mFrameCount;
+    int32_t mColorType;     /* of the last output, the changes are logged */
+
+    vpu_display_mem_pool *mFramePool;
+    int32_t mFramePoolNum;
+    int32_t mFramePoolSize;
+    /* pools replaced on info change, released when all frames are back */
+    vpu_display_mem_pool *mRetiredPools[DEC_RETIRED_POOL_MAX];
+    /* owner of each buffer output, frames go back to their own pool */
+    PoolBuffer *mPoolBuffers;
+    int32_t mPoolBufferNum;
+    /* pools and buffers, frames are released from any thread */
+    pthread_mutex_t mPoolLock;
+
+    /* info change */
+    OMX_RK_VIDEO_CODINGTYPE mCoding;
+    int32_t mStreamWidth;   /* by the last sps sent */
+    int32_t mStreamHeight;
+    int64_t mSpsChangeUs;   /* new sps sent, 0 if the change is out */
+    OutputFormat mOutFormat;
+    VPU_FRAME mHeldFrame;   /* first frame after VPU_FORMAT_CHANGED */
+    bool mHasHeldFrame;
+    InfoChangeStats mInfoStats;
+
+    /* seek */
+    const RKStreamIndex *mStreamIndex;
+    bool mSeeking;          /* output dropped until the seek target is out */
+    int32_t mSeekFrames;    /* packets to send before the target, -1 if sent */
+    int64_t mSeekPts;       /* of the target packet, -1 if not sent yet */
+    int32_t mSeekLate;      /* frames out after the target is sent */
+    bool mSkipRasl;         /* drop RASL frames until the trailing ones */
+
+    /* decode mode */
+    int32_t mSplitMode;
+    DecodeMode mDecodeMode;
+    int64_t mKeyInterval;
+    int64_t mLastKeyPts;    /* of the last key frame sent, -1 if none */
+    bool mWaitKey;          /* references missing, drop until a key frame */
+    DecodeModeStats mModeStats;
+
+    /* error recovery */
+    ErrorPolicy mErrorPolicy;
+    bool mRecovering;       /* frames dropped until the key frame is out */
+    int64_t mRecoverKeyPts; /* of the key frame sent, -1 if not yet */
+    ErrorStats mErrorStats;
+
+    RKPollWaiter mWaiter;
+    RKLatencyTracker mLatency;
+    int64_t mRetryPts;      /* synthetic pts of the packet got VPU_EAGAIN */
+
+    /* threaded mode */
+    pthread_mutex_t mCtxLock;
+    bool mThreaded;
+    std::atomic<bool> mThreadQuit;
+    pthread_t mFeedThread;
+    pthread_t mDrainThread;
+    RKSpscQueue<PacketSlot> mInRing;
+    RKSpscQueue<FrameSlot> mOutRing;
+    RKPollWaiter mFeedWaiter;
+    RKPollWaiter mDrainWaiter;
+    RKPollWaiter mPushWaiter;
+    RKPollWaiter mPopWaiter;
+    ThreadStats mThreadStats;
+    /* all the stats, updated by the feed and drain threads too */
+    pthread_mutex_t mStatsLock;
 };
 
 #endif  // __RKVPU_DEC_API_H__
@@ -0,0 +1,738 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: native-codec: rkvpu_dec_farm sample code
+ * date  : 2021/03/22
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rkvpu_dec_farm"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <atomic>
+
+#include "rkvpu_dec_api.h"
+#include "rkvpu_stream_packer.h"
+
+#define MAX_FILE_LEN            128
+#define FARM_MAX_CHANNELS       64
+#define FARM_MAX_WORKERS        16
+#define FARM_IDLE_WAIT_MS       10
+
+typedef enum FarmSched {
+    FARM_SCHED_ROUND_ROBIN  = 0,
+    FARM_SCHED_DEADLINE     = 1,
+} FarmSched;
+
+/*
+ * One decoder session. A channel is serviced by one worker at a time, the
+ * worker feeds at most one packet and drains all ready frames, then gives
+ * the channel back to the scheduler.
+ */
+typedef struct FarmChannel_t {
+    int32_t id;
+    RKHWDecApi *decApi;
+    RKStreamPacker packer;
+    const char *fileInput;
+
+    char *pktBuf;
+    int32_t readsize;
+    int32_t loopsLeft;
+    bool reopen;
+    bool sawInputEOS;
+    bool signalledInputEOS;
+    bool lastPktQueued;
+    bool sawOutputEOS;
+
+    /* scheduler state, under FarmCtx lock */
+    bool busy;
+    int64_t dueUs;          /* due time of next packet, deadline order */
+    int32_t inFlight;       /* packets sent, frames not out yet */
+
+    /* statistics */
+    int64_t packets;
+    int64_t frames;
+    int64_t capStalls;
+    int64_t startUs;
+    int64_t endUs;
+    int64_t latencySumUs;
+    int64_t latencyMaxUs;
+} FarmChannel;
+
+typedef struct FarmCtx_t {
+    char fileInput[FARM_MAX_CHANNELS][MAX_FILE_LEN];
+    int32_t numFiles;
+    bool useMmap;
+    bool bench;
+
+    OMX_RK_VIDEO_CODINGTYPE videoCoding;
+    int32_t width;
+    int32_t height;
+
+    int32_t numChannels;
+    int32_t numWorkers;
+    int32_t loops;
+    int32_t fps;            /* paced input per channel, 0 - as fast as possible */
+    int32_t maxInFlight;    /* global cap of frames in flight, 0 - no cap */
+    int32_t reorderDepth;   /* frames a decoder holds before output */
+    FarmSched sched;
+
+    /* running farm */
+    FarmChannel *channels;
+    int32_t activeChannels;
+    pthread_mutex_t lock;
+    int32_t rrNext;
+    int32_t doneChannels;
+    bool failed;
+    std::atomic<int32_t> inFlight;
+} FarmCtx;
+
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Dumps usage on stderr.
+ */
+static void testUsage()
+{
+    fprintf(stderr,
+        "\nUsage: rkvpu_dec_farm [options] \n"
+        "Rockchip VpuApiLegacy multi-channel decoder demo.\n"
+        "  - rkvpu_dec_farm --i cam0.h264 --i cam1.h264 --n 16 --w 1920 --h 1080\n"
+        "  - rkvpu_dec_farm --i input.h264 --n 64 --w 1920 --h 1080 --b\n"
+        "\n"
+        "Options:\n"
+        "--u\n"
+        "    Show this message.\n"
+        "--i\n"
+        "    input file, repeat for more files, channels use them in turn\n"
+        "--w\n"
+        "    the width of input picture\n"
+        "--h\n"
+        "    the height of input picture\n"
+        "--t\n"
+        "    input pictrue type(h264 default):\n"
+        "        1: h264\n"
+        "        2: h265\n"
+        "--n\n"
+        "    number of channels, default the number of input files\n"
+        "--j\n"
+        "    number of worker threads, default 4\n"
+        "--s\n"
+        "    scheduler:\n"
+        "        0: round-robin(default)\n"
+        "        1: earliest deadline first\n"
+        "--f\n"
+        "    input fps of each channel, 0 feeds as fast as possible(default)\n"
+        "--c\n"
+        "    max frames in flight of all channels, 0 no limit(default)\n"
+        "--r\n"
+        "    frames held by a decoder for reordering, default 2, the cap is\n"
+        "    raised to channels x (reorder + 1) at least\n"
+        "--l\n"
+        "    loop the input file more times\n"
+        "--m\n"
+        "    mmap the input file\n"
+        "--b\n"
+        "    benchmark, run 1, 2, 4 ... up to --n channels\n"
+        "\n");
+}
+
+static VPU_RET testParseArgs(FarmCtx *ctx, int argc, char **argv)
+{
+    static const struct option longOptions[] = {
+        { "usage",              no_argument,        NULL, 'u' },
+        { "input",              required_argument,  NULL, 'i' },
+        { "width",              required_argument,  NULL, 'w' },
+        { "height",             required_argument,  NULL, 'h' },
+        { "type",               required_argument,  NULL, 't' },
+        { "num",                required_argument,  NULL, 'n' },
+        { "jobs",               required_argument,  NULL, 'j' },
+        { "sched",              required_argument,  NULL, 's' },
+        { "fps",                required_argument,  NULL, 'f' },
+        { "cap",                required_argument,  NULL, 'c' },
+        { "reorder",            required_argument,  NULL, 'r' },
+        { "loop",               required_argument,  NULL, 'l' },
+        { "mmap",               no_argument,        NULL, 'm' },
+        { "bench",              no_argument,        NULL, 'b' },
+        { NULL,                 0,                  NULL, 0 }
+    };
+
+    ctx->numFiles = 0;
+    ctx->useMmap = false;
+    ctx->bench = false;
+    ctx->videoCoding = OMX_RK_VIDEO_CodingAVC;
+    ctx->width = 0;
+    ctx->height = 0;
+    ctx->numChannels = 0;
+    ctx->numWorkers = 4;
+    ctx->loops = 0;
+    ctx->fps = 0;
+    ctx->maxInFlight = 0;
+    ctx->reorderDepth = 2;
+    ctx->sched = FARM_SCHED_ROUND_ROBIN;
+
+    while (true) {
+        int optionIndex = 0;
+        int ic = getopt_long(argc, argv, "", longOptions, &optionIndex);
+        if (ic == -1) {
+            break;
+        }
+
+        switch (ic) {
+        case 'u':
+            return VPU_ERR_UNKNOW;
+        case 'i':
+            if (ctx->numFiles >= FARM_MAX_CHANNELS) {
+                fprintf(stderr, "ERROR: too many input files\n");
+                return VPU_ERR_UNKNOW;
+            }
+            strncpy(ctx->fileInput[ctx->numFiles], optarg, MAX_FILE_LEN - 1);
+            ctx->fileInput[ctx->numFiles][MAX_FILE_LEN - 1] = '\0';
+            ctx->numFiles++;
+            break;
+        case 'w':
+            ctx->width = atoi(optarg);
+            break;
+        case 'h':
+            ctx->height = atoi(optarg);
+            break;
+        case 't':
+            if (atoi(optarg) == 2) {
+                ctx->videoCoding = OMX_RK_VIDEO_CodingHEVC;
+            } else {
+                ctx->videoCoding = OMX_RK_VIDEO_CodingAVC;
+            }
+            break;
+        case 'n':
+            ctx->numChannels = atoi(optarg);
+            break;
+        case 'j':
+            ctx->numWorkers = atoi(optarg);
+            break;
+        case 's':
+            ctx->sched = (atoi(optarg) == 1) ? FARM_SCHED_DEADLINE
+                                             : FARM_SCHED_ROUND_ROBIN;
+            break;
+        case 'f':
+            ctx->fps = atoi(optarg);
+            break;
+        case 'c':
+            ctx->maxInFlight = atoi(optarg);
+            break;
+        case 'r':
+            ctx->reorderDepth = atoi(optarg);
+            break;
+        case 'l':
+            ctx->loops = atoi(optarg);
+            break;
+        case 'm':
+            ctx->useMmap = true;
+            break;
+        case 'b':
+            ctx->bench = true;
+            break;
+        default:
+            fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
+            return VPU_ERR_UNKNOW;
+        }
+    }
+
+    if (ctx->numFiles == 0) {
+        fprintf(stderr, "ERROR: must specify input file\n");
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (ctx->numChannels <= 0)
+        ctx->numChannels = ctx->numFiles;
+
+    if (ctx->numChannels > FARM_MAX_CHANNELS || ctx->numWorkers <= 0 ||
+        ctx->numWorkers > FARM_MAX_WORKERS || ctx->fps < 0 ||
+        ctx->maxInFlight < 0 || ctx->reorderDepth < 0 || ctx->loops < 0) {
+        fprintf(stderr, "ERROR: invalid farm settings\n");
+        return VPU_ERR_UNKNOW;
+    }
+
+    /*
+     * a decoder outputs nothing until it holds reorder + 1 frames, with a
+     * lower cap all channels could stall short of that.
+     */
+    if (ctx->maxInFlight > 0 &&
+        ctx->maxInFlight < ctx->numChannels * (ctx->reorderDepth + 1)) {
+        fprintf(stderr, "max in flight %d below %d channels x %d frames, raised\n",
+                ctx->maxInFlight, ctx->numChannels, ctx->reorderDepth + 1);
+        ctx->maxInFlight = ctx->numChannels * (ctx->reorderDepth + 1);
+    }
+
+    // dump cmd options
+    fprintf(stderr, "\ncmd parse result:\n"
+        "   input files          : %d\n"
+        "   input_resolution     : %dx%d\n"
+        "   input video coding   : %d\n"
+        "   channels             : %d\n"
+        "   workers              : %d\n"
+        "   scheduler            : %s\n"
+        "   input fps            : %d\n"
+        "   max in flight        : %d\n"
+        "   reorder depth        : %d\n",
+        ctx->numFiles, ctx->width, ctx->height, ctx->videoCoding,
+        ctx->numChannels, ctx->numWorkers,
+        (ctx->sched == FARM_SCHED_DEADLINE) ? "deadline" : "round-robin",
+        ctx->fps, ctx->maxInFlight, ctx->reorderDepth);
+
+    return VPU_OK;
+}
+
+static VPU_RET farmOpenChannel(FarmCtx *farm, FarmChannel *ch, int32_t id)
+{
+    RKHWDecApi::DecCfgInfo cfg;
+    VPU_RET ret;
+
+    ch->id = id;
+    ch->fileInput = farm->fileInput[id % farm->numFiles];
+    ch->pktBuf = NULL;
+    ch->readsize = 0;
+    ch->loopsLeft = farm->loops;
+    ch->reopen = false;
+    ch->sawInputEOS = false;
+    ch->signalledInputEOS = false;
+    ch->lastPktQueued = true;
+    ch->sawOutputEOS = false;
+    ch->busy = false;
+    ch->dueUs = 0;
+    ch->inFlight = 0;
+    ch->packets = 0;
+    ch->frames = 0;
+    ch->capStalls = 0;
+    ch->startUs = 0;
+    ch->endUs = 0;
+    ch->latencySumUs = 0;
+    ch->latencyMaxUs = 0;
+
+    ret = ch->packer.open(ch->fileInput, farm->videoCoding, farm->useMmap);
+    if (ret != VPU_OK) {
+        fprintf(stderr, "failed to open input file %s\n", ch->fileInput);
+        return ret;
+    }
+
+    ch->decApi = new RKHWDecApi();
+
+    cfg.width = farm->width;
+    cfg.height = farm->height;
+    cfg.coding = farm->videoCoding;
+    cfg.splitMode = 0;  // RKStreamPacker sends one frame each time
+    cfg.framePoolNum = 0;
+    cfg.framePoolSize = 0;
+    cfg.latencyMode = 0;
+
+    ret = ch->decApi->prepare(&cfg);
+    if (ret != VPU_OK) {
+        fprintf(stderr, "channel %d: decApi prepare failed(err=%d)\n", id, ret);
+        return ret;
+    }
+
+    return VPU_OK;
+}
+
+static void farmCloseChannel(FarmChannel *ch)
+{
+    ch->packer.close();
+
+    if (ch->decApi != NULL) {
+        delete ch->decApi;
+        ch->decApi = NULL;
+    }
+}
+
+/*
+ * Pick the next channel to service, NULL if every channel is done or
+ * serviced by other workers.
+ */
+static FarmChannel *farmPickChannel(FarmCtx *farm, bool *allDone)
+{
+    FarmChannel *pick = NULL;
+    int32_t num = farm->activeChannels;
+
+    pthread_mutex_lock(&farm->lock);
+
+    *allDone = (farm->doneChannels >= num) || farm->failed;
+    if (*allDone) {
+        pthread_mutex_unlock(&farm->lock);
+        return NULL;
+    }
+
+    if (farm->sched == FARM_SCHED_DEADLINE) {
+        for (int32_t i = 0; i < num; i++) {
+            FarmChannel *ch = &farm->channels[i];
+            if (ch->busy || ch->sawOutputEOS)
+                continue;
+            if (pick == NULL || ch->dueUs < pick->dueUs)
+                pick = ch;
+        }
+    } else {
+        for (int32_t i = 0; i < num; i++) {
+            FarmChannel *ch = &farm->channels[(farm->rrNext + i) % num];
+            if (ch->busy || ch->sawOutputEOS)
+                continue;
+            pick = ch;
+            farm->rrNext = (ch->id + 1) % num;
+            break;
+        }
+    }
+
+    if (pick != NULL)
+        pick->busy = true;
+
+    pthread_mutex_unlock(&farm->lock);
+
+    return pick;
+}
+
+static void farmReleaseChannel(FarmCtx *farm, FarmChannel *ch, VPU_RET ret)
+{
+    pthread_mutex_lock(&farm->lock);
+    ch->busy = false;
+    if (ch->sawOutputEOS)
+        farm->doneChannels++;
+    if (ret != VPU_OK)
+        farm->failed = true;
+    pthread_mutex_unlock(&farm->lock);
+}
+
+static VPU_RET farmReadPacket(FarmCtx *farm, FarmChannel *ch)
+{
+    static char eosBuf[1] = { 0 };
+    VPU_RET ret;
+
+    if (ch->reopen) {
+        ch->packer.close();
+        if (ch->packer.open(ch->fileInput, farm->videoCoding,
+                            farm->useMmap) != VPU_OK) {
+            fprintf(stderr, "failed to reopen input file %s\n", ch->fileInput);
+            return VPU_ERR_INIT;
+        }
+        ch->reopen = false;
+    }
+
+    ret = ch->packer.readFrame(&ch->pktBuf, &ch->readsize);
+    if (ret == VPU_ERR_UNKNOW) {
+        fprintf(stderr, "channel %d: failed to read input file %s\n",
+                ch->id, ch->fileInput);
+        return ret;
+    } else if (ret != VPU_OK) {
+        ch->pktBuf = eosBuf;
+        ch->readsize = 0;
+    }
+
+    if (ch->packer.isEos()) {
+        if (ch->loopsLeft > 0) {
+            ch->loopsLeft--;
+            ch->reopen = true;
+        } else {
+            ch->sawInputEOS = true;
+        }
+    }
+    ch->lastPktQueued = false;
+
+    return VPU_OK;
+}
+
+/*
+ * Feed one packet and drain the ready frames of a channel, never blocks.
+ * @progress is set if any packet or frame went through.
+ */
+static VPU_RET farmServiceChannel(FarmCtx *farm, FarmChannel *ch, bool *progress)
+{
+    RKHWDecApi *decApi = ch->decApi;
+    int64_t now = time_now_us();
+    VPU_RET ret;
+
+    *progress = false;
+
+    if (ch->startUs == 0) {
+        ch->startUs = now;
+        ch->dueUs = now;
+    }
+
+    if (!ch->signalledInputEOS) {
+        if (ch->lastPktQueued) {
+            ret = farmReadPacket(farm, ch);
+            if (ret != VPU_OK)
+                return ret;
+        }
+
+        /*
+         * the cap holds the packets of frames not out yet, a channel with
+         * nothing in flight can always go, so no channel starves.
+         */
+        bool hasFrame = ch->readsize > 0;
+        bool capped = hasFrame && farm->maxInFlight > 0 && ch->inFlight > 0 &&
+                      farm->inFlight.load() >= farm->maxInFlight;
+
+        if (capped) {
+            ch->capStalls++;
+        } else if (farm->fps == 0 || now >= ch->dueUs) {
+            int32_t flag = ch->sawInputEOS ? OMX_BUFFERFLAG_EOS : 0;
+            // pts carries the due time back in VPU_FRAME for the latency
+            int64_t pts = (farm->fps > 0) ? ch->dueUs : now;
+
+            ret = decApi->sendStream(ch->pktBuf, ch->readsize, pts, flag);
+            if (ret == VPU_OK) {
+                ch->lastPktQueued = true;
+                if (ch->sawInputEOS)
+                    ch->signalledInputEOS = true;
+                if (hasFrame) {
+                    ch->packets++;
+                    ch->inFlight++;
+                    farm->inFlight++;
+                }
+                ch->dueUs = (farm->fps > 0) ? ch->dueUs + 1000000 / farm->fps : now;
+                *progress = true;
+            } else if (ret != VPU_EAGAIN) {
+                fprintf(stderr, "channel %d: send stream failed(err=%d)\n",
+                        ch->id, ret);
+                return ret;
+            }
+        }
+    }
+
+    while (true) {
+        VPU_FRAME vframe;
+
+        ret = decApi->getOutFrame(&vframe);
+        if (ret == VPU_OK) {
+            int64_t pts = ((int64_t)vframe.ShowTime.TimeHigh << 32) |
+                          vframe.ShowTime.TimeLow;
+            int64_t outUs = time_now_us();
+
+            if (pts > 0 && pts <= outUs) {
+                ch->latencySumUs += outUs - pts;
+                if (outUs - pts > ch->latencyMaxUs)
+                    ch->latencyMaxUs = outUs - pts;
+            }
+            ch->frames++;
+            if (ch->inFlight > 0) {
+                ch->inFlight--;
+                farm->inFlight--;
+            }
+            decApi->deinitOutFrame(&vframe);
+            *progress = true;
+        } else if (ret == VPU_EOS_STREAM_REACHED) {
+            ALOGD("channel %d saw output eos", ch->id);
+            // frames dropped by decoder never come out, release them
+            farm->inFlight -= ch->inFlight;
+            ch->inFlight = 0;
+            ch->endUs = time_now_us();
+            ch->sawOutputEOS = true;
+            *progress = true;
+            break;
+        } else if (ret == VPU_FORMAT_CHANGED) {
+            ALOGD("channel %d output format changed", ch->id);
+            *progress = true;
+        } else if (ret == VPU_EAGAIN) {
+            break;
+        } else {
+            fprintf(stderr, "channel %d: get frame failed(err=%d)\n", ch->id, ret);
+            return ret;
+        }
+    }
+
+    return VPU_OK;
+}
+
+static void *farmWorker(void *arg)
+{
+    FarmCtx *farm = (FarmCtx *)arg;
+    RKPollWaiter waiter;
+    int32_t idle = 0;
+
+    while (true) {
+        bool allDone = false, progress = false;
+        FarmChannel *ch = farmPickChannel(farm, &allDone);
+
+        if (allDone)
+            break;
+
+        if (ch != NULL) {
+            VPU_RET ret = farmServiceChannel(farm, ch, &progress);
+            farmReleaseChannel(farm, ch, ret);
+        }
+
+        if (progress) {
+            if (idle >= farm->activeChannels)
+                waiter.done();
+            idle = 0;
+            continue;
+        }
+
+        // nothing to do on a whole round, spin then sleep
+        if (++idle == farm->activeChannels)
+            waiter.begin(FARM_IDLE_WAIT_MS);
+        if (idle >= farm->activeChannels && !waiter.wait())
+            waiter.begin(FARM_IDLE_WAIT_MS);
+    }
+
+    return NULL;
+}
+
+/*
+ * run @numChannels channels until all of them reach output eos, the
+ * aggregate fps is returned in @fps.
+ */
+static VPU_RET farmRun(FarmCtx *farm, int32_t numChannels, bool verbose,
+                       double *fps)
+{
+    pthread_t workers[FARM_MAX_WORKERS];
+    int32_t numWorkers = 0;
+    int64_t startUs, elapsedUs, frames = 0, latencySumUs = 0, latencyMaxUs = 0;
+    VPU_RET ret = VPU_OK;
+
+    farm->channels = new FarmChannel[numChannels];
+    farm->activeChannels = 0;
+    farm->rrNext = 0;
+    farm->doneChannels = 0;
+    farm->failed = false;
+    farm->inFlight = 0;
+    pthread_mutex_init(&farm->lock, NULL);
+
+    for (int32_t i = 0; i < numChannels; i++) {
+        farm->channels[i].decApi = NULL;
+        farm->activeChannels++;
+        ret = farmOpenChannel(farm, &farm->channels[i], i);
+        if (ret != VPU_OK)
+            goto FARM_OUT;
+    }
+
+    startUs = time_now_us();
+
+    for (int32_t i = 0; i < farm->numWorkers; i++) {
+        if (pthread_create(&workers[i], NULL, farmWorker, farm)) {
+            fprintf(stderr, "failed to create worker %d\n", i);
+            farm->failed = true;
+            break;
+        }
+        numWorkers++;
+    }
+
+    for (int32_t i = 0; i < numWorkers; i++)
+        pthread_join(workers[i], NULL);
+
+    elapsedUs = time_now_us() - startUs;
+
+    if (farm->failed) {
+        ret = VPU_ERR_UNKNOW;
+        goto FARM_OUT;
+    }
+
+    for (int32_t i = 0; i < numChannels; i++) {
+        FarmChannel *ch = &farm->channels[i];
+        int64_t chUs = ch->endUs - ch->startUs;
+
+        frames += ch->frames;
+        latencySumUs += ch->latencySumUs;
+        if (ch->latencyMaxUs > latencyMaxUs)
+            latencyMaxUs = ch->latencyMaxUs;
+
+        if (verbose) {
+            printf("  channel %2d: %6lld frames, %8.2f fps, latency avg %6.2f ms "
+                   "max %6.2f ms, cap stalls %lld\n",
+                   ch->id, (long long)ch->frames,
+                   (chUs > 0) ? ch->frames * 1E6 / chUs : 0.0,
+                   ch->frames ? ch->latencySumUs / 1E3 / ch->frames : 0.0,
+                   ch->latencyMaxUs / 1E3, (long long)ch->capStalls);
+        }
+    }
+
+    *fps = (elapsedUs > 0) ? frames * 1E6 / elapsedUs : 0.0;
+
+    printf("%3d channels: %8lld frames in %6lld ms, %9.2f fps total, "
+           "%8.2f fps/channel, latency avg %6.2f ms max %6.2f ms\n",
+           numChannels, (long long)frames, (long long)elapsedUs / 1000, *fps,
+           *fps / numChannels, frames ? latencySumUs / 1E3 / frames : 0.0,
+           latencyMaxUs / 1E3);
+
+FARM_OUT:
+    for (int32_t i = 0; i < farm->activeChannels; i++)
+        farmCloseChannel(&farm->channels[i]);
+
+    delete[] farm->channels;
+    farm->channels = NULL;
+    pthread_mutex_destroy(&farm->lock);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    VPU_RET ret = VPU_OK;
+    FarmCtx *farm = new FarmCtx;
+    double fps = 0;
+
+    // parse the cmd option
+    if (argc > 0)
+        ret = testParseArgs(farm, argc, argv);
+
+    if (ret != VPU_OK) {
+        testUsage();
+        delete farm;
+        return 1;
+    }
+
+    if (farm->bench) {
+        double baseFps = 0;
+
+        printf("\nscaling from 1 to %d channels, %d workers\n",
+               farm->numChannels, farm->numWorkers);
+        for (int32_t n = 1; ; n *= 2) {
+            if (n > farm->numChannels)
+                n = farm->numChannels;
+
+            ret = farmRun(farm, n, false, &fps);
+            if (ret != VPU_OK)
+                break;
+            if (n == 1)
+                baseFps = fps;
+            else if (baseFps > 0)
+                printf("              scaling %.2fx of 1 channel\n", fps / baseFps);
+
+            if (n == farm->numChannels)
+                break;
+        }
+    } else {
+        printf("\n");
+        ret = farmRun(farm, farm->numChannels, true, &fps);
+    }
+
+    delete farm;
+
+    if (ret != VPU_OK) {
+        fprintf(stderr, "ERROR: dec_farm failed(err=%d)\n", ret);
+        return 1;
+    }
+
+    return 0;
+}
@@ -26,30 +26,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
 #include <getopt.h>
 
 #include "rkvpu_dec_api.h"
+#include "rkvpu_stream_packer.h"
+#include "rkvpu_stream_index.h"
+#include "rkvpu_stream_probe.h"
+#include "rkvpu_yuv_writer.h"
 
 #define MAX_FILE_LEN  128
+#define OUTPUT_WAIT_MS  20
+
+/* ring depth of the threaded mode */
+#define THREAD_IN_DEPTH   8
+#define THREAD_OUT_DEPTH  4
+
+/* frames held by the output writer at most */
+#define OUTPUT_WRITE_DEPTH  4
 
 typedef struct {
-    struct timeval start;
-    struct timeval end;
+    int64_t startUs;
+    int64_t endUs;
 } DebugTimeInfo;
 
 static DebugTimeInfo time_info;
 
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static void time_start_record()
 {
-    gettimeofday(&time_info.start, NULL);
+    time_info.startUs = time_now_us();
 }
 
+/* elapsed us since time_start_record */
 static int64_t time_end_record()
 {
-    gettimeofday(&time_info.end, NULL);
-    return ((time_info.end.tv_sec  - time_info.start.tv_sec)  * 1000) +
-           ((time_info.end.tv_usec - time_info.start.tv_usec) / 1000);
+    time_info.endUs = time_now_us();
+    return time_info.endUs - time_info.startUs;
 }
 
 typedef struct DecTestCtx_t {
@@ -57,8 +77,21 @@ typedef struct DecTestCtx_t {
     char fileInput[MAX_FILE_LEN];
     char fileOutput[MAX_FILE_LEN];
     bool hasOutput;
+    RKYuvWriter::YuvFormat outFormat;
+    bool useMmap;
+    bool threaded;
+    int32_t framePoolNum;
+    bool directIo;
+    int32_t convertThreads;
+    bool dither;
+    bool latencyMode;
+    int32_t seekFrame;      /* -1 - decode from the beginning */
+    RKHWDecApi::DecodeMode decodeMode;
+    int32_t keyGap;         /* in frames, key only mode */
+    bool dropErrors;
 
     /* vpu configuration settings */
+    bool hasType;           /* probed from the stream if not set */
     OMX_RK_VIDEO_CODINGTYPE videoCoding;
     int32_t width;
     int32_t height;
@@ -84,13 +117,48 @@ static void testUsage()
         "--o\n"
         "    output bitstream files\n"
         "--w\n"
-        "    the width of input picture\n"
+        "    the width of input picture, probed from the stream if not set\n"
         "--h\n"
-        "    the height of input picture\n"
+        "    the height of input picture, probed from the stream if not set\n"
         "--t\n"
-        "    input pictrue type(h264 default):\n"
+        "    input pictrue type, probed from the stream if not set:\n"
         "        1: h264\n"
         "        2: h265\n"
+        "--m\n"
+        "    mmap the input file, frames are sent to decoder without copy\n"
+        "--a\n"
+        "    async mode, decoder feeds and drains vpu in its own threads\n"
+        "--p\n"
+        "    number of pre-allocated output frames, vpu allocates if not set\n"
+        "--f\n"
+        "    output yuv format, display region only:\n"
+        "        1: nv12(default)\n"
+        "        2: i420\n"
+        "        3: rgba8888\n"
+        "        4: bgr888\n"
+        "        5: p010, 10bit stream only\n"
+        "        6: i010, 10bit stream only\n"
+        "    10bit stream goes down to 8bit with nv12 and i420\n"
+        "--j\n"
+        "    threads converting one frame, default 1\n"
+        "--n\n"
+        "    ordered dither noise when 10bit goes down to 8bit, rounding if not set\n"
+        "--l\n"
+        "    latency mode, each frame is output as soon as decoded, no reorder delay\n"
+        "--d\n"
+        "    write output file with O_DIRECT\n"
+        "--s\n"
+        "    start at this frame, decoded from the key frame before it,\n"
+        "    the key frame index is saved to input.idx for the next run\n"
+        "--k\n"
+        "    keep part of the frames, others are dropped before the decoder:\n"
+        "        1: key frames only\n"
+        "        2: reference frames only\n"
+        "--g\n"
+        "    gap in frames between key frames decoded, key frames only mode\n"
+        "--e\n"
+        "    frames with errors are dropped until the next key frame,\n"
+        "    output as concealed if not set\n"
         "\n");
 }
 
@@ -103,12 +171,37 @@ VPU_RET testParseArgs(DecTestCtx *ctx, int argc, char **argv)
         { "width",              required_argument,  NULL, 'w' },
         { "height",             required_argument,  NULL, 'h' },
         { "type",               required_argument,  NULL, 't' },
+        { "mmap",               no_argument,        NULL, 'm' },
+        { "async",              no_argument,        NULL, 'a' },
+        { "pool",               required_argument,  NULL, 'p' },
+        { "format",             required_argument,  NULL, 'f' },
+        { "direct",             no_argument,        NULL, 'd' },
+        { "jobs",               required_argument,  NULL, 'j' },
+        { "noise",              no_argument,        NULL, 'n' },
+        { "latency",            no_argument,        NULL, 'l' },
+        { "seek",               required_argument,  NULL, 's' },
+        { "keep",               required_argument,  NULL, 'k' },
+        { "gap",                required_argument,  NULL, 'g' },
+        { "error",              no_argument,        NULL, 'e' },
         { NULL,                 0,                  NULL, 0 }
     };
 
     ctx->width = 0;
     ctx->height = 0;
     ctx->hasOutput = false;
+    ctx->outFormat = RKYuvWriter::YUV_FORMAT_NV12;
+    ctx->useMmap = false;
+    ctx->threaded = false;
+    ctx->framePoolNum = 0;
+    ctx->directIo = false;
+    ctx->convertThreads = 1;
+    ctx->dither = false;
+    ctx->latencyMode = false;
+    ctx->seekFrame = -1;
+    ctx->decodeMode = RKHWDecApi::DECODE_MODE_ALL;
+    ctx->keyGap = 0;
+    ctx->dropErrors = false;
+    ctx->hasType = false;
     ctx->videoCoding = OMX_RK_VIDEO_CodingAVC; // h264 defualt
     ctx->numBuffersDecoded = 0;
 
@@ -139,12 +232,78 @@ VPU_RET testParseArgs(DecTestCtx *ctx, int argc, char **argv)
             ctx->height = atoi(optarg);
             break;
         case 't':
+            ctx->hasType = true;
             if (atoi(optarg) == 2) {
                 ctx->videoCoding = OMX_RK_VIDEO_CodingHEVC;
             } else {
                 ctx->videoCoding = OMX_RK_VIDEO_CodingAVC;
             }
             break;
+        case 'm':
+            ctx->useMmap = true;
+            break;
+        case 'a':
+            ctx->threaded = true;
+            break;
+        case 'p':
+            ctx->framePoolNum = atoi(optarg);
+            break;
+        case 'f':
+            switch (atoi(optarg)) {
+            case 2:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_I420;
+                break;
+            case 3:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_RGBA8888;
+                break;
+            case 4:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_BGR888;
+                break;
+            case 5:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_P010;
+                break;
+            case 6:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_I010;
+                break;
+            default:
+                ctx->outFormat = RKYuvWriter::YUV_FORMAT_NV12;
+                break;
+            }
+            break;
+        case 'd':
+            ctx->directIo = true;
+            break;
+        case 'j':
+            ctx->convertThreads = atoi(optarg);
+            break;
+        case 'n':
+            ctx->dither = true;
+            break;
+        case 'l':
+            ctx->latencyMode = true;
+            break;
+        case 's':
+            ctx->seekFrame = atoi(optarg);
+            break;
+        case 'k':
+            switch (atoi(optarg)) {
+            case 1:
+                ctx->decodeMode = RKHWDecApi::DECODE_MODE_KEY_ONLY;
+                break;
+            case 2:
+                ctx->decodeMode = RKHWDecApi::DECODE_MODE_REF_ONLY;
+                break;
+            default:
+                ctx->decodeMode = RKHWDecApi::DECODE_MODE_ALL;
+                break;
+            }
+            break;
+        case 'g':
+            ctx->keyGap = atoi(optarg);
+            break;
+        case 'e':
+            ctx->dropErrors = true;
+            break;
         default:
             fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
             return VPU_ERR_UNKNOW;
@@ -161,48 +320,127 @@ VPU_RET testParseArgs(DecTestCtx *ctx, int argc, char **argv)
         "   input bitstream file : %s\n"
         "   output bitstream file: %s\n"
         "   input_resolution     : %dx%d\n"
-        "   input video coding   : %d\n",
+        "   input video coding   : %d\n"
+        "   mmap input           : %d\n"
+        "   async mode           : %d\n"
+        "   frame pool           : %d\n"
+        "   direct io            : %d\n",
         ctx->fileInput, ctx->fileOutput, ctx->width,
-        ctx->height, ctx->videoCoding);
+        ctx->height, ctx->videoCoding, ctx->useMmap, ctx->threaded,
+        ctx->framePoolNum, ctx->directIo);
 
     return VPU_OK;
 }
 
+/*
+ * the threaded mode goes through the rings of RKHWDecApi, the feeding and
+ * draining of vpu run in the decoder threads.
+ */
+static VPU_RET testSendStream(RKHWDecApi *decApi, DecTestCtx *decCtx,
+                              char *data, int32_t size, int64_t pts, int32_t flag)
+{
+    if (decCtx->threaded)
+        return decApi->pushPacket(data, size, pts, flag, 0);
+
+    return decApi->sendStream(data, size, pts, flag);
+}
+
+static void printLatency(const char *name, RKLatencyTracker::LatencyStats *stats)
+{
+    printf("%s: %lld frames, first frame %lld us, avg %lld p50 %lld p95 %lld p99 %lld max %lld us\n",
+           name, (long long)stats->frames, (long long)stats->firstFrameUs,
+           (long long)stats->avgUs, (long long)stats->p50Us, (long long)stats->p95Us,
+           (long long)stats->p99Us, (long long)stats->maxUs);
+}
+
+static VPU_RET testGetOutFrame(RKHWDecApi *decApi, DecTestCtx *decCtx,
+                               DecodedFrame *frame, int32_t timeoutMs)
+{
+    if (decCtx->threaded)
+        return decApi->popFrame(frame, timeoutMs);
+
+    return decApi->getOutFrame(frame, timeoutMs);
+}
+
 VPU_RET runDecoder(RKHWDecApi *decApi, DecTestCtx *decCtx)
 {
     VPU_RET ret = VPU_OK;
-    FILE *fpInput = NULL, *fpOutput = NULL;
+    RKYuvWriter writer;
+    RKStreamPacker packer;
+    RKStreamIndex index;
+    /*
+     * glass to glass as seen by the application, from the packet read out
+     * of the file until the frame handed to the writer.
+     */
+    RKLatencyTracker glass;
+    int64_t pktPts = 0;
     char *pktBuf = NULL;
-    int32_t pktsize = 1000; // 1000 byte
+    char eosBuf[1] = { 0 };
 
     bool sawInputEOS = false, signalledInputEOS = false;
     // Indicates that the last buffer has delivered to vpu_decoder
     bool lastPktQueued = true;
-    int32_t readsize;
-
-    pktBuf = (char*)malloc(sizeof(char) * pktsize);
+    int32_t readsize = 0;
 
     // input and output dst
-    fpInput = fopen(decCtx->fileInput, "rb+");
-    if (fpInput == NULL) {
+    if (packer.open(decCtx->fileInput, decCtx->videoCoding,
+                    decCtx->useMmap) != VPU_OK) {
         fprintf(stderr, "failed to open input file %s\n", decCtx->fileInput);
         ret = VPU_ERR_INIT;
         goto DECODE_OUT;
     }
 
+    if (decCtx->seekFrame >= 0) {
+        int64_t startUs = time_now_us();
+        int64_t offset = 0;
+
+        if (index.open(decCtx->fileInput, decCtx->videoCoding) != VPU_OK) {
+            fprintf(stderr, "failed to index input file %s\n", decCtx->fileInput);
+            ret = VPU_ERR_INIT;
+            goto DECODE_OUT;
+        }
+        printf("key frame index: %d key frames in %d frames, %lld us\n",
+               index.keyFrameCount(), index.frameCount(),
+               (long long)(time_now_us() - startUs));
+
+        decApi->setStreamIndex(&index);
+        if (decApi->seekTo(decCtx->seekFrame, &offset) != VPU_OK ||
+            packer.seek(offset) != VPU_OK) {
+            fprintf(stderr, "failed to seek to frame %d\n", decCtx->seekFrame);
+            ret = VPU_ERR_STREAM;
+            goto DECODE_OUT;
+        }
+        printf("seek to frame %d from offset %lld\n", decCtx->seekFrame,
+               (long long)offset);
+    }
+
     if (decCtx->hasOutput) {
-        fpOutput = fopen(decCtx->fileOutput, "wb+");
-        if (fpOutput == NULL) {
+        if (writer.open(decCtx->fileOutput, decCtx->outFormat,
+                        OUTPUT_WRITE_DEPTH, decCtx->directIo) != VPU_OK) {
             fprintf(stderr, "failed to open output file %s\n", decCtx->fileOutput);
             ret = VPU_ERR_INIT;
             goto DECODE_OUT;
         }
+        if (decCtx->convertThreads > 1)
+            writer.setConvertThreads(decCtx->convertThreads);
+        writer.setDither(decCtx->dither);
     }
 
     while (true) {
         if (!sawInputEOS && lastPktQueued) {
-            readsize = fread(pktBuf, 1, pktsize, fpInput);
-            if (readsize != pktsize && feof(fpInput)) {
+            // one complete frame each time, vpu split mode is closed.
+            // in mmap mode pktBuf points into the mapping and keeps valid
+            // until next readFrame, so it is resent as is on VPU_EAGAIN.
+            ret = packer.readFrame(&pktBuf, &readsize);
+            if (ret == VPU_ERR_UNKNOW) {
+                fprintf(stderr, "failed to read input file %s\n", decCtx->fileInput);
+                goto DECODE_OUT;
+            } else if (ret != VPU_OK) {
+                pktBuf = eosBuf;
+                readsize = 0;
+            }
+            glass.onSend(++pktPts);
+            if (packer.isEos()) {
                 ALOGD("saw input eos");
                 sawInputEOS = true;
             }
@@ -210,43 +448,55 @@ VPU_RET runDecoder(RKHWDecApi *decApi, DecTestCtx *decCtx)
         }
 
         if (!sawInputEOS) {
-            ret = decApi->sendStream(pktBuf, readsize, 0, 0);
+            ret = testSendStream(decApi, decCtx, pktBuf, readsize, pktPts, 0);
             if (!ret) {
                 lastPktQueued = true;
-            } else {
-                /* reduce cpu overhead here */
-                usleep(1000);
             }
         } else {
             if (!signalledInputEOS) {
-                ret = decApi->sendStream(pktBuf, readsize, 0, OMX_BUFFERFLAG_EOS);
+                ret = testSendStream(decApi, decCtx, pktBuf, readsize, pktPts,
+                                     OMX_BUFFERFLAG_EOS);
                 if (ret == VPU_OK) {
                     lastPktQueued = true;
                     signalledInputEOS = true;
-                } else {
-                    usleep(1000);
                 }
             }
         }
 
-        VPU_FRAME vframe;
-        ret = decApi->getOutFrame(&vframe);
+        /*
+         * don't wait while the input goes on, otherwise the input queue
+         * is full or all input sent, block until a frame is ready.
+         */
+        int32_t timeoutMs = (lastPktQueued && !signalledInputEOS) ? 0 : OUTPUT_WAIT_MS;
+
+        /*
+         * VPU_FRAME buffers used recycled inside decoder, the handle gives
+         * the buffer back when it goes out of scope.
+         */
+        DecodedFrame frame;
+        ret = testGetOutFrame(decApi, decCtx, &frame, timeoutMs);
         if (ret == VPU_OK) {
             ++decCtx->numBuffersDecoded;
 
             if (decCtx->hasOutput) {
-                fwrite(vframe.vpumem.vir_addr, 1, vframe.vpumem.size, fpOutput);
-                fflush(fpOutput);
+                // visible region only, written on the writer thread
+                ret = writer.writeFrame(frame);
+                if (ret != VPU_OK) {
+                    fprintf(stderr, "failed to write output file\n");
+                    goto DECODE_OUT;
+                }
             }
 
-            /*
-             * VPU_FRAME buffers used recycled inside decoder, so release
-             * that buffer which has been display success.
-             */
-             decApi->deinitOutFrame(&vframe);
-        } else if (ret == VPU_EAGAIN) {
-            /* reduce cpu overhead here */
-            usleep(1000);
+            VPU_FRAME *vframe = frame.get();
+            glass.onOutput(((int64_t)vframe->ShowTime.TimeHigh << 32) |
+                           vframe->ShowTime.TimeLow);
+        } else if (ret == VPU_FORMAT_CHANGED) {
+            RKHWDecApi::OutputFormat fmt;
+
+            decApi->getOutputFormat(&fmt);
+            printf("output format change to %dx%d(%dx%d) after %lld frames\n",
+                   fmt.width, fmt.height, fmt.stride, fmt.vstride,
+                   (long long)decCtx->numBuffersDecoded);
         } else if (ret == VPU_EOS_STREAM_REACHED) {
             ALOGD("saw output eos");
             break;
@@ -256,13 +506,31 @@ VPU_RET runDecoder(RKHWDecApi *decApi, DecTestCtx *decCtx)
     ret = VPU_OK;
 
 DECODE_OUT:
-    free(pktBuf);
+    packer.close();
+    decApi->setStreamIndex(NULL);
+
+    if (decCtx->hasOutput) {
+        RKAsyncWriter::WriterStats stats;
+
+        if (writer.close() != VPU_OK && ret == VPU_OK)
+            ret = VPU_ERR_UNKNOW;
+
+        writer.getStats(&stats);
+        printf("\n%lld bytes of yuv written, %.2f MB/s, %lld blocks\n",
+               (long long)stats.bytes,
+               stats.writeUs ? (double)stats.bytes / stats.writeUs : 0.0,
+               (long long)stats.blocks);
+        printf("writer queue max %d/%d, %lld stalls %lld us\n",
+               stats.maxDepth, stats.capacity,
+               (long long)stats.stalls, (long long)stats.stallUs);
+    }
 
-    if (fpInput != NULL)
-        fclose(fpInput);
+    if (ret == VPU_OK) {
+        RKLatencyTracker::LatencyStats lstats;
 
-    if (fpOutput != NULL)
-        fclose(fpOutput);
+        glass.getStats(&lstats);
+        printLatency("\nglass to glass latency", &lstats);
+    }
 
     return ret;
 }
@@ -282,12 +550,61 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    ret = decApi.prepare(decCtx.width, decCtx.height, decCtx.videoCoding);
+    /*
+     * codec and picture size from the first sps, so that the decoder and
+     * its frame pool are set up right before the first packet.
+     */
+    StreamProbeInfo probe;
+    int64_t probeUs = time_now_us();
+    if (stream_probe_file(decCtx.fileInput, &probe) == 0) {
+        printf("probe: %s %dx%d(%dx%d), %d bit, chroma format %d, %lld us\n",
+               stream_probe_mime(probe.coding), probe.sps.width, probe.sps.height,
+               probe.sps.codedWidth, probe.sps.codedHeight, probe.sps.bitDepth,
+               probe.sps.chromaFormat, (long long)(time_now_us() - probeUs));
+
+        if (!decCtx.hasType) {
+            decCtx.videoCoding = probe.coding;
+        } else if (decCtx.videoCoding != probe.coding) {
+            fprintf(stderr, "WARNING: input type %d, but the stream looks like %s\n",
+                    decCtx.videoCoding, stream_probe_mime(probe.coding));
+        }
+        if (decCtx.width <= 0 || decCtx.height <= 0) {
+            decCtx.width = probe.sps.width;
+            decCtx.height = probe.sps.height;
+        }
+    } else if (!decCtx.hasType || decCtx.width <= 0 || decCtx.height <= 0) {
+        fprintf(stderr, "WARNING: failed to probe input, set --t --w --h\n");
+    }
+
+    RKHWDecApi::DecCfgInfo cfg;
+    cfg.width = decCtx.width;
+    cfg.height = decCtx.height;
+    cfg.coding = decCtx.videoCoding;
+    cfg.splitMode = 0;  // RKStreamPacker sends one frame each time
+    cfg.framePoolNum = decCtx.framePoolNum;
+    cfg.framePoolSize = 0;
+    cfg.latencyMode = decCtx.latencyMode ? 1 : 0;
+
+    ret = decApi.prepare(&cfg);
     if (ret) {
         fprintf(stderr, "ERROR: decApi prapare failed(err=%d)", ret);
         return 1;
     }
 
+    // pts of the packets are frame numbers, the gap goes as is
+    if (decCtx.decodeMode != RKHWDecApi::DECODE_MODE_ALL)
+        decApi.setDecodeMode(decCtx.decodeMode, decCtx.keyGap);
+    if (decCtx.dropErrors)
+        decApi.setErrorPolicy(RKHWDecApi::ERROR_POLICY_DROP_TO_KEY);
+
+    if (decCtx.threaded) {
+        ret = decApi.startThreads(THREAD_IN_DEPTH, THREAD_OUT_DEPTH);
+        if (ret) {
+            fprintf(stderr, "ERROR: decApi start threads failed(err=%d)", ret);
+            return 1;
+        }
+    }
+
     time_start_record();
 
     ret = runDecoder(&decApi, &decCtx);
@@ -297,8 +614,67 @@ int main(int argc, char **argv)
     } else {
         int64_t elapsedTimeUs = time_end_record();
         printf("\ndec_test done, %lld frames decoded in %lld ms, %.2f fps\n",
-               (long long)decCtx.numBuffersDecoded, elapsedTimeUs / 1000,
-               decCtx.numBuffersDecoded * 1E6 / elapsedTimeUs);
+               (long long)decCtx.numBuffersDecoded, (long long)(elapsedTimeUs / 1000),
+               (elapsedTimeUs > 0) ? decCtx.numBuffersDecoded * 1E6 / elapsedTimeUs : 0.0);
+
+        RKPollWaiter::WaitStats stats;
+        decApi.getWaitStats(&stats);
+        printf("output wait: %lld waits, %lld wakeups, %lld wasted, %lld timeouts\n",
+               (long long)stats.waits, (long long)stats.wakeups,
+               (long long)stats.wastedWakeups, (long long)stats.timeouts);
+
+        RKLatencyTracker::LatencyStats lstats;
+        decApi.getLatencyStats(&lstats);
+        printLatency(decCtx.latencyMode ? "decode latency(latency mode)" :
+                     "decode latency(throughput mode)", &lstats);
+        printf("reorder depth max %d, %lld unmatched, %lld packets without output\n",
+               lstats.reorderMax, (long long)lstats.unmatched,
+               (long long)(lstats.noOutput + lstats.pending));
+
+        if (decCtx.threaded) {
+            RKHWDecApi::ThreadStats tstats;
+            decApi.getThreadStats(&tstats);
+            printf("async mode: stalls push %lld feed %lld drain %lld pop %lld\n",
+                   (long long)tstats.pushStalls, (long long)tstats.feedStalls,
+                   (long long)tstats.drainStalls, (long long)tstats.popStalls);
+        }
+
+        RKHWDecApi::InfoChangeStats istats;
+        decApi.getInfoChangeStats(&istats);
+        if (istats.outputChanges > 0) {
+            printf("info change: %d in stream, %d out, %d pool resizes, switch max %lld us\n",
+                   istats.inputChanges, istats.outputChanges, istats.poolResizes,
+                   (long long)istats.maxSwitchUs);
+        }
+
+        if (decCtx.framePoolNum > 0) {
+            RKHWDecApi::FramePoolInfo pinfo;
+            decApi.getFramePoolInfo(&pinfo);
+            printf("frame pool: %d frames of %d bytes, %d unused\n",
+                   pinfo.num, pinfo.size, pinfo.unused);
+        }
+
+        RKHWDecApi::ErrorStats estats;
+        decApi.getErrorStats(&estats);
+        if (estats.errorFrames > 0) {
+            printf("stream errors: %lld frames with errors, %lld concealed, dropped %lld frames "
+                   "%lld packets, %lld recoveries\n",
+                   (long long)estats.errorFrames, (long long)estats.concealedFrames,
+                   (long long)estats.droppedFrames, (long long)estats.droppedPackets,
+                   (long long)estats.recoveries);
+        }
+
+        if (decCtx.decodeMode != RKHWDecApi::DECODE_MODE_ALL) {
+            RKHWDecApi::DecodeModeStats mstats;
+            decApi.getDecodeModeStats(&mstats);
+
+            int64_t frames = mstats.sentFrames + mstats.droppedFrames;
+            int64_t bytes = mstats.sentBytes + mstats.droppedBytes;
+            printf("decode mode %d: %lld of %lld frames sent, %.1f%% frames %.1f%% bytes saved\n",
+                   decCtx.decodeMode, (long long)mstats.sentFrames, (long long)frames,
+                   frames ? mstats.droppedFrames * 100.0 / frames : 0.0,
+                   bytes ? mstats.droppedBytes * 100.0 / bytes : 0.0);
+        }
     }
 
     return 0;
@@ -27,6 +27,15 @@
 #include <string.h>
 
 #include "rkvpu_enc_api.h"
+#include "rkvpu_nal_scan.h"
+#include "rkvpu_sps.h"
+
+/* parameter sets cached at most */
+#define ENC_HEADER_MAX_SIZE     2048
+
+#define HEVC_NAL_VPS            32
+#define HEVC_NAL_SPS            33
+#define HEVC_NAL_PPS            34
 
 typedef enum {
     UNSUPPORT_PROFILE = -1,
@@ -66,37 +75,83 @@ typedef enum HEVCLevel {
     HEVC_LEVEL_MAX = 0x7FFFFFFF,
 } HEVCLevel;
 
+/* bytes of one input picture, packed without stride */
+static int32_t getInputSize(int32_t format, int32_t width, int32_t height)
+{
+    switch (format) {
+    case ENC_INPUT_YUV420_PLANAR:
+    case ENC_INPUT_YUV420_SEMIPLANAR:
+        return width * height * 3 / 2;
+    case ENC_INPUT_RGB888:
+    case ENC_INPUT_BGR888:
+        return width * height * 3;
+    case ENC_INPUT_RGB101010:
+    case ENC_INPUT_BGR101010:
+        return width * height * 4;
+    default:
+        // yuv422 interleaved and 16 bit rgb
+        return width * height * 2;
+    }
+}
+
 RKHWEncApi::RKHWEncApi()
 {
     ALOGV("RKHWEncApi constructor");
 
     mVpuCtx = NULL;
-    mOutputBuf = NULL;
     mSpsPpsBuf = NULL;
     mSpsPpsLen = 0;
+    mHeaderMode = HEADER_MODE_FIRST;
     mInitOK = 0;
     mFrameCount = 0;
+    mInputCount = 0;
+    mInputEos = false;
+    mInputBufs = NULL;
+    mInputNum = 0;
+    mInputSize = 0;
+    mSentHead = 0;
+    mSentCount = 0;
+
+    memset(&mEncParams, 0, sizeof(mEncParams));
+    pthread_mutex_init(&mCfgLock, NULL);
+    memset(&mPendingCfg, 0, sizeof(mPendingCfg));
+    mCfgPending = false;
+    mReconfigInterval = ENC_RECONFIG_MIN_FRAMES;
+    mLastCfgFrame = -1;
+    memset(&mReconfigStats, 0, sizeof(mReconfigStats));
+    mReconfigStats.appliedFrame = -1;
+    mKeyPending = false;
+    memset(&mKeyStats, 0, sizeof(mKeyStats));
+    mKeyStats.forcedFrame = -1;
 }
 
 RKHWEncApi::~RKHWEncApi()
 {
     ALOGV("RKHWEncApi destructor");
 
-    mVpuCtx->flush(mVpuCtx);
     if (mVpuCtx != NULL) {
+        mVpuCtx->flush(mVpuCtx);
         vpu_close_context(&mVpuCtx);
         free(mVpuCtx);
         mVpuCtx = NULL;
     }
 
-    if (mOutputBuf != NULL) {
-        free(mOutputBuf);
-        mOutputBuf = NULL;
-    }
     if (mSpsPpsBuf != NULL) {
         free(mSpsPpsBuf);
         mSpsPpsBuf = NULL;
     }
+
+    // the encoder is closed, no picture is read any more
+    if (mInputBufs != NULL) {
+        for (int32_t i = 0; i < mInputNum; i++) {
+            if (mInputBufs[i].mem.vir_addr != NULL)
+                VPUFreeLinear(&mInputBufs[i].mem);
+        }
+        free(mInputBufs);
+        mInputBufs = NULL;
+    }
+
+    pthread_mutex_destroy(&mCfgLock);
 }
 
 VPU_RET RKHWEncApi::prepare(EncCfgInfo *cfg)
@@ -111,7 +166,11 @@ VPU_RET RKHWEncApi::prepare(EncCfgInfo *cfg)
         return VPU_ERR_INIT;
     }
 
-    mOutputBuf = (unsigned char *)malloc(cfg->width * cfg->height * 2);
+    // about one second of stream, not the frame size
+    if (mPacketPool.init(RKPacketPool::sizeFor(cfg->bitRate, cfg->width * cfg->height))) {
+        ALOGE("ERROR: failed to malloc packet pool");
+        return VPU_ERR_INIT;
+    }
 
     mVpuCtx->codecType = CODEC_ENCODER;
     mVpuCtx->videoCoding = cfg->coding;
@@ -172,27 +231,93 @@ VPU_RET RKHWEncApi::prepare(EncCfgInfo *cfg)
     }
 
     mVpuCtx->control(mVpuCtx, VPU_API_ENC_GETCFG, (void*)params);
+    // base of the configs set by reconfigure
+    memcpy(&mEncParams, params, sizeof(EncParameter_t));
+    // h265 parameter sets are filled in from the stream
+    mSpsPpsBuf = (unsigned char *)malloc(ENC_HEADER_MAX_SIZE);
+    if (mSpsPpsBuf == NULL) {
+        ALOGE("ERROR: failed to malloc header buffer");
+        return VPU_ERR_INIT;
+    }
     if (cfg->coding == OMX_RK_VIDEO_CodingAVC) {
-        if (mVpuCtx->extradata != NULL && mVpuCtx->extradata_size < 2048) {
-            mSpsPpsBuf = (unsigned char *)malloc(2048);
+        if (mVpuCtx->extradata != NULL && mVpuCtx->extradata_size < ENC_HEADER_MAX_SIZE) {
             memcpy(mSpsPpsBuf, mVpuCtx->extradata, mVpuCtx->extradata_size);
             mSpsPpsLen = mVpuCtx->extradata_size;
             ALOGD("general H264 SPS_PPS len %d", mSpsPpsLen);
         }
     } else {
-        mSpsPpsBuf = NULL;
         mSpsPpsLen = 0;
     }
 
+    mInputSize = getInputSize(cfg->format, cfg->width, cfg->height);
+    if (cfg->inputPoolNum > 0) {
+        mInputBufs = (InputBuffer *)calloc(cfg->inputPoolNum, sizeof(InputBuffer));
+        if (mInputBufs == NULL) {
+            ALOGE("ERROR: failed to malloc input pool");
+            return VPU_ERR_INIT;
+        }
+        mInputNum = cfg->inputPoolNum;
+
+        for (int32_t i = 0; i < mInputNum; i++) {
+            mInputBufs[i].index = i;
+            if (VPUMallocLinear(&mInputBufs[i].mem, mInputSize)) {
+                ALOGE("ERROR: failed to malloc input buffer %d, size %d", i, mInputSize);
+                return VPU_ERR_INIT;
+            }
+        }
+        ALOGD("input pool %d x %d bytes", mInputNum, mInputSize);
+    }
+
     mCoding = cfg->coding;
     mInitOK = 1;
 
     return VPU_OK;
 }
 
-VPU_RET RKHWEncApi::sendFrame(char *data, int32_t size, int64_t pts, int32_t flag)
+VPU_RET RKHWEncApi::queueFrame(EncInputStream_t *input, int32_t index)
 {
+    int32_t size = input->size;
     int32_t ret;
+    // with a pool, every picture is kept in order to know when its buffer is free
+    bool track = mInputNum > 0 && size >= mInputSize;
+
+    if (track && mSentCount >= ENC_SENT_MAX)
+        return VPU_EAGAIN;
+
+    // a new config and a key frame request go in between two frames
+    if (!(input->nFlags & OMX_BUFFERFLAG_EOS)) {
+        applyRateCfg();
+        applyKeyFrameRequest();
+    }
+
+    ret = mVpuCtx->encoder_sendframe(mVpuCtx, input);
+    if (ret < 0) {
+        ALOGE("failed to send pkt(err=%d)", ret);
+        return VPU_ERR_UNKNOW;
+    } else if (input->size != 0) {
+        return VPU_EAGAIN;
+    }
+
+    if (track) {
+        mSent[(mSentHead + mSentCount) % ENC_SENT_MAX] = index;
+        mSentCount++;
+    }
+
+    if (input->nFlags & OMX_BUFFERFLAG_EOS)
+        mInputEos = true;
+    else
+        mInputCount++;
+
+    // new input queued, the output may be ready soon
+    mWaiter.signal();
+
+    ALOGD("send pkt size %d pts %lld flag %d", size, input->timeUs, input->nFlags);
+
+    return VPU_OK;
+}
+
+VPU_RET RKHWEncApi::sendFrame(char *data, int32_t size, int64_t pts, int32_t flag)
+{
     EncInputStream_t aInput;
 
     if (!mInitOK) {
@@ -212,61 +337,437 @@ VPU_RET RKHWEncApi::sendFrame(char *data, int32_t size, int64_t pts, int32_t fla
         aInput.size = 1;
     }
 
-    ret = mVpuCtx->encoder_sendframe(mVpuCtx, &aInput);
-    if (ret < 0) {
-        ALOGE("failed to send pkt(err=%d)", ret);
+    return queueFrame(&aInput, -1);
+}
+
+VPU_RET RKHWEncApi::acquireInputBuffer(InputBuffer **buffer)
+{
+    if (!mInitOK || mInputNum == 0) {
+        ALOGW("W - no input pool, set EncCfgInfo.inputPoolNum");
         return VPU_ERR_UNKNOW;
-    } else if (aInput.size != 0) {
+    }
+
+    for (int32_t i = 0; i < mInputNum; i++) {
+        InputBuffer *buf = &mInputBufs[i];
+        if (!buf->acquired && !buf->queued) {
+            buf->acquired = true;
+            *buffer = buf;
+            return VPU_OK;
+        }
+    }
+
+    return VPU_EAGAIN;
+}
+
+void RKHWEncApi::releaseInputBuffer(InputBuffer *buffer)
+{
+    if (buffer != NULL)
+        buffer->acquired = false;
+}
+
+VPU_RET RKHWEncApi::sendFrame(InputBuffer *buffer, int64_t pts, int32_t flag)
+{
+    EncInputStream_t aInput;
+    VPU_RET ret;
+
+    if (!mInitOK) {
+        ALOGW("W - prepare RKHWEncApi first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (buffer == NULL || !buffer->acquired) {
+        ALOGE("input buffer not acquired");
+        return VPU_ERR_UNKNOW;
+    }
+
+    // the picture is written by cpu, write back the cache for the encoder
+    VPUMemClean(&buffer->mem);
+
+    memset(&aInput, 0, sizeof(EncInputStream_t));
+    aInput.buf = (unsigned char *)buffer->mem.vir_addr;
+    aInput.bufPhyAddr = (RK_U32)VPUMemGetFD(&buffer->mem);
+    aInput.size = mInputSize;
+    aInput.timeUs = pts > 0 ? pts : VPU_API_NOPTS_VALUE;
+    aInput.nFlags = flag;
+
+    ret = queueFrame(&aInput, buffer->index);
+    if (ret == VPU_OK) {
+        buffer->acquired = false;
+        buffer->queued = true;
+    }
+
+    return ret;
+}
+
+/*
+ * the encoder outputs in send order, each packet frees the oldest picture.
+ * A picture dropped by the encoder only holds its buffer a little longer.
+ */
+void RKHWEncApi::releaseSentBuffers(int32_t count)
+{
+    while (count-- > 0 && mSentCount > 0) {
+        int32_t index = mSent[mSentHead];
+
+        if (index >= 0)
+            mInputBufs[index].queued = false;
+
+        mSentHead = (mSentHead + 1) % ENC_SENT_MAX;
+        mSentCount--;
+    }
+}
+
+/*
+ * keep the vps/sps/pps in front of the first slice of a h265 packet, the
+ * slice data is not scanned. Return true if the packet has its own sps.
+ */
+bool RKHWEncApi::cacheHeaders(const uint8_t *data, int32_t size)
+{
+    const uint8_t *end = data + size;
+    const uint8_t *pos = nal_scan_find(data, end);
+    uint8_t header[ENC_HEADER_MAX_SIZE];
+    int32_t len = 0;
+    bool hasSps = false;
+
+    while (pos != NULL && pos + 5 < end) {
+        const uint8_t *nal = pos + 3;
+        const uint8_t *next;
+        const uint8_t *nalEnd;
+        int32_t type = sps_nal_type(nal, OMX_RK_VIDEO_CodingHEVC);
+
+        if (sps_is_vcl(type, OMX_RK_VIDEO_CodingHEVC))
+            break;
+
+        next = nal_scan_find(nal, end);
+        if (type >= HEVC_NAL_VPS && type <= HEVC_NAL_PPS) {
+            // the zero_byte of the next start code is not part of it
+            nalEnd = (next != NULL) ? next : end;
+            while (nalEnd > nal && nalEnd[-1] == 0)
+                nalEnd--;
+
+            if (len + 4 + (nalEnd - nal) > ENC_HEADER_MAX_SIZE) {
+                ALOGW("parameter sets over %d bytes, not cached", ENC_HEADER_MAX_SIZE);
+                return false;
+            }
+            memcpy(header + len, "\x00\x00\x00\x01", 4);
+            memcpy(header + len + 4, nal, nalEnd - nal);
+            len += 4 + (nalEnd - nal);
+            hasSps |= (type == HEVC_NAL_SPS);
+        }
+
+        pos = next;
+    }
+
+    if (hasSps) {
+        memcpy(mSpsPpsBuf, header, len);
+        mSpsPpsLen = len;
+        ALOGV("h265 parameter sets cached, len %d", len);
+    }
+
+    return hasSps;
+}
+
+VPU_RET RKHWEncApi::getPacket(EncodedPacket *packet)
+{
+    EncoderOut_t aOut;
+    int32_t spsLen = 0;
+    bool inband = false;
+    int32_t ret;
+
+    if (!mInitOK) {
+        ALOGW("W - prepare RKHWEncApi first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    memset(&aOut, 0, sizeof(EncoderOut_t));
+
+    ret = mVpuCtx->encoder_getstream(mVpuCtx, &aOut);
+    if (ret < 0 || (aOut.size == 0 && mInputEos)) {
+        // nothing will come out, every picture is done
+        releaseSentBuffers(mSentCount);
+        return VPU_EOS_STREAM_REACHED;
+    } else if (aOut.size <= 0 || aOut.data == NULL) {
+        // nothing out yet, the stream ends only after input eos
         return VPU_EAGAIN;
     }
 
-    ALOGD("send pkt size %d pts %lld flag %d", size, pts, flag);
+    releaseSentBuffers(1);
+
+    // h265 key packets may carry new parameter sets in band
+    if (aOut.keyFrame && mCoding == OMX_RK_VIDEO_CodingHEVC)
+        inband = cacheHeaders(aOut.data, aOut.size);
+
+    if (!inband && (mFrameCount == 0 ||
+                    (aOut.keyFrame && mHeaderMode == HEADER_MODE_EACH_KEY)))
+        spsLen = mSpsPpsLen;
+
+    /*
+     * the buffer is malloc'd by vpu for each packet. h265 comes with start
+     * codes and is taken over as is, h264 is copied once into the ring
+     * behind room for the start code and the sps/pps of the first frame,
+     * so is a h265 key packet which needs the parameter sets in front.
+     */
+    if (mCoding == OMX_RK_VIDEO_CodingAVC || spsLen > 0) {
+        int32_t prefix = (mCoding == OMX_RK_VIDEO_CodingAVC) ? 4 : 0;
+
+        ret = mPacketPool.alloc(packet, aOut.size, spsLen + prefix);
+        if (!ret) {
+            memcpy(packet->data(), aOut.data, aOut.size);
+            packet->prepend("\x00\x00\x00\x01", prefix);
+            if (spsLen > 0)
+                packet->prepend(mSpsPpsBuf, spsLen);
+        }
+        free(aOut.data);
+    } else {
+        ret = mPacketPool.adopt(packet, aOut.data, aOut.size);
+        if (ret)
+            free(aOut.data);
+    }
+
+    if (ret) {
+        ALOGE("failed to get packet, size %d", aOut.size);
+        return VPU_ERR_UNKNOW;
+    }
+    packet->setInfo(aOut.timeUs, aOut.keyFrame);
+
+    if (aOut.keyFrame) {
+        pthread_mutex_lock(&mCfgLock);
+        mKeyStats.keyFrames++;
+        if (spsLen > 0 && mFrameCount > 0)
+            mKeyStats.headerRepeats++;
+        pthread_mutex_unlock(&mCfgLock);
+    }
+
+    mFrameCount++;
+    ALOGD("get one frame_num %d size %d pts %lld keyFrame %d",
+          mFrameCount, packet->size(), (long long)packet->pts(), packet->keyFrame());
 
     return VPU_OK;
 }
 
 VPU_RET RKHWEncApi::getOutStream(EncoderOut_t *encOut)
 {
+    VPU_RET ret;
+
+    memset(encOut, 0, sizeof(EncoderOut_t));
+
+    // the packet of the last call is done
+    mLastPacket.reset();
+
+    ret = getPacket(&mLastPacket);
+    if (ret == VPU_OK) {
+        encOut->data = mLastPacket.data();
+        encOut->size = mLastPacket.size();
+        encOut->timeUs = mLastPacket.pts();
+        encOut->keyFrame = mLastPacket.keyFrame();
+    }
+
+    return ret;
+}
+
+VPU_RET RKHWEncApi::getOutStream(EncoderOut_t *encOut, int32_t timeoutMs)
+{
+    VPU_RET ret;
+
+    mWaiter.begin(timeoutMs);
+    while (true) {
+        ret = getOutStream(encOut);
+        if (ret != VPU_EAGAIN)
+            break;
+
+        if (!mWaiter.wait())
+            return VPU_EAGAIN;
+    }
+    mWaiter.done();
+
+    return ret;
+}
+
+VPU_RET RKHWEncApi::getOutStream(EncodedPacket *packet, int32_t timeoutMs)
+{
+    VPU_RET ret;
+
+    mWaiter.begin(timeoutMs);
+    while (true) {
+        ret = getPacket(packet);
+        if (ret != VPU_EAGAIN)
+            break;
+
+        if (!mWaiter.wait())
+            return VPU_EAGAIN;
+    }
+    mWaiter.done();
+
+    return ret;
+}
+
+VPU_RET RKHWEncApi::reconfigure(const EncRateCfg *cfg)
+{
+    if (!mInitOK) {
+        ALOGW("W - prepare RKHWEncApi first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (cfg->framerate <= 0 || cfg->intraPicRate < 0 ||
+        cfg->rc_mode < ENC_RC_MODE_VBR || cfg->rc_mode > ENC_RC_MODE_FIXQP ||
+        (cfg->rc_mode != ENC_RC_MODE_FIXQP && cfg->bitRate <= 0)) {
+        ALOGE("invalid config bitRate %d framerate %d rc_mode %d gop %d",
+              cfg->bitRate, cfg->framerate, cfg->rc_mode, cfg->intraPicRate);
+        return VPU_ERR_UNKNOW;
+    }
+
+    pthread_mutex_lock(&mCfgLock);
+    mReconfigStats.requests++;
+    if (mCfgPending)
+        mReconfigStats.coalesced++;
+    mPendingCfg = *cfg;
+    mCfgPending = true;
+    pthread_mutex_unlock(&mCfgLock);
+
+    return VPU_OK;
+}
+
+void RKHWEncApi::getRateCfg(EncRateCfg *cfg)
+{
+    pthread_mutex_lock(&mCfgLock);
+    if (mCfgPending) {
+        *cfg = mPendingCfg;
+    } else {
+        cfg->bitRate = mEncParams.bitRate;
+        cfg->framerate = mEncParams.framerate;
+        cfg->rc_mode = mEncParams.rc_mode;
+        cfg->qp = mEncParams.qp;
+        cfg->intraPicRate = mEncParams.intraPicRate;
+    }
+    pthread_mutex_unlock(&mCfgLock);
+}
+
+void RKHWEncApi::setReconfigInterval(int32_t minFrames)
+{
+    pthread_mutex_lock(&mCfgLock);
+    mReconfigInterval = (minFrames > 0) ? minFrames : ENC_RECONFIG_MIN_FRAMES;
+    pthread_mutex_unlock(&mCfgLock);
+}
+
+void RKHWEncApi::getReconfigStats(ReconfigStats *stats)
+{
+    pthread_mutex_lock(&mCfgLock);
+    *stats = mReconfigStats;
+    stats->pending = mCfgPending;
+    pthread_mutex_unlock(&mCfgLock);
+}
+
+/* called before a frame is sent, the pending config is set if it's time */
+void RKHWEncApi::applyRateCfg()
+{
+    EncParameter_t params;
+    EncRateCfg cfg;
+    int32_t oldBitRate = mEncParams.bitRate;
     int32_t ret;
 
+    pthread_mutex_lock(&mCfgLock);
+    if (!mCfgPending ||
+        (mLastCfgFrame >= 0 && mInputCount - mLastCfgFrame < mReconfigInterval)) {
+        pthread_mutex_unlock(&mCfgLock);
+        return;
+    }
+    cfg = mPendingCfg;
+    mCfgPending = false;
+    pthread_mutex_unlock(&mCfgLock);
+
+    memcpy(&params, &mEncParams, sizeof(EncParameter_t));
+    params.bitRate = cfg.bitRate;
+    params.framerate = cfg.framerate;
+    params.rc_mode = cfg.rc_mode;
+    params.qp = cfg.qp;
+    params.intraPicRate = cfg.intraPicRate;
+
+    ret = mVpuCtx->control(mVpuCtx, VPU_API_ENC_SETCFG, (void *)&params);
+
+    pthread_mutex_lock(&mCfgLock);
+    if (ret) {
+        mReconfigStats.failed++;
+    } else {
+        memcpy(&mEncParams, &params, sizeof(EncParameter_t));
+        mReconfigStats.applied++;
+        mReconfigStats.appliedFrame = mInputCount;
+        mLastCfgFrame = mInputCount;
+    }
+    pthread_mutex_unlock(&mCfgLock);
+
+    if (ret) {
+        ALOGE("failed to set config(err=%d)", ret);
+        return;
+    }
+
+    // the packet ring follows the new bitrate
+    if (params.bitRate != oldBitRate)
+        mPacketPool.resize(RKPacketPool::sizeFor(params.bitRate, params.width * params.height));
+
+    ALOGD("config at frame %lld: bitRate %d framerate %d rc_mode %d qp %d gop %d",
+          (long long)mInputCount, params.bitRate, params.framerate,
+          params.rc_mode, params.qp, params.intraPicRate);
+}
+
+VPU_RET RKHWEncApi::requestKeyFrame()
+{
     if (!mInitOK) {
         ALOGW("W - prepare RKHWEncApi first");
         return VPU_ERR_UNKNOW;
     }
 
-    memset(encOut, 0, sizeof(EncoderOut_t));
+    pthread_mutex_lock(&mCfgLock);
+    mKeyStats.requests++;
+    mKeyPending = true;
+    pthread_mutex_unlock(&mCfgLock);
 
-    ret = mVpuCtx->encoder_getstream(mVpuCtx, encOut);
-    if (ret < 0 || encOut->size == 0) {
-        return VPU_EOS_STREAM_REACHED;
-    } else if (encOut->size > 0) {
-        if (mCoding == OMX_RK_VIDEO_CodingAVC) {
-            int32_t offset = 0;
-            if (mFrameCount == 0 && mSpsPpsLen > 0) {
-                // h264 sps_pps header flag
-                memcpy(mOutputBuf, mSpsPpsBuf, mSpsPpsLen);
-                encOut->size += mSpsPpsLen;
-                offset = mSpsPpsLen;
-            }
+    return VPU_OK;
+}
 
-            memcpy(mOutputBuf + offset, "\x00\x00\x00\x01", 4);
-            memcpy(mOutputBuf + offset + 4, encOut->data, encOut->size);
-            encOut->size += 4;
-        } else {
-            memcpy(mOutputBuf, encOut->data, encOut->size);
-        }
+void RKHWEncApi::setHeaderMode(HeaderMode mode)
+{
+    mHeaderMode = mode;
+}
 
-        if (encOut->data != NULL) {
-            free(encOut->data);
-            encOut->data = mOutputBuf;
-        }
+void RKHWEncApi::getKeyFrameStats(KeyFrameStats *stats)
+{
+    pthread_mutex_lock(&mCfgLock);
+    *stats = mKeyStats;
+    pthread_mutex_unlock(&mCfgLock);
+}
 
-        mFrameCount++;
-        ALOGD("get one frame_num %d size %d pts %lld keyFrame %d",
-              mFrameCount, encOut->size, encOut->timeUs, encOut->keyFrame);
+/* called before a frame is sent, the frame is encoded as a key frame */
+void RKHWEncApi::applyKeyFrameRequest()
+{
+    int32_t ret;
 
-        return VPU_OK;
+    pthread_mutex_lock(&mCfgLock);
+    if (!mKeyPending) {
+        pthread_mutex_unlock(&mCfgLock);
+        return;
     }
+    mKeyPending = false;
+    pthread_mutex_unlock(&mCfgLock);
 
-    return VPU_EAGAIN;
+    ret = mVpuCtx->control(mVpuCtx, VPU_API_ENC_SETIDRFRAME, NULL);
+    if (ret) {
+        ALOGE("failed to request idr frame(err=%d)", ret);
+        return;
+    }
+
+    pthread_mutex_lock(&mCfgLock);
+    mKeyStats.forced++;
+    mKeyStats.forcedFrame = mInputCount;
+    pthread_mutex_unlock(&mCfgLock);
+
+    ALOGD("key frame at frame %lld", (long long)mInputCount);
+}
+
+void RKHWEncApi::getWaitStats(RKPollWaiter::WaitStats *stats)
+{
+    mWaiter.getStats(stats);
+}
+
+void RKHWEncApi::getPacketPoolStats(RKPacketPool::PoolStats *stats)
+{
+    mPacketPool.getStats(stats);
 }
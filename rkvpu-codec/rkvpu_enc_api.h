@@ -21,22 +21,18 @@
 #ifndef __RKVPU_ENC_API_H__
 #define __RKVPU_ENC_API_H__
 
+#include <pthread.h>
+
 #include "vpu_api.h"
+#include "rkvpu_ret.h"
+#include "rkvpu_waiter.h"
+#include "rkvpu_packet_pool.h"
+
+/* pictures in the encoder tracked at most */
+#define ENC_SENT_MAX            64
 
-#define OMX_BUFFERFLAG_EOS              0x00000001
-
-typedef enum VPU_RET {
-    VPU_OK                      = 0,
-    VPU_ERR_UNKNOW              = -1,
-    VPU_ERR_BASE                = -1000,
-    VPU_ERR_LIST_STREAM         = VPU_API_ERR_BASE - 1,
-    VPU_ERR_INIT                = VPU_API_ERR_BASE - 2,
-    VPU_ERR_VPU_CODEC_INIT      = VPU_API_ERR_BASE - 3,
-    VPU_ERR_STREAM              = VPU_API_ERR_BASE - 4,
-    VPU_ERR_FATAL_THREAD        = VPU_API_ERR_BASE - 5,
-    VPU_EAGAIN                  = VPU_API_ERR_BASE - 6,
-    VPU_EOS_STREAM_REACHED      = VPU_API_ERR_BASE - 11,
-} VPU_RET;
+/* frames between two configs applied by reconfigure at least */
+#define ENC_RECONFIG_MIN_FRAMES 1
 
 /* Rate control parameter */
 typedef enum MppEncRcMode_e {
@@ -61,8 +57,50 @@ public:
         int32_t bitRate;      /* target bitrate */
         int32_t framerate;
         int32_t qp;
+        int32_t inputPoolNum; /* input pictures in vpu memory, 0 - copied by vpu
+                                 from the data of sendFrame */
     } EncCfgInfo_t;
 
+    /* settings which can be changed by reconfigure between frames */
+    typedef struct EncRateCfg {
+        int32_t bitRate;
+        int32_t framerate;
+        int32_t rc_mode;
+        int32_t qp;
+        int32_t intraPicRate; /* gop length in frames */
+    } EncRateCfg_t;
+
+    typedef struct ReconfigStats {
+        int64_t requests;     /* reconfigure calls */
+        int64_t applied;      /* VPU_API_ENC_SETCFG done */
+        int64_t coalesced;    /* replaced by a later call before applied */
+        int64_t failed;
+        int64_t appliedFrame; /* input frame the last config starts at, -1 if none */
+        bool pending;         /* waiting for the next frame */
+    } ReconfigStats_t;
+
+    typedef enum HeaderMode {
+        HEADER_MODE_FIRST = 0,  /* parameter sets in front of the first packet only */
+        HEADER_MODE_EACH_KEY,   /* in front of every key frame, for receivers
+                                   joining in the middle of the stream */
+    } HeaderMode_t;
+
+    typedef struct KeyFrameStats {
+        int64_t requests;     /* requestKeyFrame calls */
+        int64_t forced;       /* VPU_API_ENC_SETIDRFRAME done */
+        int64_t keyFrames;    /* key packets out */
+        int64_t headerRepeats;/* key packets given the cached parameter sets again */
+        int64_t forcedFrame;  /* input frame of the last forced key, -1 if none */
+    } KeyFrameStats_t;
+
+    /* input picture in vpu memory, read by the encoder without copy */
+    typedef struct InputBuffer {
+        VPUMemLinear_t mem;   /* the picture goes to mem.vir_addr */
+        int32_t index;
+        bool acquired;        /* held by the caller */
+        bool queued;          /* held by the encoder */
+    } InputBuffer_t;
+
     VPU_RET prepare(EncCfgInfo *cfg);
 
     /*
@@ -70,20 +108,130 @@ public:
      */
     VPU_RET sendFrame(char *data, int32_t size, int64_t pts, int32_t flag);
 
+    /*
+     * take a free buffer of the pool set by EncCfgInfo.inputPoolNum, the
+     * caller writes one picture of the input format to buffer->mem and
+     * sends it with sendFrame(buffer), or gives it back by
+     * releaseInputBuffer. The buffer returns to the pool by itself once
+     * its packet is out of getOutStream.
+     * Note: VPU_EAGAIN is returned if all buffers are in use.
+     */
+    VPU_RET acquireInputBuffer(InputBuffer **buffer);
+    void releaseInputBuffer(InputBuffer *buffer);
+
+    /*
+     * send a picture in an acquired input buffer, the encoder reads it by
+     * the buffer fd without copy.
+     */
+    VPU_RET sendFrame(InputBuffer *buffer, int64_t pts, int32_t flag);
+
     /*
      * get encoded video packet from encoder only, async interface
+     * Note: encOut->data is valid until the next getOutStream, take the
+     *       packet handle below to keep it longer without copy.
      */
     VPU_RET getOutStream(EncoderOut_t *encOut);
 
+    /*
+     * get encoded video packet, wait until a packet is ready or timeout.
+     * @timeoutMs: 0 - no wait, < 0 - wait forever
+     * Note: VPU_EAGAIN is returned if timeout.
+     */
+    VPU_RET getOutStream(EncoderOut_t *encOut, int32_t timeoutMs);
+
+    /*
+     * same as above, the packet is returned in a refcounted handle of the
+     * packet pool, h264 packets have the start code and the sps/pps of the
+     * first frame in front already. Several packets can be held at once,
+     * e.g. queued to a muxer, each one goes back to the pool when its last
+     * handle is released.
+     */
+    VPU_RET getOutStream(EncodedPacket *packet, int32_t timeoutMs);
+
+    /*
+     * occupancy of the packet pool, sized by EncCfgInfo.bitRate.
+     */
+    void getPacketPoolStats(RKPacketPool::PoolStats *stats);
+
+    /*
+     * change rate control and gop without restart. The config is kept and
+     * applied by VPU_API_ENC_SETCFG right before the next frame is sent,
+     * at most once per @minFrames of setReconfigInterval, calls in between
+     * replace the one pending. Can be called from any thread.
+     * Note: appliedFrame of the stats counts the frames sent before the
+     *       config took effect. Packets come out in the same order, so
+     *       the packet of that index is the first one in the new config.
+     */
+    VPU_RET reconfigure(const EncRateCfg *cfg);
+    void getRateCfg(EncRateCfg *cfg);
+    void setReconfigInterval(int32_t minFrames);
+    void getReconfigStats(ReconfigStats *stats);
+
+    /*
+     * make the next frame sent a key frame by VPU_API_ENC_SETIDRFRAME, the
+     * gop goes on from it. Calls before the next frame count once. Can be
+     * called from any thread.
+     */
+    VPU_RET requestKeyFrame();
+
+    /*
+     * where the parameter sets go. h264 sps/pps come from the extradata,
+     * h265 vps/sps/pps are taken from the key packets which carry them, so
+     * HEADER_MODE_EACH_KEY repeats the last ones seen. A key packet with
+     * its own parameter sets is left as is.
+     */
+    void setHeaderMode(HeaderMode mode);
+    void getKeyFrameStats(KeyFrameStats *stats);
+
+    /*
+     * wakeup statistics of the timeout getOutStream.
+     */
+    void getWaitStats(RKPollWaiter::WaitStats *stats);
+
 private:
+    VPU_RET queueFrame(EncInputStream_t *input, int32_t index);
+    void releaseSentBuffers(int32_t count);
+    VPU_RET getPacket(EncodedPacket *packet);
+    void applyRateCfg();
+    void applyKeyFrameRequest();
+    bool cacheHeaders(const uint8_t *data, int32_t size);
+
     VpuCodecContext *mVpuCtx;
-    unsigned char *mOutputBuf;
+    /* parameter sets with start codes, h264 sps/pps or h265 vps/sps/pps */
     unsigned char *mSpsPpsBuf;
     int32_t mSpsPpsLen;
+    HeaderMode mHeaderMode;
     OMX_RK_VIDEO_CODINGTYPE mCoding;
 
     int32_t mInitOK;
     int32_t mFrameCount;
+    int64_t mInputCount;    /* frames sent, eos excluded */
+    bool mInputEos;
+
+    /* params of the encoder, the rate config and key frame waiting for a frame */
+    EncParameter_t mEncParams;
+    pthread_mutex_t mCfgLock;
+    EncRateCfg mPendingCfg;
+    bool mCfgPending;
+    int32_t mReconfigInterval;
+    int64_t mLastCfgFrame;
+    ReconfigStats mReconfigStats;
+    bool mKeyPending;
+    KeyFrameStats mKeyStats;
+
+    /* input pool, pictures in the encoder are kept in send order */
+    InputBuffer *mInputBufs;
+    int32_t mInputNum;
+    int32_t mInputSize;     /* bytes of one picture */
+    int32_t mSent[ENC_SENT_MAX];    /* pool index, -1 if copied by vpu */
+    int32_t mSentHead;
+    int32_t mSentCount;
+
+    /* output packets, the last one is held for the EncoderOut_t interface */
+    RKPacketPool mPacketPool;
+    EncodedPacket mLastPacket;
+
+    RKPollWaiter mWaiter;
 };
 
 #endif  // __RKVPU_ENC_API_H__
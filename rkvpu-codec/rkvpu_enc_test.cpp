@@ -26,30 +26,45 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
 #include <getopt.h>
+#include <new>
+#include <utility>
 
 #include "rkvpu_enc_api.h"
+#include "rkvpu_async_writer.h"
 
 #define MAX_FILE_LEN  128
+#define OUTPUT_WAIT_MS  20
+
+/* packets queued to the output writer at most */
+#define OUTPUT_WRITE_DEPTH  16
 
 typedef struct {
-    struct timeval start;
-    struct timeval end;
+    int64_t startUs;
+    int64_t endUs;
 } DebugTimeInfo;
 
 static DebugTimeInfo time_info;
 
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static void time_start_record()
 {
-    gettimeofday(&time_info.start, NULL);
+    time_info.startUs = time_now_us();
 }
 
+/* elapsed us since time_start_record */
 static int64_t time_end_record()
 {
-    gettimeofday(&time_info.end, NULL);
-    return ((time_info.end.tv_sec  - time_info.start.tv_sec)  * 1000) +
-           ((time_info.end.tv_usec - time_info.start.tv_usec) / 1000);
+    time_info.endUs = time_now_us();
+    return time_info.endUs - time_info.startUs;
 }
 
 typedef struct EncTestCtx_t {
@@ -64,6 +79,12 @@ typedef struct EncTestCtx_t {
     int32_t format;
     int32_t bitRate;
     int32_t frameRate;
+    int32_t inputPoolNum;   /* read input into vpu memory, 0 - copied by vpu */
+    int32_t switchFrame;    /* frame to change bitrate at, -1 - never */
+    int32_t switchBitRate;
+    int32_t type;           /* 1 - h264, 2 - h265 */
+    int32_t keyFrame;       /* frame to request a key frame at, -1 - never */
+    bool repeatHeader;      /* parameter sets in front of every key frame */
 
     int32_t numBuffersEncoded;
 } EncTestCtx;
@@ -93,6 +114,18 @@ static void testUsage()
         "    the framerate of encoder, deault 30fps\n"
         "--b\n"
         "    the bitrate of encoder, default 3Mbps\n"
+        "--p\n"
+        "    read input into a pool of N vpu buffers, no copy in the encoder\n"
+        "--s\n"
+        "    N:BITRATE, switch to BITRATE from frame N without restart\n"
+        "--t\n"
+        "    output stream type(h264 default):\n"
+        "        1: h264\n"
+        "        2: h265\n"
+        "--k\n"
+        "    request a key frame at frame N\n"
+        "--r\n"
+        "    repeat the parameter sets in front of every key frame\n"
         "\n");
 }
 
@@ -104,6 +137,13 @@ VPU_RET testParseArgs(EncTestCtx *ctx, int argc, char **argv)
         { "output",             required_argument,  NULL, 'o' },
         { "width",              required_argument,  NULL, 'w' },
         { "height",             required_argument,  NULL, 'h' },
+        { "framerate",          required_argument,  NULL, 'f' },
+        { "bitrate",            required_argument,  NULL, 'b' },
+        { "pool",               required_argument,  NULL, 'p' },
+        { "switch",             required_argument,  NULL, 's' },
+        { "type",               required_argument,  NULL, 't' },
+        { "keyframe",           required_argument,  NULL, 'k' },
+        { "repeat",             no_argument,        NULL, 'r' },
         { NULL,                 0,                  NULL, 0 }
     };
 
@@ -111,6 +151,12 @@ VPU_RET testParseArgs(EncTestCtx *ctx, int argc, char **argv)
     ctx->height = 0;
     ctx->frameRate = 0;
     ctx->bitRate = 0;
+    ctx->inputPoolNum = 0;
+    ctx->switchFrame = -1;
+    ctx->switchBitRate = 0;
+    ctx->type = 1;
+    ctx->keyFrame = -1;
+    ctx->repeatHeader = false;
     ctx->hasOutput = false;
 
     bool hasInput = false;
@@ -145,6 +191,25 @@ VPU_RET testParseArgs(EncTestCtx *ctx, int argc, char **argv)
         case 'b':
             ctx->bitRate = atoi(optarg);
             break;
+        case 'p':
+            ctx->inputPoolNum = atoi(optarg);
+            break;
+        case 's':
+            if (sscanf(optarg, "%d:%d", &ctx->switchFrame, &ctx->switchBitRate) != 2 ||
+                ctx->switchFrame < 0 || ctx->switchBitRate <= 0) {
+                fprintf(stderr, "invalid switch %s, N:BITRATE\n", optarg);
+                return VPU_ERR_UNKNOW;
+            }
+            break;
+        case 't':
+            ctx->type = atoi(optarg);
+            break;
+        case 'k':
+            ctx->keyFrame = atoi(optarg);
+            break;
+        case 'r':
+            ctx->repeatHeader = true;
+            break;
         default:
             fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
             return VPU_ERR_UNKNOW;
@@ -177,17 +242,27 @@ VPU_RET testParseArgs(EncTestCtx *ctx, int argc, char **argv)
     return VPU_OK;
 }
 
+/* called on the writer thread, the packet goes back to the pool */
+static void releasePacket(void *opaque)
+{
+    delete (EncodedPacket *)opaque;
+}
+
 VPU_RET runEncoder(RKHWEncApi *encApi, EncTestCtx *encCtx)
 {
     VPU_RET ret = VPU_OK;
-    FILE *fpInput = NULL, *fpOutput = NULL;
+    FILE *fpInput = NULL;
+    RKAsyncWriter writer;
     char *pktBuf = NULL;
     int32_t pktsize;
+    RKHWEncApi::InputBuffer *inBuf = NULL;
+    bool poolEmpty = false;
 
     bool sawInputEOS = false, signalledInputEOS = false;
     // Indicates that the last buffer has delivered to vpu_encoder
     bool lastPktQueued = true;
-    int32_t readsize;
+    int32_t readsize = 0;
+    int32_t framesSent = 0;
 
     if (encCtx->format <= ENC_INPUT_YUV422_INTERLEAVED_UYVY) {
         pktsize = encCtx->width * encCtx->height * 3 / 2;
@@ -207,8 +282,7 @@ VPU_RET runEncoder(RKHWEncApi *encApi, EncTestCtx *encCtx)
     }
 
     if (encCtx->hasOutput) {
-        fpOutput = fopen(encCtx->fileOutput, "wb+");
-        if (fpOutput == NULL) {
+        if (writer.open(encCtx->fileOutput, OUTPUT_WRITE_DEPTH, false)) {
             fprintf(stderr, "failed to open output file %s\n", encCtx->fileOutput);
             ret = VPU_ERR_INIT;
             goto ENCODE_OUT;
@@ -217,46 +291,89 @@ VPU_RET runEncoder(RKHWEncApi *encApi, EncTestCtx *encCtx)
 
     while (true) {
         if (!sawInputEOS && lastPktQueued) {
-            readsize = fread(pktBuf, 1, pktsize, fpInput);
-            if (readsize != pktsize && feof(fpInput)) {
-                ALOGD("saw input eos");
-                sawInputEOS = true;
+            char *dst = pktBuf;
+
+            // read straight into vpu memory, wait for a packet if none free
+            if (encCtx->inputPoolNum > 0) {
+                poolEmpty = encApi->acquireInputBuffer(&inBuf) != VPU_OK;
+                dst = poolEmpty ? NULL : (char *)inBuf->mem.vir_addr;
+            }
+
+            if (dst != NULL) {
+                readsize = fread(dst, 1, pktsize, fpInput);
+                if (readsize != pktsize && feof(fpInput)) {
+                    ALOGD("saw input eos");
+                    sawInputEOS = true;
+                }
+                lastPktQueued = false;
             }
-            lastPktQueued = false;
         }
 
         if (!sawInputEOS) {
-            ret = encApi->sendFrame(pktBuf, readsize, 0, 0);
-            if (!ret) {
-                lastPktQueued = true;
-            } else {
-                /* reduce cpu overhead here */
-                usleep(1000);
+            if (!lastPktQueued) {
+                if (framesSent == encCtx->switchFrame) {
+                    RKHWEncApi::EncRateCfg rateCfg;
+
+                    // goes to the encoder right before this frame
+                    encApi->getRateCfg(&rateCfg);
+                    rateCfg.bitRate = encCtx->switchBitRate;
+                    encApi->reconfigure(&rateCfg);
+                    encCtx->switchFrame = -1;
+                }
+                if (framesSent == encCtx->keyFrame) {
+                    encApi->requestKeyFrame();
+                    encCtx->keyFrame = -1;
+                }
+
+                ret = (inBuf != NULL) ? encApi->sendFrame(inBuf, 0, 0)
+                                      : encApi->sendFrame(pktBuf, readsize, 0, 0);
+                if (!ret) {
+                    lastPktQueued = true;
+                    inBuf = NULL;
+                    framesSent++;
+                }
             }
         } else {
+            if (inBuf != NULL) {
+                // the tail is not a whole picture
+                encApi->releaseInputBuffer(inBuf);
+                inBuf = NULL;
+                readsize = 0;
+            }
+
             if (!signalledInputEOS) {
                 ret = encApi->sendFrame(pktBuf, readsize, 0, OMX_BUFFERFLAG_EOS);
                 if (ret == VPU_OK) {
                     lastPktQueued = true;
                     signalledInputEOS = true;
-                } else {
-                    usleep(1000);
                 }
             }
         }
 
-        EncoderOut_t encOut;
-        ret = encApi->getOutStream(&encOut);
+        /*
+         * don't wait while the input goes on, otherwise the input queue
+         * is full or all input sent, block until a packet is ready.
+         */
+        int32_t timeoutMs = (lastPktQueued && !signalledInputEOS && !poolEmpty) ?
+                            0 : OUTPUT_WAIT_MS;
+
+        EncodedPacket packet;
+        ret = encApi->getOutStream(&packet, timeoutMs);
         if (ret == VPU_OK) {
             ++encCtx->numBuffersEncoded;
 
             if (encCtx->hasOutput) {
-                fwrite(encOut.data, 1, encOut.size, fpOutput);
-                fflush(fpOutput);
+                // the writer thread holds the packet until it is written
+                uint8_t *data = packet.data();
+                int32_t size = packet.size();
+                EncodedPacket *ref = new (std::nothrow) EncodedPacket(std::move(packet));
+
+                if (ref == NULL || writer.queueBuffer(data, size, releasePacket, ref)) {
+                    fprintf(stderr, "failed to write output file\n");
+                    ret = VPU_ERR_UNKNOW;
+                    goto ENCODE_OUT;
+                }
             }
-        } else if (ret == VPU_EAGAIN) {
-            /* reduce cpu overhead here */
-            usleep(1000);
         } else if (ret == VPU_EOS_STREAM_REACHED) {
             ALOGD("saw output eos");
             break;
@@ -271,8 +388,17 @@ ENCODE_OUT:
     if (fpInput != NULL)
         fclose(fpInput);
 
-    if (fpOutput != NULL)
-        fclose(fpOutput);
+    if (encCtx->hasOutput) {
+        RKAsyncWriter::WriterStats stats;
+
+        if (writer.close() && ret == VPU_OK)
+            ret = VPU_ERR_UNKNOW;
+
+        writer.getStats(&stats);
+        printf("\n%lld bytes of stream written, queue max %d/%d, %lld stalls\n",
+               (long long)stats.bytes, stats.maxDepth, stats.capacity,
+               (long long)stats.stalls);
+    }
 
     return ret;
 }
@@ -296,7 +422,7 @@ int main(int argc, char **argv)
     /* setup RKHWEncApi::EncCfgInfo by encCtx */
     cfg.width = encCtx.width;
     cfg.height = encCtx.height;
-    cfg.coding = OMX_RK_VIDEO_CodingAVC;  // h264 default
+    cfg.coding = (encCtx.type == 2) ? OMX_RK_VIDEO_CodingHEVC : OMX_RK_VIDEO_CodingAVC;
     encCtx.format = ENC_INPUT_YUV420_SEMIPLANAR;
     cfg.format = encCtx.format;           // input format: yuv420p default
     cfg.framerate = encCtx.frameRate;
@@ -311,12 +437,15 @@ int main(int argc, char **argv)
      */
     cfg.rc_mode = ENC_RC_MODE_CBR;
     cfg.qp = 20;
+    cfg.inputPoolNum = encCtx.inputPoolNum;
 
     ret = encApi.prepare(&cfg);
     if (ret) {
         fprintf(stderr, "ERROR: encApi prapare failed(err=%d)", ret);
         return 1;
     }
+    if (encCtx.repeatHeader)
+        encApi.setHeaderMode(RKHWEncApi::HEADER_MODE_EACH_KEY);
 
     time_start_record();
 
@@ -327,8 +456,36 @@ int main(int argc, char **argv)
     } else {
         int64_t elapsedTimeUs = time_end_record();
         printf("\nenc_test done, %lld frames encoded in %lld ms, %.2f fps\n",
-               (long long)encCtx.numBuffersEncoded, elapsedTimeUs / 1000,
-               encCtx.numBuffersEncoded * 1E6 / elapsedTimeUs);
+               (long long)encCtx.numBuffersEncoded, (long long)(elapsedTimeUs / 1000),
+               (elapsedTimeUs > 0) ? encCtx.numBuffersEncoded * 1E6 / elapsedTimeUs : 0.0);
+
+        RKPollWaiter::WaitStats stats;
+        encApi.getWaitStats(&stats);
+        printf("output wait: %lld waits, %lld wakeups, %lld wasted, %lld timeouts\n",
+               (long long)stats.waits, (long long)stats.wakeups,
+               (long long)stats.wastedWakeups, (long long)stats.timeouts);
+
+        RKHWEncApi::ReconfigStats cfgStats;
+        encApi.getReconfigStats(&cfgStats);
+        if (cfgStats.requests > 0) {
+            printf("reconfig: %lld requests, %lld applied, last from frame %lld\n",
+                   (long long)cfgStats.requests, (long long)cfgStats.applied,
+                   (long long)cfgStats.appliedFrame);
+        }
+
+        RKHWEncApi::KeyFrameStats keyStats;
+        encApi.getKeyFrameStats(&keyStats);
+        printf("key frames: %lld out, %lld forced, %lld with parameter sets repeated\n",
+               (long long)keyStats.keyFrames, (long long)keyStats.forced,
+               (long long)keyStats.headerRepeats);
+
+        RKPacketPool::PoolStats poolStats;
+        encApi.getPacketPoolStats(&poolStats);
+        printf("packet pool: %d bytes, %lld packets, %lld on heap, %lld adopted, "
+               "peak %d bytes in flight\n",
+               poolStats.capacity, (long long)poolStats.packets,
+               (long long)poolStats.heapPackets, (long long)poolStats.adopted,
+               poolStats.peakBytes);
     }
 
     return 0;
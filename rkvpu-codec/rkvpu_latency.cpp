@@ -0,0 +1,221 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKLatencyTracker
+ * date  : 2021/03/30
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKLatencyTracker"
+#include <utils/Log.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "rkvpu_latency.h"
+
+static int64_t getNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * values under 16 have a bucket each, above that every power of two is
+ * split into 16 buckets by the 4 bits under the leading one.
+ */
+static int32_t bucketOf(int64_t us)
+{
+    int32_t shift, bucket;
+
+    if (us < LATENCY_SUB_BUCKETS)
+        return (us < 0) ? 0 : (int32_t)us;
+
+    shift = 63 - __builtin_clzll((uint64_t)us) - LATENCY_SUB_BITS;
+    bucket = (shift + 1) * LATENCY_SUB_BUCKETS + (int32_t)(us >> shift) - LATENCY_SUB_BUCKETS;
+
+    return (bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* the middle value of a bucket */
+static int64_t bucketValue(int32_t bucket)
+{
+    int32_t shift;
+    int64_t low;
+
+    if (bucket < LATENCY_SUB_BUCKETS)
+        return bucket;
+
+    shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    low = (int64_t)(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) << shift;
+
+    return low + ((1LL << shift) >> 1);
+}
+
+RKLatencyTracker::RKLatencyTracker()
+{
+    pthread_mutex_init(&mLock, NULL);
+    reset();
+}
+
+RKLatencyTracker::~RKLatencyTracker()
+{
+    pthread_mutex_destroy(&mLock);
+}
+
+void RKLatencyTracker::reset()
+{
+    pthread_mutex_lock(&mLock);
+    memset(mPending, 0, sizeof(mPending));
+    mPendingNum = 0;
+    mSendSeq = 0;
+    mMaxOutSeq = -1;
+    mNextPts = 1;
+    mFirstSendUs = 0;
+    memset(mHistogram, 0, sizeof(mHistogram));
+    mTotalUs = 0;
+    memset(&mStats, 0, sizeof(mStats));
+    pthread_mutex_unlock(&mLock);
+}
+
+int64_t RKLatencyTracker::nextPts()
+{
+    int64_t pts;
+
+    pthread_mutex_lock(&mLock);
+    pts = mNextPts++;
+    pthread_mutex_unlock(&mLock);
+
+    return pts;
+}
+
+void RKLatencyTracker::onSend(int64_t pts)
+{
+    int64_t nowUs = getNowUs();
+
+    pthread_mutex_lock(&mLock);
+
+    PendingPacket *pkt = &mPending[mSendSeq % LATENCY_PENDING_MAX];
+
+    if (mFirstSendUs == 0)
+        mFirstSendUs = nowUs;
+
+    // header only or broken packets never come out, overwrite them
+    if (pkt->valid) {
+        mStats.noOutput++;
+        mPendingNum--;
+    }
+
+    pkt->pts = pts;
+    pkt->sendUs = nowUs;
+    pkt->seq = mSendSeq++;
+    pkt->valid = true;
+    mPendingNum++;
+
+    pthread_mutex_unlock(&mLock);
+}
+
+void RKLatencyTracker::onOutput(int64_t pts)
+{
+    int64_t nowUs = getNowUs();
+    PendingPacket *match = NULL;
+
+    pthread_mutex_lock(&mLock);
+
+    // the oldest one if the pts is repeated
+    for (int32_t i = 0; i < LATENCY_PENDING_MAX; i++) {
+        PendingPacket *pkt = &mPending[i];
+
+        if (pkt->valid && pkt->pts == pts && (match == NULL || pkt->seq < match->seq))
+            match = pkt;
+    }
+
+    if (match == NULL) {
+        mStats.unmatched++;
+        pthread_mutex_unlock(&mLock);
+        ALOGV("output pts %lld not matched", (long long)pts);
+        return;
+    }
+
+    int64_t latencyUs = nowUs - match->sendUs;
+    int32_t reorder = (mMaxOutSeq > match->seq) ? (int32_t)(mMaxOutSeq - match->seq) : 0;
+
+    if (match->seq > mMaxOutSeq)
+        mMaxOutSeq = match->seq;
+    match->valid = false;
+    mPendingNum--;
+
+    if (mStats.frames == 0)
+        mStats.firstFrameUs = nowUs - mFirstSendUs;
+
+    mHistogram[bucketOf(latencyUs)]++;
+    mTotalUs += latencyUs;
+    mStats.frames++;
+    if (latencyUs > mStats.maxUs)
+        mStats.maxUs = latencyUs;
+    if (reorder > mStats.reorderMax)
+        mStats.reorderMax = reorder;
+
+    pthread_mutex_unlock(&mLock);
+
+    ALOGV("output pts %lld latency %lld us reorder %d",
+          (long long)pts, (long long)latencyUs, reorder);
+}
+
+void RKLatencyTracker::flush()
+{
+    pthread_mutex_lock(&mLock);
+    for (int32_t i = 0; i < LATENCY_PENDING_MAX; i++)
+        mPending[i].valid = false;
+    mPendingNum = 0;
+    mMaxOutSeq = mSendSeq - 1;
+    pthread_mutex_unlock(&mLock);
+}
+
+int64_t RKLatencyTracker::percentileLocked(int64_t total, int32_t percent)
+{
+    int64_t rank = (total * percent + 99) / 100;
+    int64_t count = 0;
+
+    for (int32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        count += mHistogram[i];
+        if (count >= rank) {
+            int64_t value = bucketValue(i);
+            return (value < mStats.maxUs) ? value : mStats.maxUs;
+        }
+    }
+
+    return mStats.maxUs;
+}
+
+void RKLatencyTracker::getStats(LatencyStats *stats)
+{
+    pthread_mutex_lock(&mLock);
+
+    *stats = mStats;
+    stats->pending = mPendingNum;
+
+    if (mStats.frames > 0) {
+        stats->avgUs = mTotalUs / mStats.frames;
+        stats->p50Us = percentileLocked(mStats.frames, 50);
+        stats->p95Us = percentileLocked(mStats.frames, 95);
+        stats->p99Us = percentileLocked(mStats.frames, 99);
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
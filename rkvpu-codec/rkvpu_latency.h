@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKLatencyTracker
+ * date  : 2021/03/30
+ */
+
+#ifndef __RKVPU_LATENCY_H__
+#define __RKVPU_LATENCY_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* packets sent and waiting for output at most, older ones are dropped */
+#define LATENCY_PENDING_MAX     256
+
+/* log-linear histogram, 16 buckets per power of two, < 6.25% error */
+#define LATENCY_SUB_BITS        4
+#define LATENCY_SUB_BUCKETS     (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS         (LATENCY_SUB_BUCKETS * 40)
+
+/*
+ * Decode latency of each frame, from the packet sent to the vpu until the
+ * frame with the same pts comes out.
+ *
+ * Every packet accepted by the vpu is recorded with its pts, a submission
+ * sequence and the monotonic time. The output frame carries the pts back
+ * in ShowTime, so it's matched to its packet and the latency goes into
+ * the histogram. Packets without pts get a synthetic one from nextPts().
+ *
+ * Reorder depth of a frame is how many packets sent after it came out
+ * before it, i.e. the decoded picture buffer delay in display order.
+ */
+class RKLatencyTracker
+{
+public:
+    RKLatencyTracker();
+    ~RKLatencyTracker();
+
+    typedef struct LatencyStats {
+        int64_t frames;         /* outputs matched to a packet */
+        int64_t unmatched;      /* outputs with unknown pts */
+        int64_t noOutput;       /* packets dropped from the pending table */
+        int32_t pending;        /* packets sent, no output yet */
+        int32_t reorderMax;     /* deepest reorder seen */
+        int64_t firstFrameUs;   /* first packet sent to first frame out */
+        int64_t avgUs;
+        int64_t p50Us;
+        int64_t p95Us;
+        int64_t p99Us;
+        int64_t maxUs;
+    } LatencyStats_t;
+
+    /* the pts for a packet sent without one, never 0 or negative */
+    int64_t nextPts();
+
+    /* the packet with @pts is accepted by the vpu */
+    void onSend(int64_t pts);
+
+    /* a frame with @pts comes out of the vpu */
+    void onOutput(int64_t pts);
+
+    /* forget the pending packets, stats are kept */
+    void flush();
+
+    void getStats(LatencyStats *stats);
+
+    /* clear pending packets and stats */
+    void reset();
+
+private:
+    typedef struct PendingPacket {
+        int64_t pts;
+        int64_t sendUs;
+        int64_t seq;
+        bool valid;
+    } PendingPacket;
+
+    int64_t percentileLocked(int64_t total, int32_t percent);
+
+    pthread_mutex_t mLock;
+
+    PendingPacket mPending[LATENCY_PENDING_MAX];
+    int32_t mPendingNum;
+    int64_t mSendSeq;       /* of the next packet */
+    int64_t mMaxOutSeq;     /* largest seq came out */
+    int64_t mNextPts;
+    int64_t mFirstSendUs;   /* 0 if nothing sent */
+
+    int64_t mHistogram[LATENCY_BUCKETS];
+    int64_t mTotalUs;
+    LatencyStats mStats;
+};
+
+#endif  // __RKVPU_LATENCY_H__
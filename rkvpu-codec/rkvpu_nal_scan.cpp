@@ -0,0 +1,264 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: nal_scan
+ * date  : 2021/03/05
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "nal_scan"
+#include <utils/Log.h>
+
+#include <pthread.h>
+#include <atomic>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define NAL_SCAN_X86
+#endif
+
+#if defined(__arm__) && defined(NAL_SCAN_NEON)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON  (1 << 12)
+#endif
+#endif
+
+#include "rkvpu_nal_scan.h"
+
+typedef const uint8_t *(*NalFindFunc)(const uint8_t *buf, const uint8_t *end);
+
+#ifdef NAL_SCAN_NEON
+/* rkvpu_nal_scan_neon.cpp, built with neon enabled */
+extern const uint8_t *nal_scan_find_neon(const uint8_t *buf, const uint8_t *end);
+#endif
+
+/* set once by initKernel, may be switched by nal_scan_set_kernel while scanning */
+static pthread_once_t sKernelOnce = PTHREAD_ONCE_INIT;
+static std::atomic<NalFindFunc> sFindFunc(NULL);
+static std::atomic<NalScanKernel> sKernel(NAL_SCAN_KERNEL_SCALAR);
+
+static const uint8_t *findScalar(const uint8_t *p, const uint8_t *end)
+{
+    while (end - p >= 3) {
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[2] == 1) {
+            if (p[1] == 0 && p[0] == 0)
+                return p;
+            p += 3;
+        } else {
+            p++;
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef NAL_SCAN_X86
+/*
+ * positions i with buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1 are
+ * found by three unaligned loads, each loop covers 16(32) positions.
+ */
+__attribute__((target("sse2")))
+static const uint8_t *findSse2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    while (end - p >= 16 + 2) {
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), one);
+        if (_mm_movemask_epi8(c)) {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero);
+            int32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    return findScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *findAvx2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+
+    while (end - p >= 32 + 2) {
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), one);
+        if (_mm256_movemask_epi8(c)) {
+            __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+            __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), zero);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                                _mm256_and_si256(_mm256_and_si256(a, b), c));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+
+    return findScalar(p, end);
+}
+#endif
+
+static NalFindFunc kernelFunc(NalScanKernel kernel)
+{
+    switch (kernel) {
+    case NAL_SCAN_KERNEL_SCALAR:
+        return findScalar;
+#ifdef NAL_SCAN_X86
+    case NAL_SCAN_KERNEL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? findSse2 : NULL;
+    case NAL_SCAN_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? findAvx2 : NULL;
+#endif
+#ifdef NAL_SCAN_NEON
+    case NAL_SCAN_KERNEL_NEON:
+#if defined(__arm__)
+        return (getauxval(AT_HWCAP) & HWCAP_NEON) ? nal_scan_find_neon : NULL;
+#else
+        return nal_scan_find_neon;
+#endif
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static void initKernel()
+{
+    static const NalScanKernel order[] = {
+        NAL_SCAN_KERNEL_NEON,
+        NAL_SCAN_KERNEL_AVX2,
+        NAL_SCAN_KERNEL_SSE2,
+        NAL_SCAN_KERNEL_SCALAR,
+    };
+
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        NalFindFunc func = kernelFunc(order[i]);
+        if (func != NULL) {
+            sKernel.store(order[i], std::memory_order_relaxed);
+            sFindFunc.store(func, std::memory_order_release);
+            break;
+        }
+    }
+
+    ALOGD("nal scan kernel %s", nal_scan_kernel_name(sKernel.load()));
+}
+
+const uint8_t *nal_scan_find(const uint8_t *buf, const uint8_t *end)
+{
+    NalFindFunc func = sFindFunc.load(std::memory_order_acquire);
+
+    if (func == NULL) {
+        pthread_once(&sKernelOnce, initKernel);
+        func = sFindFunc.load(std::memory_order_acquire);
+    }
+
+    return func(buf, end);
+}
+
+int32_t nal_scan_units(const uint8_t *buf, size_t size,
+                       OMX_RK_VIDEO_CODINGTYPE coding,
+                       NalUnitInfo *units, int32_t max)
+{
+    const uint8_t *end = buf + size;
+    const uint8_t *sc;
+    int32_t num = 0;
+
+    if (buf == NULL || units == NULL || max <= 0)
+        return 0;
+
+    sc = nal_scan_find(buf, end);
+    while (sc != NULL && num < max) {
+        NalUnitInfo *unit = &units[num];
+        const uint8_t *hdr = sc + 3;
+
+        // zero_byte of the four bytes start code
+        if (sc > buf && sc[-1] == 0 &&
+            (num == 0 || sc - 1 > buf + units[num - 1].offset + units[num - 1].scLen)) {
+            unit->offset = sc - 1 - buf;
+            unit->scLen = 4;
+        } else {
+            unit->offset = sc - buf;
+            unit->scLen = 3;
+        }
+
+        if (hdr >= end) {
+            unit->type = -1;
+        } else if (coding == OMX_RK_VIDEO_CodingHEVC) {
+            unit->type = (hdr[0] >> 1) & 0x3f;
+        } else {
+            unit->type = hdr[0] & 0x1f;
+        }
+
+        if (num > 0)
+            units[num - 1].size = unit->offset - units[num - 1].offset;
+
+        num++;
+        sc = nal_scan_find(hdr, end);
+    }
+
+    if (num > 0)
+        units[num - 1].size = size - units[num - 1].offset;
+
+    return num;
+}
+
+int32_t nal_scan_set_kernel(NalScanKernel kernel)
+{
+    NalFindFunc func;
+
+    pthread_once(&sKernelOnce, initKernel);
+
+    if (kernel == NAL_SCAN_KERNEL_AUTO) {
+        initKernel();
+        return 1;
+    }
+
+    func = kernelFunc(kernel);
+    if (func == NULL)
+        return 0;
+
+    sKernel.store(kernel, std::memory_order_relaxed);
+    sFindFunc.store(func, std::memory_order_release);
+
+    return 1;
+}
+
+NalScanKernel nal_scan_get_kernel()
+{
+    pthread_once(&sKernelOnce, initKernel);
+
+    return sKernel.load();
+}
+
+const char *nal_scan_kernel_name(NalScanKernel kernel)
+{
+    switch (kernel) {
+    case NAL_SCAN_KERNEL_AUTO:      return "auto";
+    case NAL_SCAN_KERNEL_SCALAR:    return "scalar";
+    case NAL_SCAN_KERNEL_SSE2:      return "sse2";
+    case NAL_SCAN_KERNEL_AVX2:      return "avx2";
+    case NAL_SCAN_KERNEL_NEON:      return "neon";
+    default:                        return "unknown";
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: nal_scan
+ * date  : 2021/03/05
+ */
+
+#ifndef __RKVPU_NAL_SCAN_H__
+#define __RKVPU_NAL_SCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vpu_api.h"
+
+/*
+ * Start code(00 00 01 / 00 00 00 01) scanner shared by all raw stream
+ * paths. The kernel is chosen at runtime by cpu features, NEON on arm,
+ * AVX2 or SSE2 on x86, byte scan on others.
+ */
+typedef enum NalScanKernel {
+    NAL_SCAN_KERNEL_AUTO,
+    NAL_SCAN_KERNEL_SCALAR,
+    NAL_SCAN_KERNEL_SSE2,
+    NAL_SCAN_KERNEL_AVX2,
+    NAL_SCAN_KERNEL_NEON,
+    NAL_SCAN_KERNEL_BUTT,
+} NalScanKernel;
+
+typedef struct NalUnitInfo {
+    size_t offset;      /* start code position, zero_byte included */
+    size_t size;        /* up to the next start code or the buffer end */
+    int32_t scLen;      /* 3 or 4 */
+    int32_t type;       /* nal_unit_type, -1 if header out of buffer */
+} NalUnitInfo;
+
+/*
+ * Find the first 00 00 01 in [buf, end), return the position of the
+ * first zero byte, or NULL if not found.
+ */
+const uint8_t *nal_scan_find(const uint8_t *buf, const uint8_t *end);
+
+/*
+ * Batch scan nal units in buffer, return the number of units filled.
+ * If the result equals @max, continue from units[max - 1].offset to get
+ * the rest, the last unit is always extended to the buffer end.
+ */
+int32_t nal_scan_units(const uint8_t *buf, size_t size,
+                       OMX_RK_VIDEO_CODINGTYPE coding,
+                       NalUnitInfo *units, int32_t max);
+
+/*
+ * Force a specific kernel, used by benchmark and verification.
+ * Return 0 if the kernel is not supported by the cpu.
+ */
+int32_t nal_scan_set_kernel(NalScanKernel kernel);
+NalScanKernel nal_scan_get_kernel();
+const char *nal_scan_kernel_name(NalScanKernel kernel);
+
+#endif  // __RKVPU_NAL_SCAN_H__
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: rkvpu_nal_scan_bench sample code
+ * date  : 2021/03/05
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rkvpu_nal_scan_bench"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "rkvpu_nal_scan.h"
+
+#define MAX_FILE_LEN        128
+#define SCAN_BATCH_SIZE     256
+
+typedef struct ScanBenchCtx_t {
+    char fileInput[MAX_FILE_LEN];
+    bool hasInput;
+    OMX_RK_VIDEO_CODINGTYPE videoCoding;
+
+    int64_t totalBytes;     /* bytes scanned for each kernel */
+    int32_t bufferSize;     /* synthetic stream or file window size */
+} ScanBenchCtx;
+
+static int64_t time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Dumps usage on stderr.
+ */
+static void testUsage()
+{
+    fprintf(stderr,
+        "\nUsage: rkvpu_nal_scan_bench [options] \n"
+        "Start code scanner benchmark.\n"
+        "  - rkvpu_nal_scan_bench --s 4\n"
+        "  - rkvpu_nal_scan_bench --i input.h264 --s 4\n"
+        "\n"
+        "Options:\n"
+        "--u\n"
+        "    Show this message.\n"
+        "--i\n"
+        "    input bitstream file, synthetic stream if not specified\n"
+        "--s\n"
+        "    total GB scanned by each kernel, default 4\n"
+        "--m\n"
+        "    buffer size in MB, default 64\n"
+        "--t\n"
+        "    input pictrue type(h264 default):\n"
+        "        1: h264\n"
+        "        2: h265\n"
+        "\n");
+}
+
+static int32_t testParseArgs(ScanBenchCtx *ctx, int argc, char **argv)
+{
+    static const struct option longOptions[] = {
+        { "usage",              no_argument,        NULL, 'u' },
+        { "input",              required_argument,  NULL, 'i' },
+        { "size",               required_argument,  NULL, 's' },
+        { "mem",                required_argument,  NULL, 'm' },
+        { "type",               required_argument,  NULL, 't' },
+        { NULL,                 0,                  NULL, 0 }
+    };
+
+    ctx->hasInput = false;
+    ctx->videoCoding = OMX_RK_VIDEO_CodingAVC;
+    ctx->totalBytes = 4LL << 30;
+    ctx->bufferSize = 64 << 20;
+
+    while (true) {
+        int optionIndex = 0;
+        int ic = getopt_long(argc, argv, "", longOptions, &optionIndex);
+        if (ic == -1) {
+            break;
+        }
+
+        switch (ic) {
+        case 'u':
+            return -1;
+        case 'i':
+            strcpy(ctx->fileInput, optarg);
+            ctx->hasInput = true;
+            break;
+        case 's':
+            ctx->totalBytes = (int64_t)atoi(optarg) << 30;
+            break;
+        case 'm':
+            ctx->bufferSize = atoi(optarg) << 20;
+            break;
+        case 't':
+            if (atoi(optarg) == 2) {
+                ctx->videoCoding = OMX_RK_VIDEO_CodingHEVC;
+            } else {
+                ctx->videoCoding = OMX_RK_VIDEO_CodingAVC;
+            }
+            break;
+        default:
+            fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
+            return -1;
+        }
+    }
+
+    if (ctx->totalBytes <= 0 || ctx->bufferSize <= 0) {
+        fprintf(stderr, "ERROR: invalid scan size\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Random payload with 1080p slice like nal sizes, the emulation prevention
+ * is kept so that only the inserted start codes are found.
+ */
+static int32_t genSyntheticStream(uint8_t *buf, int32_t size)
+{
+    int32_t pos = 0, nals = 0;
+    uint32_t seed = 0x12345678;
+
+    while (pos + 4 < size) {
+        int32_t nalSize;
+
+        seed = seed * 1103515245 + 12345;
+        nalSize = 64 + (seed >> 8) % (128 * 1024);
+
+        memcpy(buf + pos, "\x00\x00\x00\x01", 4);
+        pos += 4;
+        nals++;
+
+        for (int32_t i = 0; i < nalSize && pos < size; i++, pos++) {
+            seed = seed * 1103515245 + 12345;
+            uint8_t val = (seed >> 24) & 0xff;
+            // zero runs are common in real slices
+            if ((seed & 0x70) == 0)
+                val = 0;
+            if (pos >= 2 && buf[pos - 1] == 0 && buf[pos - 2] == 0 && val <= 3)
+                val = 3;
+            buf[pos] = val;
+        }
+    }
+
+    return nals;
+}
+
+static int32_t loadFile(const char *file, uint8_t *buf, int32_t size)
+{
+    FILE *fp = fopen(file, "rb");
+    int32_t readsize;
+
+    if (fp == NULL) {
+        fprintf(stderr, "failed to open input file %s\n", file);
+        return -1;
+    }
+
+    readsize = fread(buf, 1, size, fp);
+    fclose(fp);
+
+    return readsize;
+}
+
+static int64_t scanBuffer(const uint8_t *buf, int32_t size,
+                          OMX_RK_VIDEO_CODINGTYPE coding, NalUnitInfo *units)
+{
+    int64_t count = 0;
+    size_t pos = 0;
+
+    while (true) {
+        int32_t num = nal_scan_units(buf + pos, size - pos, coding,
+                                     units, SCAN_BATCH_SIZE);
+        if (num < SCAN_BATCH_SIZE) {
+            count += num;
+            break;
+        }
+        // the last one is rescanned as the head of next batch
+        count += num - 1;
+        pos += units[num - 1].offset;
+    }
+
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    ScanBenchCtx ctx;
+    uint8_t *buf = NULL;
+    NalUnitInfo *units = NULL;
+    int32_t size;
+    int64_t refCount = -1;
+    int32_t ret = 0;
+
+    if (argc > 0)
+        ret = testParseArgs(&ctx, argc, argv);
+
+    if (ret != 0) {
+        testUsage();
+        return 1;
+    }
+
+    buf = (uint8_t *)malloc(ctx.bufferSize);
+    units = (NalUnitInfo *)malloc(sizeof(NalUnitInfo) * SCAN_BATCH_SIZE);
+    if (buf == NULL || units == NULL) {
+        fprintf(stderr, "ERROR: failed to malloc %d bytes\n", ctx.bufferSize);
+        ret = -1;
+        goto BENCH_OUT;
+    }
+
+    if (ctx.hasInput) {
+        size = loadFile(ctx.fileInput, buf, ctx.bufferSize);
+        if (size <= 0) {
+            ret = -1;
+            goto BENCH_OUT;
+        }
+    } else {
+        size = ctx.bufferSize;
+        genSyntheticStream(buf, size);
+    }
+
+    printf("\nscan %.2f GB over %.2f MB %s stream for each kernel\n",
+           ctx.totalBytes / 1E9, size / 1E6, ctx.hasInput ? "file" : "synthetic");
+
+    for (int32_t k = NAL_SCAN_KERNEL_SCALAR; k < NAL_SCAN_KERNEL_BUTT; k++) {
+        NalScanKernel kernel = (NalScanKernel)k;
+        int64_t scanned = 0, count = 0, passCount = 0;
+        int64_t startUs, elapsedUs;
+
+        if (!nal_scan_set_kernel(kernel)) {
+            printf("  %-8s: not supported\n", nal_scan_kernel_name(kernel));
+            continue;
+        }
+
+        startUs = time_now_us();
+        while (scanned < ctx.totalBytes) {
+            passCount = scanBuffer(buf, size, ctx.videoCoding, units);
+            count += passCount;
+            scanned += size;
+        }
+        elapsedUs = time_now_us() - startUs;
+
+        if (refCount < 0) {
+            refCount = passCount;
+        } else if (refCount != passCount) {
+            fprintf(stderr, "ERROR: kernel %s found %lld nals, expect %lld\n",
+                    nal_scan_kernel_name(kernel), (long long)passCount,
+                    (long long)refCount);
+            ret = -1;
+        }
+
+        printf("  %-8s: %8.3f GB/s, %lld nals in %lld ms\n",
+               nal_scan_kernel_name(kernel), scanned / 1E3 / elapsedUs,
+               (long long)count, (long long)elapsedUs / 1000);
+    }
+
+    nal_scan_set_kernel(NAL_SCAN_KERNEL_AUTO);
+    printf("runtime selected kernel: %s\n",
+           nal_scan_kernel_name(nal_scan_get_kernel()));
+
+BENCH_OUT:
+    free(buf);
+    free(units);
+
+    return (ret == 0) ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: nal_scan neon kernel
+ * date  : 2021/03/05
+ */
+
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+/*
+ * Built as a separate file so that only this kernel needs neon enabled
+ * on armv7, nal_scan_find dispatches here after checking the hwcap.
+ */
+const uint8_t *nal_scan_find_neon(const uint8_t *p, const uint8_t *end)
+{
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    while (end - p >= 16 + 2) {
+        uint8x16_t c = vceqq_u8(vld1q_u8(p + 2), one);
+        uint64x2_t m = vreinterpretq_u64_u8(c);
+
+        if (vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)) {
+            uint8x16_t a = vceqq_u8(vld1q_u8(p), zero);
+            uint8x16_t b = vceqq_u8(vld1q_u8(p + 1), zero);
+            m = vreinterpretq_u64_u8(vandq_u8(vandq_u8(a, b), c));
+
+            uint64_t lo = vgetq_lane_u64(m, 0);
+            uint64_t hi = vgetq_lane_u64(m, 1);
+            if (lo)
+                return p + (__builtin_ctzll(lo) >> 3);
+            if (hi)
+                return p + 8 + (__builtin_ctzll(hi) >> 3);
+        }
+        p += 16;
+    }
+
+    for (; end - p >= 3; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,439 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKPacketPool
+ * date  : 2021/04/04
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKPacketPool"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "rkvpu_packet_pool.h"
+
+/* slots start on a cache line */
+#define PACKET_ALIGN            64
+#define PACKET_ALIGN_UP(x, a)   (((x) + (a) - 1) / (a) * (a))
+
+EncodedPacket::EncodedPacket()
+    : mRef(NULL)
+{
+}
+
+EncodedPacket::~EncodedPacket()
+{
+    reset();
+}
+
+EncodedPacket::EncodedPacket(EncodedPacket &&other)
+    : mRef(other.mRef)
+{
+    other.mRef = NULL;
+}
+
+EncodedPacket &EncodedPacket::operator=(EncodedPacket &&other)
+{
+    if (this != &other) {
+        reset();
+        mRef = other.mRef;
+        other.mRef = NULL;
+    }
+
+    return *this;
+}
+
+EncodedPacket EncodedPacket::share() const
+{
+    EncodedPacket packet;
+
+    if (mRef != NULL) {
+        mRef->refs.fetch_add(1, std::memory_order_relaxed);
+        packet.mRef = mRef;
+    }
+
+    return packet;
+}
+
+void EncodedPacket::reset()
+{
+    if (mRef == NULL)
+        return;
+
+    // the last reference gives the space back to the pool
+    if (mRef->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        mRef->owner->release(mRef);
+    mRef = NULL;
+}
+
+int32_t EncodedPacket::prepend(const void *data, int32_t size)
+{
+    if (mRef == NULL || size > mRef->headroom)
+        return -1;
+
+    mRef->data -= size;
+    mRef->size += size;
+    mRef->headroom -= size;
+    memcpy(mRef->data, data, size);
+
+    return 0;
+}
+
+void EncodedPacket::setInfo(int64_t pts, int32_t keyFrame)
+{
+    if (mRef != NULL) {
+        mRef->pts = pts;
+        mRef->keyFrame = keyFrame;
+    }
+}
+
+RKPacketPool::RKPacketPool()
+{
+    pthread_mutex_init(&mLock, NULL);
+
+    mBuf = NULL;
+    mCapacity = 0;
+    mWanted = 0;
+    mHead = 0;
+    mTail = 0;
+    mWrap = 0;
+    mWrapped = false;
+    mSlots = 0;
+    mRetired = NULL;
+    mRetiredSize = 0;
+    mRetiredSlots = 0;
+
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+RKPacketPool::~RKPacketPool()
+{
+    if (mStats.inFlight > 0)
+        ALOGW("%d packets not released", mStats.inFlight);
+
+    free(mBuf);
+    mBuf = NULL;
+    free(mRetired);
+    mRetired = NULL;
+
+    pthread_mutex_destroy(&mLock);
+}
+
+int32_t RKPacketPool::sizeFor(int32_t bitRate, int32_t frameSize)
+{
+    int64_t size = (bitRate > 0) ? bitRate / 8 : frameSize;
+
+    if (size < PACKET_POOL_MIN_SIZE)
+        size = PACKET_POOL_MIN_SIZE;
+    if (size > PACKET_POOL_MAX_SIZE)
+        size = PACKET_POOL_MAX_SIZE;
+
+    return PACKET_ALIGN_UP((int32_t)size, 4096);
+}
+
+int32_t RKPacketPool::init(int32_t capacity)
+{
+    void *buf = NULL;
+
+    capacity = PACKET_ALIGN_UP(capacity, PACKET_ALIGN);
+    if (capacity <= 0 || posix_memalign(&buf, PACKET_ALIGN, capacity)) {
+        ALOGE("failed to malloc packet ring, size %d", capacity);
+        return -1;
+    }
+
+    pthread_mutex_lock(&mLock);
+    free(mBuf);
+    mBuf = (uint8_t *)buf;
+    mCapacity = capacity;
+    mWanted = capacity;
+    mHead = 0;
+    mTail = 0;
+    mWrapped = false;
+    mSlots = 0;
+    mStats.capacity = capacity;
+    pthread_mutex_unlock(&mLock);
+
+    ALOGD("packet ring %d bytes", capacity);
+
+    return 0;
+}
+
+void RKPacketPool::resize(int32_t capacity)
+{
+    pthread_mutex_lock(&mLock);
+    mWanted = PACKET_ALIGN_UP(capacity, PACKET_ALIGN);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * called with lock, slots in the ring not released yet. The ones released
+ * behind an older packet still held are in mSlots until reclaimed.
+ */
+int32_t RKPacketPool::pendingSlots()
+{
+    int32_t pos = mHead;
+    int32_t pending = 0;
+
+    for (int32_t i = 0; i < mSlots; i++) {
+        EncodedPacket::PacketRef *ref = (EncodedPacket::PacketRef *)(mBuf + pos);
+
+        if (!ref->done)
+            pending++;
+        pos += ref->slotSize;
+        if (mWrapped && pos == mWrap)
+            pos = 0;
+    }
+
+    return pending;
+}
+
+/*
+ * called with lock, new packets go to a ring of mWanted bytes. The slots
+ * left in the old ring are released one by one and never reclaimed, only
+ * counted, and one old ring is kept at most.
+ */
+void RKPacketPool::switchRing()
+{
+    void *buf = NULL;
+    int32_t pending = pendingSlots();
+
+    if (pending > 0 && mRetired != NULL)
+        return;
+
+    if (posix_memalign(&buf, PACKET_ALIGN, mWanted)) {
+        ALOGE("failed to malloc packet ring, size %d", mWanted);
+        mWanted = mCapacity;
+        return;
+    }
+
+    ALOGD("packet ring resize %d -> %d bytes, %d packets in flight",
+          mCapacity, mWanted, pending);
+
+    if (pending > 0) {
+        mRetired = mBuf;
+        mRetiredSize = mCapacity;
+        mRetiredSlots = pending;
+    } else {
+        free(mBuf);
+    }
+
+    mBuf = (uint8_t *)buf;
+    mCapacity = mWanted;
+    mHead = 0;
+    mTail = 0;
+    mWrapped = false;
+    mSlots = 0;
+    mStats.capacity = mWanted;
+    mStats.resizes++;
+}
+
+/* called with lock, NULL if no room */
+EncodedPacket::PacketRef *RKPacketPool::allocSlot(int32_t slotSize)
+{
+    int32_t offset;
+
+    if (!mWrapped) {
+        if (mCapacity - mTail >= slotSize) {
+            offset = mTail;
+        } else if (mHead >= slotSize) {
+            // the end is too short, go on from the start
+            mWrap = mTail;
+            mWrapped = true;
+            offset = 0;
+        } else {
+            return NULL;
+        }
+    } else if (mHead - mTail >= slotSize) {
+        offset = mTail;
+    } else {
+        return NULL;
+    }
+
+    mTail = offset + slotSize;
+    mSlots++;
+
+    return (EncodedPacket::PacketRef *)(mBuf + offset);
+}
+
+/* called with lock, the released slots at the head are free again */
+void RKPacketPool::reclaim()
+{
+    while (mSlots > 0) {
+        EncodedPacket::PacketRef *ref = (EncodedPacket::PacketRef *)(mBuf + mHead);
+
+        if (!ref->done)
+            break;
+
+        mHead += ref->slotSize;
+        mSlots--;
+        if (mWrapped && mHead == mWrap) {
+            mHead = 0;
+            mWrapped = false;
+        }
+    }
+
+    if (mSlots == 0) {
+        mHead = 0;
+        mTail = 0;
+        mWrapped = false;
+    }
+}
+
+int32_t RKPacketPool::alloc(EncodedPacket *packet, int32_t size, int32_t headroom)
+{
+    int32_t bytes = sizeof(EncodedPacket::PacketRef) + headroom + size;
+    int32_t slotSize = PACKET_ALIGN_UP(bytes, PACKET_ALIGN);
+    EncodedPacket::PacketRef *ref = NULL;
+    void *mem;
+
+    pthread_mutex_lock(&mLock);
+
+    if (mWanted != mCapacity)
+        switchRing();
+
+    // a packet over half of the ring would stall the ones after it
+    if (mBuf != NULL && slotSize <= mCapacity / 2)
+        mem = allocSlot(slotSize);
+    else
+        mem = NULL;
+
+    mStats.packets++;
+    mStats.inFlight++;
+    mStats.inFlightBytes += headroom + size;
+    if (mStats.peakBytes < mStats.inFlightBytes)
+        mStats.peakBytes = mStats.inFlightBytes;
+
+    if (mem == NULL) {
+        // the next packets go to a ring of twice the peak in flight
+        int64_t wanted = PACKET_ALIGN_UP((int64_t)mStats.peakBytes * 2, 4096);
+
+        if (wanted > PACKET_POOL_MAX_SIZE)
+            wanted = PACKET_POOL_MAX_SIZE;
+        if (wanted > mWanted)
+            mWanted = (int32_t)wanted;
+
+        mStats.heapPackets++;
+        slotSize = 0;
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    if (mem == NULL) {
+        mem = malloc(bytes);
+        if (mem == NULL) {
+            ALOGE("failed to malloc packet, size %d", size);
+            pthread_mutex_lock(&mLock);
+            mStats.inFlight--;
+            mStats.inFlightBytes -= headroom + size;
+            pthread_mutex_unlock(&mLock);
+            return -1;
+        }
+    }
+
+    ref = new (mem) EncodedPacket::PacketRef;
+    ref->data = (uint8_t *)mem + sizeof(EncodedPacket::PacketRef) + headroom;
+    ref->size = size;
+    ref->headroom = headroom;
+    ref->pts = 0;
+    ref->keyFrame = 0;
+    ref->refs.store(1, std::memory_order_relaxed);
+    ref->owner = this;
+    ref->slotSize = slotSize;
+    ref->done = false;
+    ref->adopted = NULL;
+
+    packet->reset();
+    packet->mRef = ref;
+
+    return 0;
+}
+
+int32_t RKPacketPool::adopt(EncodedPacket *packet, uint8_t *data, int32_t size)
+{
+    EncodedPacket::PacketRef *ref;
+    void *mem = malloc(sizeof(EncodedPacket::PacketRef));
+
+    if (mem == NULL) {
+        ALOGE("failed to malloc packet handle");
+        return -1;
+    }
+
+    ref = new (mem) EncodedPacket::PacketRef;
+    ref->data = data;
+    ref->size = size;
+    ref->headroom = 0;
+    ref->pts = 0;
+    ref->keyFrame = 0;
+    ref->refs.store(1, std::memory_order_relaxed);
+    ref->owner = this;
+    ref->slotSize = 0;
+    ref->done = false;
+    ref->adopted = data;
+
+    pthread_mutex_lock(&mLock);
+    mStats.packets++;
+    mStats.adopted++;
+    mStats.inFlight++;
+    mStats.inFlightBytes += size;
+    if (mStats.peakBytes < mStats.inFlightBytes)
+        mStats.peakBytes = mStats.inFlightBytes;
+    pthread_mutex_unlock(&mLock);
+
+    packet->reset();
+    packet->mRef = ref;
+
+    return 0;
+}
+
+void RKPacketPool::release(EncodedPacket::PacketRef *ref)
+{
+    uint8_t *slot = (uint8_t *)ref;
+    uint8_t *retired = NULL;
+    bool inRing = ref->slotSize > 0;
+
+    pthread_mutex_lock(&mLock);
+    mStats.inFlight--;
+    mStats.inFlightBytes -= ref->headroom + ref->size;
+    if (inRing && mRetired != NULL &&
+        slot >= mRetired && slot < mRetired + mRetiredSize) {
+        // the last packet of the old ring frees it
+        if (--mRetiredSlots == 0) {
+            retired = mRetired;
+            mRetired = NULL;
+        }
+    } else if (inRing) {
+        ref->done = true;
+        reclaim();
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (!inRing) {
+        free(ref->adopted);
+        free(ref);
+    }
+    free(retired);
+}
+
+void RKPacketPool::getStats(PoolStats *stats)
+{
+    pthread_mutex_lock(&mLock);
+    *stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
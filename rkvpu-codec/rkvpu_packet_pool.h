@@ -0,0 +1,178 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKPacketPool
+ * date  : 2021/04/04
+ */
+
+#ifndef __RKVPU_PACKET_POOL_H__
+#define __RKVPU_PACKET_POOL_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+/* ring bytes, see RKPacketPool::sizeFor */
+#define PACKET_POOL_MIN_SIZE    (64 * 1024)
+#define PACKET_POOL_MAX_SIZE    (32 * 1024 * 1024)
+
+class RKPacketPool;
+
+/*
+ * Handle of an encoded packet, owns one reference of the packet.
+ *
+ * Same rules as DecodedFrame: move-only, share() gives another handle of
+ * the same data without copy, and the space goes back to the pool when the
+ * last handle is released, from any thread. The pool must outlive all of
+ * its handles.
+ */
+class EncodedPacket
+{
+public:
+    EncodedPacket();
+    ~EncodedPacket();
+
+    EncodedPacket(EncodedPacket &&other);
+    EncodedPacket &operator=(EncodedPacket &&other);
+
+    /* another reference of the same packet, invalid handle if none */
+    EncodedPacket share() const;
+
+    /* drop this reference, the handle turns invalid */
+    void reset();
+
+    /*
+     * put @size bytes in front of the data, in the headroom reserved by
+     * RKPacketPool::alloc. Only before the packet is shared.
+     * Return -1 if the headroom is too small.
+     */
+    int32_t prepend(const void *data, int32_t size);
+
+    void setInfo(int64_t pts, int32_t keyFrame);
+
+    bool valid() const { return mRef != NULL; }
+    uint8_t *data() const { return (mRef != NULL) ? mRef->data : NULL; }
+    int32_t size() const { return (mRef != NULL) ? mRef->size : 0; }
+    int64_t pts() const { return (mRef != NULL) ? mRef->pts : 0; }
+    int32_t keyFrame() const { return (mRef != NULL) ? mRef->keyFrame : 0; }
+    int32_t refCount() const { return (mRef != NULL) ? mRef->refs.load() : 0; }
+
+private:
+    friend class RKPacketPool;
+
+    /* at the head of a ring slot, or of a heap block */
+    typedef struct PacketRef {
+        uint8_t *data;
+        int32_t size;
+        int32_t headroom;       /* bytes free before data */
+        int64_t pts;
+        int32_t keyFrame;
+        std::atomic<int32_t> refs;
+        RKPacketPool *owner;
+        int32_t slotSize;       /* bytes in the ring, 0 - heap */
+        bool done;              /* released, waits to be reclaimed in order */
+        uint8_t *adopted;       /* buffer of adopt() */
+    } PacketRef;
+
+    EncodedPacket(const EncodedPacket &);
+    EncodedPacket &operator=(const EncodedPacket &);
+
+    PacketRef *mRef;
+};
+
+/*
+ * Ring of encoded packets.
+ *
+ * Packets are taken from the tail of one buffer and come back in any
+ * order, the space is reclaimed from the head once the oldest packet is
+ * released. The encoder outputs in order and packets are released in
+ * about the same order, so the ring rarely holds space of a released
+ * packet for long.
+ *
+ * A packet which doesn't fit, too large or the ring full of packets in
+ * flight, is allocated on the heap instead. The peak bytes in flight are
+ * tracked and a larger ring is taken for the next packets, the old one is
+ * freed when its last packet is released.
+ */
+class RKPacketPool
+{
+public:
+    RKPacketPool();
+    ~RKPacketPool();
+
+    typedef struct PoolStats {
+        int32_t capacity;       /* ring bytes */
+        int32_t resizes;
+        int64_t packets;
+        int64_t heapPackets;    /* out of the ring, too large or ring full */
+        int64_t adopted;        /* buffers taken over without copy */
+        int32_t inFlight;       /* packets not released */
+        int32_t inFlightBytes;
+        int32_t peakBytes;
+    } PoolStats_t;
+
+    /* ring size for a stream of @bitRate, @frameSize if bitrate unknown */
+    static int32_t sizeFor(int32_t bitRate, int32_t frameSize);
+
+    int32_t init(int32_t capacity);
+
+    /*
+     * ring size wanted, applied to the next packets, e.g. for a new bitrate.
+     */
+    void resize(int32_t capacity);
+
+    /*
+     * a packet of @size bytes to write into data(), with @headroom bytes
+     * before it for EncodedPacket::prepend.
+     */
+    int32_t alloc(EncodedPacket *packet, int32_t size, int32_t headroom);
+
+    /*
+     * wrap a malloc'd buffer as a packet, it is freed by the last release.
+     */
+    int32_t adopt(EncodedPacket *packet, uint8_t *data, int32_t size);
+
+    void getStats(PoolStats *stats);
+
+private:
+    friend class EncodedPacket;
+
+    void release(EncodedPacket::PacketRef *ref);
+    void reclaim();
+    int32_t pendingSlots();
+    void switchRing();
+    EncodedPacket::PacketRef *allocSlot(int32_t slotSize);
+
+    pthread_mutex_t mLock;
+
+    uint8_t *mBuf;
+    int32_t mCapacity;
+    int32_t mWanted;
+    int32_t mHead;          /* oldest slot */
+    int32_t mTail;          /* next slot */
+    int32_t mWrap;          /* end of the slots before the tail wrapped */
+    bool mWrapped;          /* tail is behind head */
+    int32_t mSlots;         /* slots in the ring, released or not */
+
+    /* ring replaced by resize, packets still in flight */
+    uint8_t *mRetired;
+    int32_t mRetiredSize;
+    int32_t mRetiredSlots;
+
+    PoolStats mStats;
+};
+
+#endif  // __RKVPU_PACKET_POOL_H__
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: rkvpu_packet_pool_test sample code
+ * date  : 2021/04/04
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "rkvpu_packet_pool_test"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rkvpu_packet_pool.h"
+
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return -1;                                                      \
+        }                                                                   \
+    } while (0)
+
+/* packets released in order, the ring is reused from the start */
+static int32_t testInOrder()
+{
+    RKPacketPool pool;
+    RKPacketPool::PoolStats stats;
+
+    TEST_CHECK(pool.init(PACKET_POOL_MIN_SIZE) == 0);
+
+    for (int32_t i = 0; i < 1000; i++) {
+        EncodedPacket packet;
+
+        TEST_CHECK(pool.alloc(&packet, 1000, 16) == 0);
+        memset(packet.data(), i & 0xff, packet.size());
+    }
+
+    pool.getStats(&stats);
+    TEST_CHECK(stats.heapPackets == 0);
+    TEST_CHECK(stats.inFlight == 0);
+
+    return 0;
+}
+
+/*
+ * a packet released behind an older one held is not reclaimed yet, the
+ * ring retired by a resize must still go once the older one is released,
+ * and the next resize must not wait for it.
+ */
+static int32_t testOutOfOrderResize()
+{
+    RKPacketPool pool;
+    RKPacketPool::PoolStats stats;
+    EncodedPacket a, b, c, d;
+
+    TEST_CHECK(pool.init(PACKET_POOL_MIN_SIZE) == 0);
+    TEST_CHECK(pool.alloc(&a, 1000, 0) == 0);
+    TEST_CHECK(pool.alloc(&b, 1000, 0) == 0);
+    b.reset();
+
+    pool.resize(PACKET_POOL_MIN_SIZE * 2);
+    TEST_CHECK(pool.alloc(&c, 1000, 0) == 0);
+    pool.getStats(&stats);
+    TEST_CHECK(stats.resizes == 1);
+    TEST_CHECK(stats.capacity == PACKET_POOL_MIN_SIZE * 2);
+
+    // the last packet of the old ring
+    a.reset();
+
+    pool.resize(PACKET_POOL_MIN_SIZE * 4);
+    TEST_CHECK(pool.alloc(&d, 1000, 0) == 0);
+    pool.getStats(&stats);
+    TEST_CHECK(stats.resizes == 2);
+    TEST_CHECK(stats.capacity == PACKET_POOL_MIN_SIZE * 4);
+    TEST_CHECK(stats.heapPackets == 0);
+
+    c.reset();
+    d.reset();
+    pool.getStats(&stats);
+    TEST_CHECK(stats.inFlight == 0);
+
+    return 0;
+}
+
+/* shared handles keep the packet until the last one is released */
+static int32_t testShare()
+{
+    RKPacketPool pool;
+    RKPacketPool::PoolStats stats;
+    EncodedPacket packet, shared;
+
+    TEST_CHECK(pool.init(PACKET_POOL_MIN_SIZE) == 0);
+    TEST_CHECK(pool.alloc(&packet, 100, 4) == 0);
+    TEST_CHECK(packet.prepend("\x00\x00\x00\x01", 4) == 0);
+    TEST_CHECK(packet.size() == 104);
+
+    shared = packet.share();
+    TEST_CHECK(packet.refCount() == 2);
+    packet.reset();
+    pool.getStats(&stats);
+    TEST_CHECK(stats.inFlight == 1);
+
+    shared.reset();
+    pool.getStats(&stats);
+    TEST_CHECK(stats.inFlight == 0);
+
+    return 0;
+}
+
+int main()
+{
+    int32_t failed = 0;
+
+    failed += testInOrder() ? 1 : 0;
+    failed += testOutOfOrderResize() ? 1 : 0;
+    failed += testShare() ? 1 : 0;
+
+    if (failed) {
+        fprintf(stderr, "ERROR: packet_pool_test %d failed\n", failed);
+        return 1;
+    }
+
+    printf("packet_pool_test passed\n");
+    return 0;
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: sps_parser
+ * date  : 2021/03/31
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "sps_parser"
+#include <utils/Log.h>
+
+#include <string.h>
+
+#include "rkvpu_sps.h"
+#include "rkvpu_nal_scan.h"
+
+/* rbsp bytes kept, the fields we need are in the first few dozen */
+#define SPS_MAX_BYTES           512
+/* larger than any level allows, sizes above are taken as broken */
+#define SPS_MAX_SIZE            16384
+
+#define H264_NAL_IDR            5
+#define H264_NAL_SPS            7
+#define H265_NAL_RADL_N         6
+#define H265_NAL_RASL_N         8
+#define H265_NAL_RASL_R         9
+#define H265_NAL_IRAP_BEGIN     16
+#define H265_NAL_IRAP_END       21
+#define H265_NAL_RSV_VCL_N14    14
+#define H265_NAL_SPS            33
+
+typedef struct BitReader {
+    const uint8_t *buf;
+    int32_t size;
+    int32_t pos;            /* in bits */
+    bool error;             /* read beyond the end */
+} BitReader;
+
+static uint32_t readBits(BitReader *br, int32_t n)
+{
+    uint32_t val = 0;
+
+    for (int32_t i = 0; i < n; i++) {
+        if (br->pos >= br->size * 8) {
+            br->error = true;
+            return 0;
+        }
+        val = (val << 1) | ((br->buf[br->pos >> 3] >> (7 - (br->pos & 7))) & 1);
+        br->pos++;
+    }
+
+    return val;
+}
+
+static void skipBits(BitReader *br, int32_t n)
+{
+    br->pos += n;
+    if (br->pos > br->size * 8)
+        br->error = true;
+}
+
+static uint32_t readUe(BitReader *br)
+{
+    int32_t zeros = 0;
+
+    while (readBits(br, 1) == 0) {
+        if (br->error || ++zeros > 31) {
+            br->error = true;
+            return 0;
+        }
+    }
+
+    return ((1u << zeros) - 1) + readBits(br, zeros);
+}
+
+static int32_t readSe(BitReader *br)
+{
+    uint32_t val = readUe(br);
+
+    return (val & 1) ? (int32_t)((val + 1) / 2) : -(int32_t)(val / 2);
+}
+
+/* drop the 03 of every 00 00 03 */
+static int32_t unescapeRbsp(const uint8_t *src, size_t size, uint8_t *dst, int32_t max)
+{
+    int32_t len = 0;
+    int32_t zeros = 0;
+
+    for (size_t i = 0; i < size && len < max; i++) {
+        if (zeros >= 2 && src[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = (src[i] == 0) ? zeros + 1 : 0;
+        dst[len++] = src[i];
+    }
+
+    return len;
+}
+
+/* coded size in range and the crop leaves something */
+static bool sizeValid(int64_t coded, int64_t crop)
+{
+    return coded > 0 && coded <= SPS_MAX_SIZE && crop < coded;
+}
+
+static void skipScalingList(BitReader *br, int32_t size)
+{
+    int32_t last = 8, next = 8;
+
+    for (int32_t j = 0; j < size && !br->error; j++) {
+        if (next != 0)
+            next = (last + readSe(br) + 256) % 256;
+        last = (next == 0) ? last : next;
+    }
+}
+
+static int32_t parseH264Sps(BitReader *br, SpsInfo *info)
+{
+    int32_t profile, frameMbsOnly, cropUnitX, cropUnitY;
+    int64_t widthMbs, heightMapUnits, codedWidth, codedHeight, cropX, cropY;
+    int64_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    bool separateColourPlane = false;
+
+    profile = readBits(br, 8);
+    skipBits(br, 8);                            // constraint flags
+    info->profile = profile;
+    info->level = readBits(br, 8);
+    readUe(br);                                 // seq_parameter_set_id
+
+    info->chromaFormat = 1;
+    info->bitDepth = 8;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 ||
+        profile == 44 || profile == 83 || profile == 86 || profile == 118 ||
+        profile == 128 || profile == 138 || profile == 139 || profile == 134 ||
+        profile == 135) {
+        info->chromaFormat = readUe(br);
+        if (info->chromaFormat == 3)
+            separateColourPlane = readBits(br, 1);
+        info->bitDepth = readUe(br) + 8;
+        readUe(br);                             // bit_depth_chroma_minus8
+        skipBits(br, 1);                        // qpprime_y_zero_transform_bypass
+        if (readBits(br, 1)) {                  // seq_scaling_matrix_present
+            int32_t lists = (info->chromaFormat != 3) ? 8 : 12;
+
+            for (int32_t i = 0; i < lists; i++) {
+                if (readBits(br, 1))
+                    skipScalingList(br, (i < 6) ? 16 : 64);
+            }
+        }
+    }
+
+    readUe(br);                                 // log2_max_frame_num_minus4
+    switch (readUe(br)) {                       // pic_order_cnt_type
+    case 0:
+        readUe(br);                             // log2_max_pic_order_cnt_lsb_minus4
+        break;
+    case 1: {
+        skipBits(br, 1);                        // delta_pic_order_always_zero
+        readSe(br);                             // offset_for_non_ref_pic
+        readSe(br);                             // offset_for_top_to_bottom_field
+        uint32_t cycle = readUe(br);
+        for (uint32_t i = 0; i < cycle && !br->error; i++)
+            readSe(br);                         // offset_for_ref_frame
+        break;
+    }
+    default:
+        break;
+    }
+
+    readUe(br);                                 // max_num_ref_frames
+    skipBits(br, 1);                            // gaps_in_frame_num_allowed
+    widthMbs = readUe(br) + 1;
+    heightMapUnits = readUe(br) + 1;
+    frameMbsOnly = readBits(br, 1);
+    if (!frameMbsOnly)
+        skipBits(br, 1);                        // mb_adaptive_frame_field
+    skipBits(br, 1);                            // direct_8x8_inference
+    if (readBits(br, 1)) {                      // frame_cropping
+        cropLeft = readUe(br);
+        cropRight = readUe(br);
+        cropTop = readUe(br);
+        cropBottom = readUe(br);
+    }
+
+    if (br->error || info->chromaFormat > 3)
+        return -1;
+
+    if (info->chromaFormat == 0 || separateColourPlane) {
+        cropUnitX = 1;
+        cropUnitY = 2 - frameMbsOnly;
+    } else {
+        cropUnitX = (info->chromaFormat == 3) ? 1 : 2;
+        cropUnitY = ((info->chromaFormat == 1) ? 2 : 1) * (2 - frameMbsOnly);
+    }
+
+    codedWidth = widthMbs * 16;
+    codedHeight = (2 - frameMbsOnly) * heightMapUnits * 16;
+    cropX = cropUnitX * (cropLeft + cropRight);
+    cropY = cropUnitY * (cropTop + cropBottom);
+    if (!sizeValid(codedWidth, cropX) || !sizeValid(codedHeight, cropY))
+        return -1;
+
+    info->codedWidth = (int32_t)codedWidth;
+    info->codedHeight = (int32_t)codedHeight;
+    info->width = (int32_t)(codedWidth - cropX);
+    info->height = (int32_t)(codedHeight - cropY);
+
+    return 0;
+}
+
+static void skipProfileTierLevel(BitReader *br, int32_t maxSubLayersMinus1, SpsInfo *info)
+{
+    bool subProfile[8], subLevel[8];
+
+    skipBits(br, 2);                            // general_profile_space
+    skipBits(br, 1);                            // general_tier_flag
+    info->profile = readBits(br, 5);
+    skipBits(br, 32);                           // compatibility flags
+    skipBits(br, 48);                           // source and constraint flags
+    info->level = readBits(br, 8);
+
+    for (int32_t i = 0; i < maxSubLayersMinus1; i++) {
+        subProfile[i] = readBits(br, 1);
+        subLevel[i] = readBits(br, 1);
+    }
+    if (maxSubLayersMinus1 > 0) {
+        for (int32_t i = maxSubLayersMinus1; i < 8; i++)
+            skipBits(br, 2);                    // reserved_zero_2bits
+    }
+    for (int32_t i = 0; i < maxSubLayersMinus1; i++) {
+        if (subProfile[i])
+            skipBits(br, 88);
+        if (subLevel[i])
+            skipBits(br, 8);
+    }
+}
+
+static int32_t parseH265Sps(BitReader *br, SpsInfo *info)
+{
+    int32_t maxSubLayersMinus1, subWidth, subHeight;
+    int64_t codedWidth, codedHeight, cropX, cropY;
+    int64_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+
+    skipBits(br, 4);                            // sps_video_parameter_set_id
+    maxSubLayersMinus1 = readBits(br, 3);
+    skipBits(br, 1);                            // temporal_id_nesting
+    if (maxSubLayersMinus1 > 6)
+        return -1;
+
+    skipProfileTierLevel(br, maxSubLayersMinus1, info);
+
+    readUe(br);                                 // sps_seq_parameter_set_id
+    info->chromaFormat = readUe(br);
+    if (info->chromaFormat == 3 && readBits(br, 1))
+        info->chromaFormat = 0;                 // separate colour planes, mono each
+    codedWidth = readUe(br);
+    codedHeight = readUe(br);
+    if (readBits(br, 1)) {                      // conformance_window
+        cropLeft = readUe(br);
+        cropRight = readUe(br);
+        cropTop = readUe(br);
+        cropBottom = readUe(br);
+    }
+    info->bitDepth = readUe(br) + 8;
+
+    if (br->error || info->chromaFormat > 3)
+        return -1;
+
+    subWidth = (info->chromaFormat == 1 || info->chromaFormat == 2) ? 2 : 1;
+    subHeight = (info->chromaFormat == 1) ? 2 : 1;
+
+    cropX = subWidth * (cropLeft + cropRight);
+    cropY = subHeight * (cropTop + cropBottom);
+    if (!sizeValid(codedWidth, cropX) || !sizeValid(codedHeight, cropY))
+        return -1;
+
+    info->codedWidth = (int32_t)codedWidth;
+    info->codedHeight = (int32_t)codedHeight;
+    info->width = (int32_t)(codedWidth - cropX);
+    info->height = (int32_t)(codedHeight - cropY);
+
+    return 0;
+}
+
+int32_t sps_nal_type(const uint8_t *nal, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        return (nal[0] >> 1) & 0x3f;
+
+    return nal[0] & 0x1f;
+}
+
+bool sps_is_vcl(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        return type < 32;
+
+    return type >= 1 && type <= 5;
+}
+
+bool sps_is_sps(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    return type == ((coding == OMX_RK_VIDEO_CodingHEVC) ? H265_NAL_SPS : H264_NAL_SPS);
+}
+
+bool sps_is_irap(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        return type >= H265_NAL_IRAP_BEGIN && type <= H265_NAL_IRAP_END;
+
+    return type == H264_NAL_IDR;
+}
+
+bool sps_is_rasl(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        return type == H265_NAL_RASL_N || type == H265_NAL_RASL_R;
+
+    return false;
+}
+
+bool sps_is_leading(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        return type >= H265_NAL_RADL_N && type <= H265_NAL_RASL_R;
+
+    return false;
+}
+
+bool sps_is_reference(const uint8_t *nal, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    if (coding == OMX_RK_VIDEO_CodingHEVC) {
+        int32_t type = sps_nal_type(nal, coding);
+
+        // the even types up to RSV_VCL_N14 are non-reference
+        return type > H265_NAL_RSV_VCL_N14 || (type & 1);
+    }
+
+    return (nal[0] & 0x60) != 0;
+}
+
+const uint8_t *sps_find_slice(const uint8_t *buf, size_t size,
+                              OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    const uint8_t *end = buf + size;
+    const uint8_t *pos = nal_scan_find(buf, end);
+
+    while (pos != NULL && pos + 3 < end) {
+        if (sps_is_vcl(sps_nal_type(pos + 3, coding), coding))
+            return pos + 3;
+
+        pos = nal_scan_find(pos + 3, end);
+    }
+
+    return NULL;
+}
+
+int32_t sps_parse(const uint8_t *nal, size_t size,
+                  OMX_RK_VIDEO_CODINGTYPE coding, SpsInfo *info)
+{
+    uint8_t rbsp[SPS_MAX_BYTES];
+    int32_t header = (coding == OMX_RK_VIDEO_CodingHEVC) ? 2 : 1;
+    BitReader br;
+    int32_t ret;
+
+    if (coding != OMX_RK_VIDEO_CodingAVC && coding != OMX_RK_VIDEO_CodingHEVC)
+        return -1;
+
+    if (size <= (size_t)header || !sps_is_sps(sps_nal_type(nal, coding), coding))
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    br.buf = rbsp;
+    br.size = unescapeRbsp(nal + header, size - header, rbsp, SPS_MAX_BYTES);
+    br.pos = 0;
+    br.error = false;
+
+    if (coding == OMX_RK_VIDEO_CodingHEVC)
+        ret = parseH265Sps(&br, info);
+    else
+        ret = parseH264Sps(&br, info);
+
+    if (ret || info->width <= 0 || info->height <= 0) {
+        ALOGW("broken sps, %d bytes", (int32_t)size);
+        return -1;
+    }
+
+    ALOGV("sps profile %d level %d %dx%d(%dx%d) chroma %d %d bit",
+          info->profile, info->level, info->width, info->height,
+          info->codedWidth, info->codedHeight, info->chromaFormat, info->bitDepth);
+
+    return 0;
+}
+
+int32_t sps_find_in_packet(const uint8_t *buf, size_t size,
+                           OMX_RK_VIDEO_CODINGTYPE coding, SpsInfo *info)
+{
+    const uint8_t *end = buf + size;
+    const uint8_t *pos = nal_scan_find(buf, end);
+
+    while (pos != NULL) {
+        const uint8_t *nal = pos + 3;
+        const uint8_t *next;
+        int32_t type;
+
+        if (nal + 2 > end)
+            break;
+
+        type = sps_nal_type(nal, coding);
+        if (sps_is_vcl(type, coding))
+            break;
+
+        next = nal_scan_find(nal, end);
+        if (sps_is_sps(type, coding))
+            return sps_parse(nal, (next ? next : end) - nal, coding, info) ? 0 : 1;
+
+        pos = next;
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: sps_parser
+ * date  : 2021/03/31
+ */
+
+#ifndef __RKVPU_SPS_H__
+#define __RKVPU_SPS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vpu_api.h"
+
+/*
+ * Minimal H.264 / H.265 sequence parameter set parser, only the fields
+ * up to the picture size are read, enough to tell a resolution or bit
+ * depth change in the stream before the decoder does.
+ */
+typedef struct SpsInfo {
+    int32_t profile;
+    int32_t level;
+    int32_t chromaFormat;   /* 0 - 400, 1 - 420, 2 - 422, 3 - 444 */
+    int32_t bitDepth;       /* luma */
+    int32_t codedWidth;     /* in luma samples, before cropping */
+    int32_t codedHeight;
+    int32_t width;          /* cropped, the display size */
+    int32_t height;
+} SpsInfo;
+
+/* nal_unit_type of the first byte(s) of a nal, start code excluded */
+int32_t sps_nal_type(const uint8_t *nal, OMX_RK_VIDEO_CODINGTYPE coding);
+bool sps_is_vcl(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding);
+bool sps_is_sps(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding);
+
+/* h264 idr, h265 irap(BLA/IDR/CRA), decodable without earlier frames */
+bool sps_is_irap(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding);
+
+/*
+ * h265 RASL_N/RASL_R, leading frames which refer to the frames before
+ * their CRA/BLA, not decodable when the decoding starts there. None in h264.
+ */
+bool sps_is_rasl(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding);
+
+/* h265 RADL and RASL, before the trailing frames in decode order */
+bool sps_is_leading(int32_t type, OMX_RK_VIDEO_CODINGTYPE coding);
+
+/*
+ * h264 nal_ref_idc != 0, h265 not a sub-layer non-reference type
+ * (TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and reserved ones).
+ */
+bool sps_is_reference(const uint8_t *nal, OMX_RK_VIDEO_CODINGTYPE coding);
+
+/*
+ * the first slice nal in an Annex-B packet, start code excluded.
+ * Return NULL if the packet has no slice.
+ */
+const uint8_t *sps_find_slice(const uint8_t *buf, size_t size,
+                              OMX_RK_VIDEO_CODINGTYPE coding);
+
+/*
+ * @nal: sps nal unit with the nal header, start code excluded, emulation
+ *       prevention bytes are removed inside.
+ * Return 0 on success, -1 if unsupported or broken.
+ */
+int32_t sps_parse(const uint8_t *nal, size_t size,
+                  OMX_RK_VIDEO_CODINGTYPE coding, SpsInfo *info);
+
+/*
+ * Find and parse the sps in an Annex-B packet, the scan stops at the
+ * first slice as parameter sets always come before it.
+ * Return 1 if a sps is parsed, 0 if none.
+ */
+int32_t sps_find_in_packet(const uint8_t *buf, size_t size,
+                           OMX_RK_VIDEO_CODINGTYPE coding, SpsInfo *info);
+
+#endif  // __RKVPU_SPS_H__
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKSpscQueue
+ * date  : 2021/03/15
+ */
+
+#ifndef __RKVPU_SPSC_QUEUE_H__
+#define __RKVPU_SPSC_QUEUE_H__
+
+#include <stdint.h>
+#include <new>
+#include <atomic>
+
+/*
+ * Bounded single-producer/single-consumer lock-free ring.
+ *
+ * The slots are kept in the ring and reused, the producer fills the slot
+ * from writeSlot() in place and publishes it by push(), the consumer reads
+ * the slot from readSlot() and releases it by pop(). So slots owning heap
+ * buffers(packet data) are recycled without allocation.
+ */
+template <typename T>
+class RKSpscQueue
+{
+public:
+    RKSpscQueue() : mSlots(NULL), mMask(0), mHead(0), mTail(0) {}
+    ~RKSpscQueue() { deinit(); }
+
+    /* @depth is rounded up to power of two */
+    bool init(uint32_t depth) {
+        uint32_t size = 1;
+        while (size < depth)
+            size <<= 1;
+
+        mSlots = new (std::nothrow) T[size]();
+        mMask = size - 1;
+        mHead.store(0, std::memory_order_relaxed);
+        mTail.store(0, std::memory_order_relaxed);
+        return mSlots != NULL;
+    }
+
+    void deinit() {
+        delete[] mSlots;
+        mSlots = NULL;
+        mMask = 0;
+    }
+
+    /* producer side, NULL if the ring is full */
+    T *writeSlot() {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) > mMask)
+            return NULL;
+        return &mSlots[tail & mMask];
+    }
+
+    void push() {
+        mTail.store(mTail.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    /* consumer side, NULL if the ring is empty */
+    T *readSlot() {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire))
+            return NULL;
+        return &mSlots[head & mMask];
+    }
+
+    void pop() {
+        mHead.store(mHead.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    /* approximate when called from a third thread */
+    uint32_t size() {
+        return mTail.load(std::memory_order_acquire) -
+               mHead.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacity() { return mMask + 1; }
+
+    /* all slots, used to release slot resources after the threads exit */
+    T *slotAt(uint32_t idx) { return &mSlots[idx & mMask]; }
+
+private:
+    RKSpscQueue(const RKSpscQueue &);
+    RKSpscQueue &operator=(const RKSpscQueue &);
+
+    T *mSlots;
+    uint32_t mMask;
+
+    /*
+     * producer and consumer indexes padded onto separate cache lines, not
+     * alignas, so the owner can still be allocated by plain new.
+     */
+    std::atomic<uint32_t> mHead;
+    char mPad[64];
+    std::atomic<uint32_t> mTail;
+};
+
+#endif  // __RKVPU_SPSC_QUEUE_H__
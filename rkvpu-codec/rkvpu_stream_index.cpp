@@ -0,0 +1,282 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKStreamIndex
+ * date  : 2021/04/01
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKStreamIndex"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "rkvpu_stream_index.h"
+#include "rkvpu_stream_packer.h"
+#include "rkvpu_sps.h"
+
+#define INDEX_PATH_LEN          256
+
+static int64_t getFileSize(const char *file)
+{
+    struct stat st;
+
+    if (stat(file, &st))
+        return -1;
+
+    return st.st_size;
+}
+
+/*
+ * nal type of the key slice in the frame, -1 if not a key frame.
+ */
+static int32_t findKeySlice(const uint8_t *buf, int32_t size,
+                            OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    const uint8_t *nal = sps_find_slice(buf, size, coding);
+    int32_t type;
+
+    if (nal == NULL)
+        return -1;
+
+    // all slices of a picture are the same kind
+    type = sps_nal_type(nal, coding);
+
+    return sps_is_irap(type, coding) ? type : -1;
+}
+
+RKStreamIndex::RKStreamIndex()
+{
+    mCoding = OMX_RK_VIDEO_CodingUnused;
+    mFileSize = 0;
+    mFrames = 0;
+    mKeys = NULL;
+    mCount = 0;
+    mCapacity = 0;
+}
+
+RKStreamIndex::~RKStreamIndex()
+{
+    clear();
+}
+
+void RKStreamIndex::clear()
+{
+    if (mKeys != NULL) {
+        free(mKeys);
+        mKeys = NULL;
+    }
+    mCount = 0;
+    mCapacity = 0;
+    mFrames = 0;
+    mFileSize = 0;
+}
+
+VPU_RET RKStreamIndex::addKeyFrame(int64_t offset, int32_t frame, int32_t nalType)
+{
+    if (mCount == mCapacity) {
+        int32_t capacity = (mCapacity > 0) ? mCapacity * 2 : 256;
+        KeyFrame *keys = (KeyFrame *)realloc(mKeys, capacity * sizeof(KeyFrame));
+        if (keys == NULL) {
+            ALOGE("failed to malloc index, %d key frames", capacity);
+            return VPU_ERR_UNKNOW;
+        }
+        mKeys = keys;
+        mCapacity = capacity;
+    }
+
+    mKeys[mCount].offset = offset;
+    mKeys[mCount].frame = frame;
+    mKeys[mCount].nalType = nalType;
+    mCount++;
+
+    return VPU_OK;
+}
+
+VPU_RET RKStreamIndex::build(const char *file, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    RKStreamPacker packer;
+    VPU_RET ret;
+
+    clear();
+    mCoding = coding;
+    mFileSize = getFileSize(file);
+
+    // mapped and read ahead, nothing copied
+    ret = packer.open(file, coding, true);
+    if (ret != VPU_OK)
+        return ret;
+
+    while (!packer.isEos()) {
+        int64_t offset = packer.tell();
+        char *data = NULL;
+        int32_t size = 0;
+        int32_t type;
+
+        ret = packer.readFrame(&data, &size);
+        if (ret == VPU_ERR_UNKNOW)
+            return ret;
+        if (ret != VPU_OK)
+            break;
+
+        type = findKeySlice((const uint8_t *)data, size, coding);
+        if (type >= 0) {
+            ret = addKeyFrame(offset, mFrames, type);
+            if (ret != VPU_OK)
+                return ret;
+        }
+        mFrames++;
+    }
+
+    ALOGD("index %s: %d frames, %d key frames", file, mFrames, mCount);
+
+    return VPU_OK;
+}
+
+VPU_RET RKStreamIndex::load(const char *idxFile, int64_t fileSize,
+                            OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    IndexHeader hdr;
+    VPU_RET ret = VPU_ERR_STREAM;
+    FILE *fp;
+
+    clear();
+
+    fp = fopen(idxFile, "rb");
+    if (fp == NULL)
+        return VPU_ERR_INIT;
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != STREAM_INDEX_MAGIC || hdr.version != STREAM_INDEX_VERSION) {
+        ALOGW("invalid index file %s", idxFile);
+        goto LOAD_OUT;
+    }
+
+    if (hdr.fileSize != fileSize || hdr.coding != (int32_t)coding || hdr.count < 0) {
+        ALOGD("index %s out of date", idxFile);
+        goto LOAD_OUT;
+    }
+
+    if (hdr.count > 0) {
+        mKeys = (KeyFrame *)malloc(hdr.count * sizeof(KeyFrame));
+        if (mKeys == NULL) {
+            ALOGE("failed to malloc index, %d key frames", hdr.count);
+            ret = VPU_ERR_UNKNOW;
+            goto LOAD_OUT;
+        }
+        if (fread(mKeys, sizeof(KeyFrame), hdr.count, fp) != (size_t)hdr.count) {
+            ALOGW("index file %s truncated", idxFile);
+            clear();
+            goto LOAD_OUT;
+        }
+    }
+
+    mCoding = coding;
+    mFileSize = fileSize;
+    mFrames = hdr.frames;
+    mCount = mCapacity = hdr.count;
+    ret = VPU_OK;
+
+    ALOGD("index %s loaded: %d frames, %d key frames", idxFile, mFrames, mCount);
+
+LOAD_OUT:
+    fclose(fp);
+    return ret;
+}
+
+VPU_RET RKStreamIndex::save(const char *idxFile)
+{
+    IndexHeader hdr;
+    FILE *fp;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = STREAM_INDEX_MAGIC;
+    hdr.version = STREAM_INDEX_VERSION;
+    hdr.coding = mCoding;
+    hdr.count = mCount;
+    hdr.frames = mFrames;
+    hdr.fileSize = mFileSize;
+
+    fp = fopen(idxFile, "wb");
+    if (fp == NULL) {
+        ALOGW("failed to create index file %s", idxFile);
+        return VPU_ERR_INIT;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        (mCount > 0 && fwrite(mKeys, sizeof(KeyFrame), mCount, fp) != (size_t)mCount)) {
+        ALOGW("failed to write index file %s", idxFile);
+        fclose(fp);
+        remove(idxFile);
+        return VPU_ERR_UNKNOW;
+    }
+
+    fclose(fp);
+
+    return VPU_OK;
+}
+
+VPU_RET RKStreamIndex::open(const char *file, OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    char idxFile[INDEX_PATH_LEN];
+    int64_t fileSize = getFileSize(file);
+    VPU_RET ret;
+
+    if (fileSize < 0) {
+        ALOGE("failed to stat input file %s", file);
+        return VPU_ERR_INIT;
+    }
+
+    snprintf(idxFile, sizeof(idxFile), "%s.idx", file);
+    if (load(idxFile, fileSize, coding) == VPU_OK)
+        return VPU_OK;
+
+    ret = build(file, coding);
+    if (ret != VPU_OK)
+        return ret;
+
+    // read only media is fine, the index lives in memory anyway
+    save(idxFile);
+
+    return VPU_OK;
+}
+
+VPU_RET RKStreamIndex::findKeyFrame(int32_t frame, KeyFrame *key) const
+{
+    int32_t low = 0, high = mCount - 1, found = -1;
+
+    // key frames are in increasing frame number
+    while (low <= high) {
+        int32_t mid = (low + high) / 2;
+
+        if (mKeys[mid].frame <= frame) {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    if (found < 0)
+        return VPU_ERR_STREAM;
+
+    *key = mKeys[found];
+
+    return VPU_OK;
+}
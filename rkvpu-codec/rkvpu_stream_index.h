@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKStreamIndex
+ * date  : 2021/04/01
+ */
+
+#ifndef __RKVPU_STREAM_INDEX_H__
+#define __RKVPU_STREAM_INDEX_H__
+
+#include <stdint.h>
+
+#include "rkvpu_dec_api.h"
+
+#define STREAM_INDEX_MAGIC      0x58494b52  /* "RKIX" */
+#define STREAM_INDEX_VERSION    1
+
+/*
+ * Key frame index of a raw h264/h265 file.
+ *
+ * The file is scanned once with RKStreamPacker, so the frames are counted
+ * the same way as they are sent to the decoder. Every frame with an IDR
+ * (h264) or IRAP (h265, IDR/CRA/BLA) slice is recorded with its byte offset
+ * and frame number, parameter sets in front of the slice included.
+ *
+ * The index is saved next to the stream as "<file>.idx", and it is taken
+ * again only if the stream size and coding still match.
+ */
+class RKStreamIndex
+{
+public:
+    RKStreamIndex();
+    ~RKStreamIndex();
+
+    typedef struct KeyFrame {
+        int64_t offset;     /* of the frame in the stream file */
+        int32_t frame;      /* frame number in decode order, from 0 */
+        int32_t nalType;    /* of the key slice */
+    } KeyFrame_t;
+
+    /*
+     * load the sidecar index of @file, or build it and save the sidecar
+     * if it's missing or out of date.
+     */
+    VPU_RET open(const char *file, OMX_RK_VIDEO_CODINGTYPE coding);
+
+    /* scan the stream, no sidecar read or written */
+    VPU_RET build(const char *file, OMX_RK_VIDEO_CODINGTYPE coding);
+
+    VPU_RET load(const char *idxFile, int64_t fileSize, OMX_RK_VIDEO_CODINGTYPE coding);
+    VPU_RET save(const char *idxFile);
+
+    /*
+     * the last key frame at or before @frame.
+     * Return VPU_ERR_STREAM if there is none.
+     */
+    VPU_RET findKeyFrame(int32_t frame, KeyFrame *key) const;
+
+    int32_t keyFrameCount() const { return mCount; }
+    int32_t frameCount() const { return mFrames; }
+
+    void clear();
+
+private:
+    typedef struct IndexHeader {
+        uint32_t magic;
+        int32_t version;
+        int32_t coding;
+        int32_t count;      /* key frames */
+        int32_t frames;     /* all frames */
+        int32_t reserved;
+        int64_t fileSize;
+    } IndexHeader;
+
+    VPU_RET addKeyFrame(int64_t offset, int32_t frame, int32_t nalType);
+
+    OMX_RK_VIDEO_CODINGTYPE mCoding;
+    int64_t mFileSize;
+    int32_t mFrames;
+
+    KeyFrame *mKeys;
+    int32_t mCount;
+    int32_t mCapacity;
+};
+
+#endif  // __RKVPU_STREAM_INDEX_H__
@@ -0,0 +1,413 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKStreamPacker
+ * date  : 2021/03/02
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKStreamPacker"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "rkvpu_stream_packer.h"
+#include "rkvpu_nal_scan.h"
+
+#define PACKER_READ_SIZE        (256 * 1024)
+#define PACKER_MMAP_WINDOW      (64 * 1024 * 1024)
+
+/* h264 nal_unit_type */
+#define AVC_NAL_SLICE           1
+#define AVC_NAL_IDR             5
+#define AVC_NAL_SEI             6
+#define AVC_NAL_SPS             7
+#define AVC_NAL_PPS             8
+#define AVC_NAL_AUD             9
+#define AVC_NAL_PREFIX          14
+#define AVC_NAL_RSV_END         18
+
+/* h265 nal_unit_type */
+#define HEVC_NAL_VCL_END        31
+#define HEVC_NAL_VPS            32
+#define HEVC_NAL_AUD            35
+#define HEVC_NAL_SEI_PREFIX     39
+#define HEVC_NAL_RSV_NVCL41     41
+#define HEVC_NAL_RSV_NVCL44     44
+#define HEVC_NAL_UNSPEC48       48
+#define HEVC_NAL_UNSPEC55       55
+
+/*
+ * NAL classify result, @vcl means slice data, @first means the NAL
+ * begins a new frame if the current frame already has slice data.
+ */
+typedef struct NalInfo {
+    bool vcl;
+    bool first;
+} NalInfo;
+
+/*
+ * @hdr points to the nal header, @left is the valid data size from there.
+ */
+static NalInfo classifyNal(OMX_RK_VIDEO_CODINGTYPE coding,
+                           const unsigned char *hdr, int32_t left)
+{
+    NalInfo info = { false, false };
+    int32_t type;
+
+    if (left < 1)
+        return info;
+
+    if (coding == OMX_RK_VIDEO_CodingHEVC) {
+        type = (hdr[0] >> 1) & 0x3f;
+        if (type <= HEVC_NAL_VCL_END) {
+            info.vcl = true;
+            // first_slice_segment_in_pic_flag
+            info.first = (left > 2) ? ((hdr[2] & 0x80) != 0) : false;
+        } else if ((type >= HEVC_NAL_VPS && type <= HEVC_NAL_AUD) ||
+                   type == HEVC_NAL_SEI_PREFIX ||
+                   (type >= HEVC_NAL_RSV_NVCL41 && type <= HEVC_NAL_RSV_NVCL44) ||
+                   (type >= HEVC_NAL_UNSPEC48 && type <= HEVC_NAL_UNSPEC55)) {
+            info.first = true;
+        }
+    } else {
+        type = hdr[0] & 0x1f;
+        if (type >= AVC_NAL_SLICE && type <= AVC_NAL_IDR) {
+            info.vcl = true;
+            // first_mb_in_slice is ue(v), equal to 0 if the first bit is set
+            info.first = (left > 1) ? ((hdr[1] & 0x80) != 0) : false;
+        } else if ((type >= AVC_NAL_SEI && type <= AVC_NAL_AUD) ||
+                   (type >= AVC_NAL_PREFIX && type <= AVC_NAL_RSV_END)) {
+            info.first = true;
+        }
+    }
+
+    return info;
+}
+
+RKStreamPacker::RKStreamPacker()
+{
+    ALOGV("RKStreamPacker constructor");
+
+    mFp = NULL;
+    mCoding = OMX_RK_VIDEO_CodingAVC;
+    mBuf = NULL;
+    mBufSize = 0;
+    mPos = 0;
+    mScan = 0;
+    mEnd = 0;
+    mHasVcl = false;
+    mEos = false;
+    mReadOffset = 0;
+    mUseMmap = false;
+    mFd = -1;
+    mFileSize = 0;
+    mMapOffset = 0;
+}
+
+RKStreamPacker::~RKStreamPacker()
+{
+    ALOGV("RKStreamPacker destructor");
+
+    close();
+}
+
+VPU_RET RKStreamPacker::open(const char *file, OMX_RK_VIDEO_CODINGTYPE coding,
+                             bool useMmap)
+{
+    mCoding = coding;
+    mPos = mScan = mEnd = 0;
+    mHasVcl = false;
+    mEos = false;
+    mReadOffset = 0;
+    mUseMmap = useMmap;
+
+    if (mUseMmap) {
+        mFd = ::open(file, O_RDONLY);
+        if (mFd < 0) {
+            ALOGE("failed to open input file %s", file);
+            return VPU_ERR_INIT;
+        }
+
+        mFileSize = lseek64(mFd, 0, SEEK_END);
+        mMapOffset = 0;
+        mBufSize = 0;
+        if (mFileSize <= 0) {
+            // nothing to map, empty stream
+            mEos = true;
+            return VPU_OK;
+        }
+
+        if (mapWindow()) {
+            close();
+            return VPU_ERR_INIT;
+        }
+
+        return VPU_OK;
+    }
+
+    mFp = fopen(file, "rb");
+    if (mFp == NULL) {
+        ALOGE("failed to open input file %s", file);
+        return VPU_ERR_INIT;
+    }
+
+    mBufSize = PACKER_READ_SIZE * 4;
+    mBuf = (unsigned char *)malloc(mBufSize);
+    if (mBuf == NULL) {
+        ALOGE("failed to malloc packer buffer, size %d", mBufSize);
+        close();
+        return VPU_ERR_INIT;
+    }
+
+    return VPU_OK;
+}
+
+void RKStreamPacker::close()
+{
+    if (mFp != NULL) {
+        fclose(mFp);
+        mFp = NULL;
+    }
+    if (mUseMmap) {
+        if (mBuf != NULL)
+            munmap(mBuf, mBufSize);
+        if (mFd >= 0)
+            ::close(mFd);
+        mFd = -1;
+        mBuf = NULL;
+    }
+    if (mBuf != NULL) {
+        free(mBuf);
+        mBuf = NULL;
+    }
+    mBufSize = 0;
+}
+
+bool RKStreamPacker::isEos()
+{
+    return mEos && mPos >= mEnd;
+}
+
+int64_t RKStreamPacker::tell()
+{
+    return (mUseMmap ? mMapOffset : mReadOffset) + mPos;
+}
+
+VPU_RET RKStreamPacker::seek(int64_t offset)
+{
+    if (mFp == NULL && mFd < 0) {
+        ALOGW("W - open RKStreamPacker first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    mPos = mScan = mEnd = 0;
+    mHasVcl = false;
+    mEos = false;
+
+    if (mUseMmap) {
+        if (offset >= mFileSize) {
+            mEos = true;
+            return VPU_OK;
+        }
+
+        // map again from the new position
+        if (mBuf != NULL)
+            munmap(mBuf, mBufSize);
+        mBuf = NULL;
+        mBufSize = 0;
+        mMapOffset = offset;
+
+        return mapWindow();
+    }
+
+    if (fseeko(mFp, offset, SEEK_SET)) {
+        ALOGE("failed to seek input to %lld", (long long)offset);
+        return VPU_ERR_UNKNOW;
+    }
+    mReadOffset = offset;
+
+    ALOGV("seek to %lld", (long long)offset);
+
+    return VPU_OK;
+}
+
+/*
+ * Map the window which starts at the pending frame, the window is doubled
+ * if the frame doesn't fit into it. Only called from readFrame, so the
+ * frame returned last time keeps valid until the next readFrame.
+ */
+VPU_RET RKStreamPacker::mapWindow()
+{
+    int64_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+    int64_t offset = (mMapOffset + mPos) & ~pageMask;
+    int64_t size = PACKER_MMAP_WINDOW;
+    void *base;
+
+    if (mBuf != NULL && offset == mMapOffset)
+        size = (int64_t)mBufSize * 2;
+    if (size > mFileSize - offset)
+        size = mFileSize - offset;
+
+    base = mmap64(NULL, size, PROT_READ, MAP_PRIVATE, mFd, offset);
+    if (base == MAP_FAILED) {
+        ALOGE("failed to mmap input offset %lld size %lld",
+              (long long)offset, (long long)size);
+        return VPU_ERR_UNKNOW;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    if (mBuf != NULL)
+        munmap(mBuf, mBufSize);
+
+    // keep the frame and scan positions relative to the new window
+    mPos -= (int32_t)(offset - mMapOffset);
+    mScan -= (int32_t)(offset - mMapOffset);
+    mMapOffset = offset;
+    mBuf = (unsigned char *)base;
+    mBufSize = (int32_t)size;
+    mEnd = mBufSize;
+
+    if (mMapOffset + mBufSize >= mFileSize) {
+        ALOGD("saw input eos");
+        mEos = true;
+    }
+
+    return VPU_OK;
+}
+
+VPU_RET RKStreamPacker::fillBuffer()
+{
+    int32_t readsize;
+
+    if (mUseMmap)
+        return mapWindow();
+
+    // move the pending frame to the buffer head
+    if (mPos > 0) {
+        memmove(mBuf, mBuf + mPos, mEnd - mPos);
+        mReadOffset += mPos;
+        mEnd -= mPos;
+        mScan -= mPos;
+        mPos = 0;
+    }
+
+    // frame larger than buffer, enlarge it
+    if (mBufSize - mEnd < PACKER_READ_SIZE) {
+        unsigned char *buf = (unsigned char *)realloc(mBuf, mBufSize * 2);
+        if (buf == NULL) {
+            ALOGE("failed to enlarge packer buffer to %d", mBufSize * 2);
+            return VPU_ERR_UNKNOW;
+        }
+        mBuf = buf;
+        mBufSize *= 2;
+    }
+
+    readsize = fread(mBuf + mEnd, 1, mBufSize - mEnd, mFp);
+    mEnd += readsize;
+    if (feof(mFp) || ferror(mFp)) {
+        ALOGD("saw input eos");
+        mEos = true;
+    }
+
+    return VPU_OK;
+}
+
+/*
+ * Return end position of the current frame, or -1 if need more data.
+ */
+int32_t RKStreamPacker::findFrameEnd()
+{
+    while (true) {
+        const uint8_t *pos = nal_scan_find(mBuf + mScan, mBuf + mEnd);
+        if (pos == NULL) {
+            // the last two bytes may be part of a start code
+            mScan = (mEnd - 2 > mScan) ? mEnd - 2 : mScan;
+            return -1;
+        }
+
+        // make sure the slice header is complete enough to classify
+        int32_t sc = pos - mBuf;
+        int32_t hdr = sc + 3;
+        if (hdr + 3 > mEnd && !mEos) {
+            mScan = sc;
+            return -1;
+        }
+
+        NalInfo info = classifyNal(mCoding, mBuf + hdr, mEnd - hdr);
+
+        // four bytes start code, zero_byte belongs to the next nal
+        int32_t nalBegin = (sc > mPos && mBuf[sc - 1] == 0) ? sc - 1 : sc;
+        if (mHasVcl && info.first && nalBegin > mPos) {
+            mScan = nalBegin;
+            mHasVcl = false;
+            return nalBegin;
+        }
+
+        if (info.vcl)
+            mHasVcl = true;
+        mScan = hdr;
+    }
+}
+
+VPU_RET RKStreamPacker::readFrame(char **data, int32_t *size)
+{
+    int32_t end;
+
+    if (mFp == NULL && mFd < 0) {
+        ALOGW("W - open RKStreamPacker first");
+        return VPU_ERR_UNKNOW;
+    }
+
+    while (true) {
+        end = findFrameEnd();
+        if (end > 0)
+            break;
+
+        if (mEos) {
+            // the rest data is the last frame
+            end = mEnd;
+            mScan = mEnd;
+            mHasVcl = false;
+            break;
+        }
+
+        // a read or mmap error ends the stream, no empty frame after it
+        if (fillBuffer()) {
+            ALOGE("failed to read input at %lld", (long long)tell());
+            mEos = true;
+            mPos = mScan = mEnd;
+            mHasVcl = false;
+            return VPU_ERR_UNKNOW;
+        }
+    }
+
+    if (mBuf == NULL || end <= mPos)
+        return VPU_EOS_STREAM_REACHED;
+
+    *data = (char *)(mBuf + mPos);
+    *size = end - mPos;
+    mPos = end;
+
+    ALOGV("read frame size %d", *size);
+
+    return VPU_OK;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKStreamPacker
+ * date  : 2021/03/02
+ */
+
+#ifndef __RKVPU_STREAM_PACKER_H__
+#define __RKVPU_STREAM_PACKER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "rkvpu_dec_api.h"
+
+/*
+ * Annex-B access unit assembler for raw h264/h265 files.
+ *
+ * The packer finds NAL boundaries in the file and groups them into whole
+ * frames (AUD, parameter sets and SEI start a new frame, as well as the
+ * first slice of a picture), so that each RKHWDecApi::sendStream carries
+ * exactly one frame and the vpu split mode can be turned off.
+ *
+ * In mmap mode the file is mapped window by window with sequential
+ * read-ahead, and the frames returned point into the mapping directly,
+ * no fread and no copy to an intermediate buffer.
+ */
+class RKStreamPacker
+{
+public:
+    RKStreamPacker();
+    ~RKStreamPacker();
+
+    VPU_RET open(const char *file, OMX_RK_VIDEO_CODINGTYPE coding,
+                 bool useMmap = false);
+    void close();
+
+    /*
+     * get next complete frame from the stream.
+     * Note: the returned data keeps valid until the next readFrame call,
+     *       so it can be resent on VPU_EAGAIN directly.
+     *       VPU_ERR_UNKNOW is returned on read or mmap error, the rest of
+     *       the stream is dropped and isEos() turns true.
+     */
+    VPU_RET readFrame(char **data, int32_t *size);
+
+    /* no more frame left in the stream */
+    bool isEos();
+
+    /* file offset of the frame the next readFrame returns */
+    int64_t tell();
+
+    /*
+     * go on reading from @offset, which must be the start of a frame,
+     * e.g. a key frame offset of RKStreamIndex.
+     */
+    VPU_RET seek(int64_t offset);
+
+private:
+    int32_t findFrameEnd();
+    VPU_RET fillBuffer();
+    VPU_RET mapWindow();
+
+    FILE *mFp;
+    OMX_RK_VIDEO_CODINGTYPE mCoding;
+
+    unsigned char *mBuf;
+    int32_t mBufSize;
+    int32_t mPos;       /* start of the current frame */
+    int32_t mScan;      /* next position to search start code from */
+    int32_t mEnd;       /* end of valid data */
+    bool mHasVcl;       /* current frame has slice data already */
+    bool mEos;
+    int64_t mReadOffset; /* file offset of mBuf, fread mode */
+
+    /* mmap mode, mBuf is the current mapped window */
+    bool mUseMmap;
+    int32_t mFd;
+    int64_t mFileSize;
+    int64_t mMapOffset;
+};
+
+#endif  // __RKVPU_STREAM_PACKER_H__
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: stream_probe
+ * date  : 2021/04/02
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "stream_probe"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rkvpu_stream_probe.h"
+#include "rkvpu_nal_scan.h"
+
+#define H264_NAL_SPS            7
+
+/* forbidden_zero_bit 0, nuh_layer_id 0, nuh_temporal_id_plus1 > 0 */
+static bool isHevcHeader(const uint8_t *nal)
+{
+    return !(nal[0] & 0x80) && !(nal[0] & 0x01) && !(nal[1] & 0xf8) && (nal[1] & 0x07);
+}
+
+int32_t stream_probe(const uint8_t *buf, size_t size, StreamProbeInfo *info)
+{
+    const uint8_t *end = buf + size;
+    const uint8_t *pos = nal_scan_find(buf, end);
+    SpsInfo avc, hevc;
+    bool avcFound = false, hevcFound = false;
+    int32_t hevcBad = 0;
+
+    // slices may come before the first sps if the stream is cut, go on
+    while (pos != NULL && pos + 5 < end) {
+        const uint8_t *nal = pos + 3;
+        const uint8_t *next = nal_scan_find(nal, end);
+        size_t len = (next ? next : end) - nal;
+
+        if (!isHevcHeader(nal)) {
+            hevcBad++;
+        } else if (!hevcFound &&
+                   sps_is_sps(sps_nal_type(nal, OMX_RK_VIDEO_CodingHEVC), OMX_RK_VIDEO_CodingHEVC)) {
+            hevcFound = !sps_parse(nal, len, OMX_RK_VIDEO_CodingHEVC, &hevc);
+        }
+
+        // nal_ref_idc of a sps is never 0
+        if (!avcFound && !(nal[0] & 0x80) && (nal[0] & 0x60) &&
+            (nal[0] & 0x1f) == H264_NAL_SPS) {
+            avcFound = !sps_parse(nal, len, OMX_RK_VIDEO_CodingAVC, &avc);
+        }
+
+        if ((hevcFound && hevcBad == 0) || (avcFound && hevcBad > 0))
+            break;
+
+        pos = next;
+    }
+
+    if (hevcFound && (hevcBad == 0 || !avcFound)) {
+        info->coding = OMX_RK_VIDEO_CodingHEVC;
+        info->sps = hevc;
+    } else if (avcFound) {
+        info->coding = OMX_RK_VIDEO_CodingAVC;
+        info->sps = avc;
+    } else {
+        info->coding = OMX_RK_VIDEO_CodingUnused;
+        return -1;
+    }
+
+    ALOGV("probe %s %dx%d(%dx%d) %d bit chroma %d",
+          stream_probe_mime(info->coding), info->sps.width, info->sps.height,
+          info->sps.codedWidth, info->sps.codedHeight, info->sps.bitDepth,
+          info->sps.chromaFormat);
+
+    return 0;
+}
+
+int32_t stream_probe_file(const char *file, StreamProbeInfo *info)
+{
+    uint8_t *buf = NULL;
+    size_t size = 0, capacity = STREAM_PROBE_MIN_SIZE;
+    int32_t ret = -1;
+    FILE *fp;
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        ALOGE("failed to open input file %s", file);
+        return -1;
+    }
+
+    while (capacity <= STREAM_PROBE_MAX_SIZE) {
+        uint8_t *tmp = (uint8_t *)realloc(buf, capacity);
+        size_t readsize;
+
+        if (tmp == NULL) {
+            ALOGE("failed to malloc probe buffer, size %d", (int32_t)capacity);
+            break;
+        }
+        buf = tmp;
+
+        readsize = fread(buf + size, 1, capacity - size, fp);
+        size += readsize;
+
+        ret = stream_probe(buf, size, info);
+        if (!ret || feof(fp) || ferror(fp))
+            break;
+
+        capacity *= 2;
+    }
+
+    if (ret)
+        ALOGW("no sps found in the first %d bytes of %s", (int32_t)size, file);
+
+    free(buf);
+    fclose(fp);
+
+    return ret;
+}
+
+const char *stream_probe_mime(OMX_RK_VIDEO_CODINGTYPE coding)
+{
+    switch (coding) {
+    case OMX_RK_VIDEO_CodingAVC:
+        return "video/avc";
+    case OMX_RK_VIDEO_CodingHEVC:
+        return "video/hevc";
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: stream_probe
+ * date  : 2021/04/02
+ */
+
+#ifndef __RKVPU_STREAM_PROBE_H__
+#define __RKVPU_STREAM_PROBE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vpu_api.h"
+#include "rkvpu_sps.h"
+
+/* head of the file read at most when probing */
+#define STREAM_PROBE_MIN_SIZE   (4 * 1024)
+#define STREAM_PROBE_MAX_SIZE   (1024 * 1024)
+
+typedef struct StreamProbeInfo {
+    OMX_RK_VIDEO_CODINGTYPE coding;
+    SpsInfo sps;
+} StreamProbeInfo;
+
+/*
+ * Tell h264 from h265 by the nal headers of a raw Annex-B stream, and get
+ * the picture size, bit depth and chroma format from its first sps.
+ *
+ * h265 nal headers have nuh_layer_id 0 and nuh_temporal_id_plus1 > 0 in
+ * a base layer stream, which most h264 nal types break, so a stream with
+ * a valid h265 sps and only valid h265 headers is h265.
+ *
+ * Return 0 if probed, -1 if no sps found.
+ */
+int32_t stream_probe(const uint8_t *buf, size_t size, StreamProbeInfo *info);
+
+/*
+ * Probe the head of @file, the data read grows from STREAM_PROBE_MIN_SIZE
+ * until the sps is found or STREAM_PROBE_MAX_SIZE is reached.
+ */
+int32_t stream_probe_file(const char *file, StreamProbeInfo *info);
+
+/* mime type for MediaCodec, NULL if not h264 or h265 */
+const char *stream_probe_mime(OMX_RK_VIDEO_CODINGTYPE coding);
+
+#endif  // __RKVPU_STREAM_PROBE_H__
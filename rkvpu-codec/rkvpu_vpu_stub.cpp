@@ -0,0 +1,1223 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: libvpu stub
+ * date  : 2021/03/22
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "vpu_stub"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "vpu_api.h"
+#include "rkvpu_sps.h"
+
+/*
+ * Host side stand-in of libvpu, used to run the wrappers and the tests
+ * without rockchip hardware.
+ *
+ * Each packet sent becomes one frame after a fixed decode latency, the
+ * frames come out in order of a serialized "hardware". The input queue
+ * depth is bounded, decode_sendstream leaves pkt->size untouched when the
+ * queue is full, which RKHWDecApi reports as VPU_EAGAIN. With a frame pool
+ * set by VPU_API_SET_VPUMEM_CONTEXT the frames are output into the pool
+ * buffers, and decoding stalls while no pool buffer is free.
+ *
+ * The packets are taken as an IBBP gop of RKVPU_STUB_REORDER b frames
+ * between the anchors: each packet gets a display order at send time, and a
+ * decoded frame is held until the next frames are decoded as well, the one
+ * first in display order of the held frames is output, like the dpb does.
+ * The frames keep the pts of their packets, so the pts come out of order
+ * when the packets are sent with pts in decode order. With
+ * VPU_API_SET_IMMEDIATE_OUT the frames are output in decode order.
+ *
+ * The sps in the packets is parsed for the picture size. When the size
+ * changes, a frame without buffer in the new size is output first, and
+ * decoding stalls until the caller acks with VPU_API_SET_INFO_CHANGE, as
+ * the info change handshake of mpp.
+ *
+ * Stream errors are emulated by marking a packet broken, its frame and the
+ * frames after it have ErrorInfo set until the next IDR/IRAP, the same as
+ * the errors spread through the references on hardware.
+ *
+ * The encoder goes through the same queue and latency. A frame sent comes
+ * out as one packet of bitRate / framerate bytes, key frames by the gop of
+ * intraPicRate or VPU_API_ENC_SETIDRFRAME. The packets have valid nal and
+ * slice headers for the stream to be split and probed, h264 sps/pps are
+ * given as the extradata, h265 vps/sps/pps go in band in front of the
+ * first key frame only, as libmpp does by default. Input
+ * smaller than a luma plane carries no picture, as the eos of RKHWEncApi.
+ *
+ * env settings:
+ *   RKVPU_STUB_LATENCY_US  - per frame decode latency, default 2000
+ *   RKVPU_STUB_QUEUE       - input queue depth, default 4
+ *   RKVPU_STUB_REORDER     - b frames between anchors, held for reorder, default 2
+ *   RKVPU_STUB_ERROR       - every Nth packet is broken, default 0 - none
+ */
+
+#define STUB_MAX_QUEUE          64
+#define STUB_ALIGN(x, a)        (((x) + (a) - 1) & ~((a) - 1))
+#define STUB_EXTRA_SIZE         128
+
+typedef struct StubPacket {
+    int64_t pts;
+    int32_t width;
+    int32_t height;
+    int64_t readyUs;
+    int32_t eos;
+    int32_t empty;
+    int32_t error;
+    int32_t key;
+    int32_t size;       /* coded bytes, by the rate control at send time */
+    int64_t poc;        /* display order */
+} StubPacket;
+
+typedef struct StubMem StubMem;
+typedef struct StubPool StubPool;
+
+/*
+ * The memory handle keeps a reference count in VPUMemLinear_t.offset like
+ * the mpp buffers do, a buffer from the frame pool goes back to its pool
+ * when the last reference is released.
+ */
+struct StubMem {
+    RK_U32 *data;
+    int32_t ref;
+    StubPool *pool;
+};
+
+struct StubPool {
+    vpu_display_mem_pool base;
+    pthread_mutex_t lock;
+    int32_t num;
+    StubMem *bufs;
+};
+
+/* controls set before init, kept in VpuCodecContext.private_data */
+typedef struct StubOptions {
+    RK_U32 immediateOut;
+} StubOptions;
+
+typedef struct StubCtx {
+    pthread_mutex_t lock;
+    StubPacket queue[STUB_MAX_QUEUE];
+    int32_t head;
+    int32_t count;
+    int32_t depth;
+    int64_t latencyUs;
+    int64_t lastReadyUs;
+    int32_t eosQueued;
+    int32_t frameNum;
+    int32_t reorder;
+    int32_t immediateOut;
+    int64_t pocBase;        /* display order of the last key frame */
+    int64_t pocMax;
+    int32_t gopFrames;      /* frames sent after the last key frame */
+    int32_t streamWidth;    /* by the last sps sent */
+    int32_t streamHeight;
+    int32_t outWidth;       /* of the frames output */
+    int32_t outHeight;
+    int32_t infoChangeWait; /* info change output, waiting for ack */
+    int32_t errorEvery;
+    int32_t packetNum;
+    int32_t errorRun;       /* references broken until the next key frame */
+    vpu_display_mem_pool *pool;
+    /* encoder */
+    EncParameter_t encCfg;
+    int32_t gopPos;
+    int32_t idrRequest;
+    uint8_t extra[STUB_EXTRA_SIZE];
+    int32_t extraSize;
+    int32_t headerSent;     /* h265 parameter sets out */
+} StubCtx;
+
+/* rbsp writer with emulation prevention, for the parameter sets */
+typedef struct StubBits {
+    uint8_t *buf;
+    int32_t size;
+    int32_t pos;
+    uint32_t cur;
+    int32_t bits;
+    int32_t zeros;
+} StubBits;
+
+static int64_t stubNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static StubMem *stubPoolGet(StubPool *pool);
+static RK_U32 stubNewHandle();
+static void stubEncInit(VpuCodecContext *ctx, StubCtx *p);
+
+static int32_t stubEnv(const char *name, int32_t def)
+{
+    const char *val = getenv(name);
+
+    return (val != NULL) ? atoi(val) : def;
+}
+
+static RK_S32 stubInit(VpuCodecContext *ctx, RK_U8 *extraData, RK_U32 extra_size)
+{
+    StubCtx *p = (StubCtx *)calloc(1, sizeof(StubCtx));
+
+    (void)extraData;
+    (void)extra_size;
+
+    if (p == NULL)
+        return -1;
+
+    pthread_mutex_init(&p->lock, NULL);
+    p->depth = stubEnv("RKVPU_STUB_QUEUE", 4);
+    if (p->depth <= 0 || p->depth > STUB_MAX_QUEUE)
+        p->depth = 4;
+    p->latencyUs = stubEnv("RKVPU_STUB_LATENCY_US", 2000);
+    p->reorder = stubEnv("RKVPU_STUB_REORDER", 2);
+    if (p->reorder < 0 || p->reorder >= p->depth)
+        p->reorder = 0;
+    if (ctx->codecType == CODEC_DECODER && ctx->private_data != NULL)
+        p->immediateOut = ((StubOptions *)ctx->private_data)->immediateOut;
+    p->errorEvery = stubEnv("RKVPU_STUB_ERROR", 0);
+    p->streamWidth = p->outWidth = ctx->width;
+    p->streamHeight = p->outHeight = ctx->height;
+
+    ctx->vpuApiObj = p;
+    if (ctx->codecType == CODEC_ENCODER)
+        stubEncInit(ctx, p);
+
+    return 0;
+}
+
+static RK_S32 stubFlush(VpuCodecContext *ctx)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+
+    if (p == NULL)
+        return 0;
+
+    pthread_mutex_lock(&p->lock);
+    p->head = 0;
+    p->count = 0;
+    p->eosQueued = 0;
+    p->lastReadyUs = 0;
+    p->infoChangeWait = 0;
+    p->gopPos = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return 0;
+}
+
+static RK_S32 stubControl(VpuCodecContext *ctx, VPU_API_CMD cmdType, void *param)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+
+    ALOGV("control cmd 0x%x", cmdType);
+
+    switch (cmdType) {
+    case VPU_API_SET_INFO_CHANGE:
+        if (p == NULL)
+            return -1;
+        pthread_mutex_lock(&p->lock);
+        p->infoChangeWait = 0;
+        pthread_mutex_unlock(&p->lock);
+        break;
+    case VPU_API_SET_IMMEDIATE_OUT:
+        if (param == NULL)
+            return -1;
+        if (p != NULL) {
+            p->immediateOut = *(RK_U32 *)param;
+            break;
+        }
+        // before init, kept until the context is created
+        if (ctx->private_data == NULL)
+            ctx->private_data = calloc(1, sizeof(StubOptions));
+        if (ctx->private_data == NULL)
+            return -1;
+        ((StubOptions *)ctx->private_data)->immediateOut = *(RK_U32 *)param;
+        break;
+    case VPU_API_SET_VPUMEM_CONTEXT:
+        if (p == NULL)
+            return -1;
+        p->pool = (vpu_display_mem_pool *)param;
+        break;
+    case VPU_API_ENC_GETCFG:
+        if (p == NULL || param == NULL)
+            return -1;
+        pthread_mutex_lock(&p->lock);
+        memcpy(param, &p->encCfg, sizeof(EncParameter_t));
+        pthread_mutex_unlock(&p->lock);
+        break;
+    case VPU_API_ENC_SETCFG:
+        if (p == NULL || param == NULL)
+            return -1;
+        pthread_mutex_lock(&p->lock);
+        memcpy(&p->encCfg, param, sizeof(EncParameter_t));
+        pthread_mutex_unlock(&p->lock);
+        break;
+    case VPU_API_ENC_SETIDRFRAME:
+        if (p == NULL)
+            return -1;
+        pthread_mutex_lock(&p->lock);
+        p->idrRequest = 1;
+        pthread_mutex_unlock(&p->lock);
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static RK_S32 stubSendStream(VpuCodecContext *ctx, VideoPacket_t *pkt)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+    StubPacket *sp;
+    SpsInfo sps;
+    int64_t now = stubNowUs();
+
+    if (p == NULL)
+        return -1;
+
+    pthread_mutex_lock(&p->lock);
+    // an empty eos can't be told from an accepted one, always take it
+    if (p->count >= p->depth && (!(pkt->nFlags & 0x1) || p->count >= STUB_MAX_QUEUE)) {
+        // queue full, keep pkt->size for retry
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+
+    sp = &p->queue[(p->head + p->count) % STUB_MAX_QUEUE];
+    // new size takes effect from this packet on
+    if (pkt->size > 0 &&
+        sps_find_in_packet(pkt->data, pkt->size, (OMX_RK_VIDEO_CODINGTYPE)ctx->videoCoding, &sps)) {
+        p->streamWidth = sps.width;
+        p->streamHeight = sps.height;
+    }
+
+    sp->pts = pkt->pts;
+    sp->width = p->streamWidth;
+    sp->height = p->streamHeight;
+    sp->eos = (pkt->nFlags & 0x1) ? 1 : 0;
+    sp->empty = (pkt->size == 0);
+    sp->error = 0;
+
+    if (!sp->empty) {
+        OMX_RK_VIDEO_CODINGTYPE coding = (OMX_RK_VIDEO_CODINGTYPE)ctx->videoCoding;
+        const uint8_t *nal = sps_find_slice(pkt->data, pkt->size, coding);
+
+        if (nal != NULL && sps_is_irap(sps_nal_type(nal, coding), coding)) {
+            p->errorRun = 0;
+            p->pocBase = p->pocMax + 1;
+            p->gopFrames = 0;
+            sp->poc = p->pocBase;
+        } else {
+            // anchor of each group first, then the b frames before it
+            int32_t m = p->reorder + 1;
+            int32_t i = p->gopFrames++;
+
+            sp->poc = p->pocBase + (int64_t)(i / m) * m + ((i % m) ? i % m : m);
+        }
+        if (p->pocMax < sp->poc)
+            p->pocMax = sp->poc;
+        p->packetNum++;
+        if (p->errorEvery > 0 && p->packetNum % p->errorEvery == 0)
+            p->errorRun = 1;
+        sp->error = p->errorRun;
+    }
+
+    // the hardware decodes one frame after another
+    p->lastReadyUs = ((p->lastReadyUs > now) ? p->lastReadyUs : now) + p->latencyUs;
+    sp->readyUs = sp->empty ? now : p->lastReadyUs;
+
+    p->count++;
+    if (sp->eos)
+        p->eosQueued = 1;
+
+    pkt->size = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return 0;
+}
+
+/*
+ * called with lock, position of the frame to output next: the first in
+ * display order of the held frames, -1 if one of them is not decoded yet.
+ */
+static int32_t stubPickFrame(StubCtx *p)
+{
+    int32_t pick = p->head;
+    int32_t window = (p->count < p->reorder + 1) ? p->count : p->reorder + 1;
+    int64_t now = stubNowUs();
+
+    if (p->queue[pick].empty || p->immediateOut)
+        return pick;
+
+    for (int32_t i = 1; i < window; i++) {
+        int32_t pos = (p->head + i) % STUB_MAX_QUEUE;
+
+        if (p->queue[pos].empty)
+            break;
+        if (p->queue[pos].readyUs > now)
+            return -1;
+        if (p->queue[pos].poc < p->queue[pick].poc)
+            pick = pos;
+    }
+
+    return pick;
+}
+
+/* called with lock, take the entry at @pos out, the others keep their order */
+static void stubRemoveFrame(StubCtx *p, int32_t pos)
+{
+    while (pos != p->head) {
+        int32_t prev = (pos + STUB_MAX_QUEUE - 1) % STUB_MAX_QUEUE;
+
+        p->queue[pos] = p->queue[prev];
+        pos = prev;
+    }
+
+    p->head = (p->head + 1) % STUB_MAX_QUEUE;
+    p->count--;
+}
+
+static RK_S32 stubGetFrame(VpuCodecContext *ctx, DecoderOut_t *aDecOut)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+    VPU_FRAME *vframe = (VPU_FRAME *)aDecOut->data;
+    StubMem *mem = NULL;
+    StubPacket sp;
+    int32_t pick;
+
+    if (p == NULL)
+        return -1;
+
+    aDecOut->size = 0;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->count == 0) {
+        int32_t eos = p->eosQueued;
+        pthread_mutex_unlock(&p->lock);
+        return eos ? VPU_API_EOS_STREAM_REACHED : 0;
+    }
+
+    if (p->infoChangeWait) {
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+
+    if (p->queue[p->head].readyUs > stubNowUs()) {
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+
+    // held until the frames after it are decoded, flushed out on eos
+    if (!p->queue[p->head].empty && !p->immediateOut && !p->eosQueued) {
+        if (p->count <= p->reorder ||
+            p->queue[(p->head + p->reorder) % STUB_MAX_QUEUE].readyUs > stubNowUs()) {
+            pthread_mutex_unlock(&p->lock);
+            return 0;
+        }
+    }
+
+    pick = stubPickFrame(p);
+    if (pick < 0) {
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+    sp = p->queue[pick];
+
+    // size changed, report it with an empty frame and wait for the ack
+    if (!sp.empty && (sp.width != p->outWidth || sp.height != p->outHeight)) {
+        p->outWidth = sp.width;
+        p->outHeight = sp.height;
+        p->infoChangeWait = 1;
+        pthread_mutex_unlock(&p->lock);
+
+        ALOGD("info change to %dx%d", sp.width, sp.height);
+        memset(vframe, 0, sizeof(VPU_FRAME));
+        vframe->FrameWidth = STUB_ALIGN(sp.width, 16);
+        vframe->FrameHeight = STUB_ALIGN(sp.height, 16);
+        vframe->DisplayWidth = sp.width;
+        vframe->DisplayHeight = sp.height;
+        vframe->CodingType = ctx->videoCoding;
+        vframe->ColorType = VPU_OUTPUT_FORMAT_YUV420_SEMIPLANAR;
+        aDecOut->size = sizeof(VPU_FRAME);
+        aDecOut->timeUs = sp.pts;
+
+        return 0;
+    }
+
+    // all pool buffers held by the caller, decoder stalls
+    if (!sp.empty && p->pool != NULL) {
+        if (p->pool->buff_size < STUB_ALIGN(sp.width, 16) * STUB_ALIGN(sp.height, 16) * 3 / 2) {
+            pthread_mutex_unlock(&p->lock);
+            ALOGE("pool buffer %d too small for %dx%d", p->pool->buff_size,
+                  sp.width, sp.height);
+            return -1;
+        }
+
+        mem = stubPoolGet((StubPool *)p->pool);
+        if (mem == NULL) {
+            pthread_mutex_unlock(&p->lock);
+            return 0;
+        }
+    }
+
+    stubRemoveFrame(p, pick);
+    pthread_mutex_unlock(&p->lock);
+
+    if (sp.empty)
+        return sp.eos ? VPU_API_EOS_STREAM_REACHED : 0;
+
+    memset(vframe, 0, sizeof(VPU_FRAME));
+    vframe->FrameWidth = STUB_ALIGN(sp.width, 16);
+    vframe->FrameHeight = STUB_ALIGN(sp.height, 16);
+    vframe->DisplayWidth = sp.width;
+    vframe->DisplayHeight = sp.height;
+    vframe->CodingType = ctx->videoCoding;
+    vframe->ColorType = VPU_OUTPUT_FORMAT_YUV420_SEMIPLANAR;
+    vframe->DecodeFrmNum = p->frameNum++;
+    vframe->ErrorInfo = sp.error ? VPU_FRAME_ERR_UNKNOW : 0;
+    vframe->ShowTime.TimeLow = (RK_U32)(sp.pts & 0xffffffff);
+    vframe->ShowTime.TimeHigh = (RK_U32)((RK_U64)sp.pts >> 32);
+
+    if (mem != NULL) {
+        vframe->vpumem.vir_addr = mem->data;
+        vframe->vpumem.phy_addr = stubNewHandle();
+        vframe->vpumem.size = p->pool->buff_size;
+        vframe->vpumem.offset = (RK_U32 *)mem;
+    } else if (VPUMallocLinear(&vframe->vpumem,
+                               vframe->FrameWidth * vframe->FrameHeight * 3 / 2)) {
+        ALOGE("failed to malloc frame buffer");
+        return -1;
+    }
+
+    aDecOut->size = sizeof(VPU_FRAME);
+    aDecOut->timeUs = sp.pts;
+
+    return 0;
+}
+
+static void stubPutByte(StubBits *bs, uint8_t byte)
+{
+    if (bs->pos + 2 > bs->size)
+        return;
+
+    if (bs->zeros >= 2 && byte <= 3) {
+        bs->buf[bs->pos++] = 3;
+        bs->zeros = 0;
+    }
+    bs->buf[bs->pos++] = byte;
+    bs->zeros = byte ? 0 : bs->zeros + 1;
+}
+
+static void stubPutBits(StubBits *bs, uint32_t val, int32_t n)
+{
+    for (int32_t i = n - 1; i >= 0; i--) {
+        bs->cur = (bs->cur << 1) | ((val >> i) & 1);
+        if (++bs->bits == 8) {
+            stubPutByte(bs, (uint8_t)bs->cur);
+            bs->cur = 0;
+            bs->bits = 0;
+        }
+    }
+}
+
+static void stubPutUe(StubBits *bs, uint32_t val)
+{
+    int32_t len = 0;
+
+    for (uint32_t v = val + 1; v; v >>= 1)
+        len++;
+
+    stubPutBits(bs, 0, len - 1);
+    stubPutBits(bs, val + 1, len);
+}
+
+static void stubPutTrailing(StubBits *bs)
+{
+    stubPutBits(bs, 1, 1);
+    while (bs->bits)
+        stubPutBits(bs, 0, 1);
+}
+
+static void stubPutStartCode(StubBits *bs)
+{
+    static const uint8_t code[4] = { 0, 0, 0, 1 };
+
+    if (bs->pos + 4 > bs->size)
+        return;
+
+    memcpy(bs->buf + bs->pos, code, 4);
+    bs->pos += 4;
+    bs->zeros = 0;
+}
+
+/* h264 baseline sps and pps, with start codes as the libvpu extradata */
+static int32_t stubEncHeader(StubCtx *p)
+{
+    EncParameter_t *cfg = &p->encCfg;
+    int32_t mbWidth = STUB_ALIGN(cfg->width, 16) / 16;
+    int32_t mbHeight = STUB_ALIGN(cfg->height, 16) / 16;
+    int32_t cropRight = (mbWidth * 16 - cfg->width) / 2;
+    int32_t cropBottom = (mbHeight * 16 - cfg->height) / 2;
+    StubBits bs;
+
+    memset(&bs, 0, sizeof(bs));
+    bs.buf = p->extra;
+    bs.size = sizeof(p->extra);
+
+    stubPutStartCode(&bs);
+    stubPutBits(&bs, 0x67, 8);
+    stubPutBits(&bs, cfg->profileIdc ? cfg->profileIdc : 66, 8);
+    stubPutBits(&bs, 0xc0, 8);                  // constraint_set0/1
+    stubPutBits(&bs, cfg->levelIdc ? cfg->levelIdc : 41, 8);
+    stubPutUe(&bs, 0);                          // seq_parameter_set_id
+    stubPutUe(&bs, 0);                          // log2_max_frame_num_minus4
+    stubPutUe(&bs, 2);                          // pic_order_cnt_type
+    stubPutUe(&bs, 1);                          // max_num_ref_frames
+    stubPutBits(&bs, 0, 1);
+    stubPutUe(&bs, mbWidth - 1);
+    stubPutUe(&bs, mbHeight - 1);
+    stubPutBits(&bs, 1, 1);                     // frame_mbs_only_flag
+    stubPutBits(&bs, 1, 1);                     // direct_8x8_inference_flag
+    stubPutBits(&bs, (cropRight || cropBottom) ? 1 : 0, 1);
+    if (cropRight || cropBottom) {
+        stubPutUe(&bs, 0);
+        stubPutUe(&bs, cropRight);
+        stubPutUe(&bs, 0);
+        stubPutUe(&bs, cropBottom);
+    }
+    stubPutBits(&bs, 0, 1);                     // vui_parameters_present_flag
+    stubPutTrailing(&bs);
+
+    stubPutStartCode(&bs);
+    stubPutBits(&bs, 0x68, 8);
+    stubPutUe(&bs, 0);                          // pic_parameter_set_id
+    stubPutUe(&bs, 0);                          // seq_parameter_set_id
+    stubPutBits(&bs, 0, 2);                     // cavlc, no bottom_field_pic_order
+    stubPutUe(&bs, 0);                          // num_slice_groups_minus1
+    stubPutUe(&bs, 0);                          // num_ref_idx_l0_default_active_minus1
+    stubPutUe(&bs, 0);                          // num_ref_idx_l1_default_active_minus1
+    stubPutBits(&bs, 0, 3);                     // no weighted prediction
+    stubPutUe(&bs, 0);                          // pic_init_qp_minus26
+    stubPutUe(&bs, 0);                          // pic_init_qs_minus26
+    stubPutUe(&bs, 0);                          // chroma_qp_index_offset
+    stubPutBits(&bs, 0x4, 3);                   // deblocking_filter_control_present_flag
+    stubPutTrailing(&bs);
+
+    return bs.pos;
+}
+
+/* general profile_tier_level of h265 Main, level 4.1, no sub layers */
+static void stubPutHevcPtl(StubBits *bs)
+{
+    stubPutBits(bs, 1, 8);                      // profile_space 0, tier 0, Main
+    stubPutBits(bs, 0x6000, 16);                // profile_compatibility_flag[1][2]
+    stubPutBits(bs, 0, 16);
+    stubPutBits(bs, 0x9, 4);                    // progressive, frame only
+    stubPutBits(bs, 0, 22);                     // reserved zero 43 bits and 1 bit
+    stubPutBits(bs, 0, 22);
+    stubPutBits(bs, 123, 8);                    // general_level_idc 4.1
+}
+
+/* h265 Main vps, sps and pps with start codes, sent in band */
+static int32_t stubEncHevcHeader(StubCtx *p)
+{
+    EncParameter_t *cfg = &p->encCfg;
+    int32_t width = STUB_ALIGN(cfg->width, 8);
+    int32_t height = STUB_ALIGN(cfg->height, 8);
+    int32_t cropRight = (width - cfg->width) / 2;
+    int32_t cropBottom = (height - cfg->height) / 2;
+    StubBits bs;
+
+    memset(&bs, 0, sizeof(bs));
+    bs.buf = p->extra;
+    bs.size = sizeof(p->extra);
+
+    stubPutStartCode(&bs);
+    stubPutBits(&bs, 32 << 9 | 1, 16);          // VPS_NUT
+    stubPutBits(&bs, 0, 4);                     // vps_video_parameter_set_id
+    stubPutBits(&bs, 3, 2);                     // base layer internal and available
+    stubPutBits(&bs, 0, 6);                     // vps_max_layers_minus1
+    stubPutBits(&bs, 0, 3);                     // vps_max_sub_layers_minus1
+    stubPutBits(&bs, 1, 1);                     // vps_temporal_id_nesting_flag
+    stubPutBits(&bs, 0xffff, 16);
+    stubPutHevcPtl(&bs);
+    stubPutBits(&bs, 1, 1);                     // sub_layer_ordering_info_present
+    stubPutUe(&bs, 1);                          // max_dec_pic_buffering_minus1
+    stubPutUe(&bs, 0);                          // max_num_reorder_pics
+    stubPutUe(&bs, 0);                          // max_latency_increase_plus1
+    stubPutBits(&bs, 0, 6);                     // vps_max_layer_id
+    stubPutUe(&bs, 0);                          // vps_num_layer_sets_minus1
+    stubPutBits(&bs, 0, 2);                     // no timing info, no extension
+    stubPutTrailing(&bs);
+
+    stubPutStartCode(&bs);
+    stubPutBits(&bs, 33 << 9 | 1, 16);          // SPS_NUT
+    stubPutBits(&bs, 0, 4);                     // sps_video_parameter_set_id
+    stubPutBits(&bs, 0, 3);                     // sps_max_sub_layers_minus1
+    stubPutBits(&bs, 1, 1);                     // sps_temporal_id_nesting_flag
+    stubPutHevcPtl(&bs);
+    stubPutUe(&bs, 0);                          // sps_seq_parameter_set_id
+    stubPutUe(&bs, 1);                          // chroma_format_idc 4:2:0
+    stubPutUe(&bs, width);
+    stubPutUe(&bs, height);
+    stubPutBits(&bs, (cropRight || cropBottom) ? 1 : 0, 1);
+    if (cropRight || cropBottom) {
+        stubPutUe(&bs, 0);
+        stubPutUe(&bs, cropRight);
+        stubPutUe(&bs, 0);
+        stubPutUe(&bs, cropBottom);
+    }
+    stubPutUe(&bs, 0);                          // bit_depth_luma_minus8
+    stubPutUe(&bs, 0);                          // bit_depth_chroma_minus8
+    stubPutUe(&bs, 4);                          // log2_max_pic_order_cnt_lsb_minus4
+    stubPutBits(&bs, 1, 1);                     // sub_layer_ordering_info_present
+    stubPutUe(&bs, 1);
+    stubPutUe(&bs, 0);
+    stubPutUe(&bs, 0);
+    stubPutUe(&bs, 0);                          // min coding block 8
+    stubPutUe(&bs, 3);                          // ctb 64
+    stubPutUe(&bs, 0);                          // min transform block 4
+    stubPutUe(&bs, 3);                          // max transform block 32
+    stubPutUe(&bs, 0);                          // max_transform_hierarchy_depth_inter
+    stubPutUe(&bs, 0);                          // max_transform_hierarchy_depth_intra
+    stubPutBits(&bs, 0, 4);                     // no scaling list, amp, sao, pcm
+    stubPutUe(&bs, 0);                          // num_short_term_ref_pic_sets
+    stubPutBits(&bs, 0, 5);                     // no long term, tmvp, smoothing, vui, ext
+    stubPutTrailing(&bs);
+
+    stubPutStartCode(&bs);
+    stubPutBits(&bs, 34 << 9 | 1, 16);          // PPS_NUT
+    stubPutUe(&bs, 0);                          // pps_pic_parameter_set_id
+    stubPutUe(&bs, 0);                          // pps_seq_parameter_set_id
+    stubPutBits(&bs, 0, 7);                     // no dependent slices ... cabac_init
+    stubPutUe(&bs, 0);                          // num_ref_idx_l0_default_active_minus1
+    stubPutUe(&bs, 0);                          // num_ref_idx_l1_default_active_minus1
+    stubPutUe(&bs, 0);                          // init_qp_minus26
+    stubPutBits(&bs, 0, 3);                     // no constrained intra, skip, cu qp delta
+    stubPutUe(&bs, 0);                          // pps_cb_qp_offset
+    stubPutUe(&bs, 0);                          // pps_cr_qp_offset
+    stubPutBits(&bs, 0, 10);                    // no offsets ... lists_modification
+    stubPutUe(&bs, 0);                          // log2_parallel_merge_level_minus2
+    stubPutBits(&bs, 0, 2);                     // no header extension, no pps extension
+    stubPutTrailing(&bs);
+
+    return bs.pos;
+}
+
+static void stubEncInit(VpuCodecContext *ctx, StubCtx *p)
+{
+    // the wrapper sets the parameters in private_data before init
+    if (ctx->private_data != NULL) {
+        memcpy(&p->encCfg, ctx->private_data, sizeof(EncParameter_t));
+    } else {
+        p->encCfg.width = ctx->width;
+        p->encCfg.height = ctx->height;
+    }
+    p->reorder = 0;
+
+    if (ctx->videoCoding == OMX_RK_VIDEO_CodingAVC) {
+        ctx->extradata = p->extra;
+        ctx->extradata_size = stubEncHeader(p);
+    } else {
+        // no extradata, in band with the first key frame
+        p->extraSize = stubEncHevcHeader(p);
+        p->headerSent = 0;
+    }
+}
+
+/* bytes of one coded frame by the rate control target */
+static int32_t stubEncFrameSize(StubCtx *p, int32_t key)
+{
+    EncParameter_t *cfg = &p->encCfg;
+    int32_t luma = cfg->width * cfg->height;
+    int32_t size;
+
+    if (cfg->bitRate > 0 && cfg->framerate > 0)
+        size = cfg->bitRate / 8 / cfg->framerate;
+    else
+        size = luma / 8;
+
+    // an intra frame costs a few times of the inter ones
+    if (key)
+        size *= 4;
+
+    if (size > luma)
+        size = luma;
+
+    return (size < 16) ? 16 : size;
+}
+
+static RK_S32 stubSendFrame(VpuCodecContext *ctx, EncInputStream_t *aEncInStrm)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+    StubPacket *sp;
+    int64_t now = stubNowUs();
+
+    if (p == NULL)
+        return -1;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->count >= p->depth &&
+        (!(aEncInStrm->nFlags & 0x1) || p->count >= STUB_MAX_QUEUE)) {
+        // queue full, keep aEncInStrm->size for retry
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+
+    sp = &p->queue[(p->head + p->count) % STUB_MAX_QUEUE];
+    memset(sp, 0, sizeof(StubPacket));
+    sp->pts = aEncInStrm->timeUs;
+    sp->width = p->encCfg.width;
+    sp->height = p->encCfg.height;
+    sp->eos = (aEncInStrm->nFlags & 0x1) ? 1 : 0;
+    sp->empty = (aEncInStrm->size < p->encCfg.width * p->encCfg.height);
+
+    if (!sp->empty) {
+        if (p->gopPos == 0 || p->idrRequest) {
+            sp->key = 1;
+            p->gopPos = 0;
+            p->idrRequest = 0;
+        }
+        p->gopPos++;
+        if (p->encCfg.intraPicRate > 0 && p->gopPos >= p->encCfg.intraPicRate)
+            p->gopPos = 0;
+
+        sp->size = stubEncFrameSize(p, sp->key);
+    }
+
+    p->lastReadyUs = ((p->lastReadyUs > now) ? p->lastReadyUs : now) + p->latencyUs;
+    sp->readyUs = sp->empty ? now : p->lastReadyUs;
+
+    p->count++;
+    if (sp->eos)
+        p->eosQueued = 1;
+
+    aEncInStrm->size = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    return 0;
+}
+
+static RK_S32 stubGetStream(VpuCodecContext *ctx, EncoderOut_t *aEncOut)
+{
+    StubCtx *p = (StubCtx *)ctx->vpuApiObj;
+    StubPacket sp;
+    uint8_t *data;
+    int32_t size, pos = 0, header = 0;
+
+    if (p == NULL)
+        return -1;
+
+    aEncOut->size = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (true) {
+        int64_t now = stubNowUs();
+
+        if (p->count == 0) {
+            int32_t eos = p->eosQueued;
+            pthread_mutex_unlock(&p->lock);
+            return eos ? VPU_API_EOS_STREAM_REACHED : 0;
+        }
+
+        sp = p->queue[p->head];
+        if (sp.readyUs <= now)
+            break;
+
+        /*
+         * RKHWEncApi takes an empty output after input eos as the end,
+         * drain the frames left blocking like the legacy encoder does.
+         */
+        if (!p->eosQueued) {
+            pthread_mutex_unlock(&p->lock);
+            return 0;
+        }
+
+        pthread_mutex_unlock(&p->lock);
+        usleep(sp.readyUs - now);
+        pthread_mutex_lock(&p->lock);
+    }
+
+    p->head = (p->head + 1) % STUB_MAX_QUEUE;
+    p->count--;
+    size = sp.size;
+    pthread_mutex_unlock(&p->lock);
+
+    if (sp.empty)
+        return sp.eos ? VPU_API_EOS_STREAM_REACHED : 0;
+
+    if (ctx->videoCoding == OMX_RK_VIDEO_CodingHEVC && sp.key && !p->headerSent) {
+        header = p->extraSize;
+        p->headerSent = 1;
+    }
+
+    // freed by the caller
+    data = (uint8_t *)malloc(header + size);
+    if (data == NULL) {
+        ALOGE("failed to malloc stream buffer");
+        return -1;
+    }
+
+    // h264 goes out without start code, h265 with it
+    if (ctx->videoCoding == OMX_RK_VIDEO_CodingAVC) {
+        data[pos++] = sp.key ? 0x65 : 0x41;
+        data[pos++] = sp.key ? 0x88 : 0x9a;     // first_mb_in_slice 0, I / P
+    } else {
+        memcpy(data, p->extra, header);
+        pos = header;
+        memcpy(data + pos, "\x00\x00\x00\x01", 4);
+        pos += 4;
+        data[pos++] = sp.key ? (19 << 1) : (1 << 1);    // IDR_W_RADL / TRAIL_R
+        data[pos++] = 0x01;
+        data[pos++] = 0xa0;                     // first_slice_segment_in_pic_flag
+    }
+    memset(data + pos, 0xa5, header + size - pos);
+
+    aEncOut->data = data;
+    aEncOut->size = header + size;
+    aEncOut->timeUs = sp.pts;
+    aEncOut->keyFrame = sp.key;
+
+    return 0;
+}
+
+RK_S32 vpu_open_context(VpuCodecContext **ctx)
+{
+    VpuCodecContext *s = *ctx;
+
+    if (s == NULL) {
+        s = (VpuCodecContext *)calloc(1, sizeof(VpuCodecContext));
+        if (s == NULL)
+            return -1;
+    } else {
+        memset(s, 0, sizeof(VpuCodecContext));
+    }
+
+    s->init = stubInit;
+    s->flush = stubFlush;
+    s->control = stubControl;
+    s->decode_sendstream = stubSendStream;
+    s->decode_getframe = stubGetFrame;
+    s->encoder_sendframe = stubSendFrame;
+    s->encoder_getstream = stubGetStream;
+
+    *ctx = s;
+
+    return 0;
+}
+
+RK_S32 vpu_close_context(VpuCodecContext **ctx)
+{
+    VpuCodecContext *s = *ctx;
+
+    if (s == NULL)
+        return 0;
+
+    if (s->vpuApiObj != NULL) {
+        StubCtx *p = (StubCtx *)s->vpuApiObj;
+        pthread_mutex_destroy(&p->lock);
+        free(p);
+    }
+    free(s->private_data);
+    free(s);
+    *ctx = NULL;
+
+    return 0;
+}
+
+/*
+ * vpu memory handle interface, plain heap memory on host
+ */
+static pthread_mutex_t sMemLock = PTHREAD_MUTEX_INITIALIZER;
+static RK_U32 sMemHandle = 0;
+
+static RK_U32 stubNewHandle()
+{
+    RK_U32 hdl;
+
+    pthread_mutex_lock(&sMemLock);
+    hdl = ++sMemHandle;
+    pthread_mutex_unlock(&sMemLock);
+
+    return hdl;
+}
+
+static void stubMemPut(StubMem *mem)
+{
+    if (mem->pool != NULL) {
+        pthread_mutex_lock(&mem->pool->lock);
+        if (mem->ref > 0)
+            mem->ref--;
+        pthread_mutex_unlock(&mem->pool->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&sMemLock);
+    int32_t ref = --mem->ref;
+    pthread_mutex_unlock(&sMemLock);
+
+    if (ref == 0) {
+        free(mem->data);
+        free(mem);
+    }
+}
+
+static void stubMemGet(StubMem *mem)
+{
+    pthread_mutex_t *lock = (mem->pool != NULL) ? &mem->pool->lock : &sMemLock;
+
+    pthread_mutex_lock(lock);
+    mem->ref++;
+    pthread_mutex_unlock(lock);
+}
+
+RK_S32 VPUMallocLinear(VPUMemLinear_t *p, RK_U32 size)
+{
+    StubMem *mem = (StubMem *)malloc(sizeof(StubMem));
+
+    if (mem == NULL)
+        return -1;
+
+    mem->data = (RK_U32 *)malloc(size);
+    if (mem->data == NULL) {
+        free(mem);
+        return -1;
+    }
+    mem->ref = 1;
+    mem->pool = NULL;
+
+    p->vir_addr = mem->data;
+    p->phy_addr = stubNewHandle();
+    p->size = size;
+    p->offset = (RK_U32 *)mem;
+
+    return 0;
+}
+
+RK_S32 VPUFreeLinear(VPUMemLinear_t *p)
+{
+    if (p->offset != NULL)
+        stubMemPut((StubMem *)p->offset);
+
+    p->vir_addr = NULL;
+    p->phy_addr = 0;
+    p->offset = NULL;
+
+    return 0;
+}
+
+RK_S32 VPUMemDuplicate(VPUMemLinear_t *dst, VPUMemLinear_t *src)
+{
+    if (src->offset != NULL)
+        stubMemGet((StubMem *)src->offset);
+
+    *dst = *src;
+
+    return 0;
+}
+
+RK_S32 VPUMemLink(VPUMemLinear_t *p)
+{
+    (void)p;
+    return 0;
+}
+
+/* the handle stands for the dma-buf fd */
+RK_S32 VPUMemGetFD(VPUMemLinear_t *p)
+{
+    return (RK_S32)p->phy_addr;
+}
+
+/* heap memory, nothing to sync with the "hardware" */
+RK_S32 VPUMemClean(VPUMemLinear_t *p)
+{
+    (void)p;
+    return 0;
+}
+
+RK_S32 VPUMemFlush(VPUMemLinear_t *p)
+{
+    (void)p;
+    return 0;
+}
+
+RK_S32 VPUMemInvalidate(VPUMemLinear_t *p)
+{
+    (void)p;
+    return 0;
+}
+
+static StubMem *stubPoolGet(StubPool *pool)
+{
+    StubMem *mem = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int32_t i = 0; i < pool->num; i++) {
+        if (pool->bufs[i].ref == 0) {
+            mem = &pool->bufs[i];
+            mem->ref = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return mem;
+}
+
+static RK_S32 stubPoolCommitHdl(vpu_display_mem_pool *p, RK_S32 hdl, RK_S32 size)
+{
+    (void)p;
+    (void)hdl;
+    (void)size;
+
+    // external buffers are not emulated
+    return -1;
+}
+
+static void *stubPoolGetFree(vpu_display_mem_pool *p)
+{
+    return stubPoolGet((StubPool *)p);
+}
+
+/* a pool only knows its own buffers, as the libvpu pools do */
+static int32_t stubPoolOwns(vpu_display_mem_pool *p, VPUMemLinear_t *mem)
+{
+    if (((StubMem *)mem->offset)->pool != (StubPool *)p) {
+        ALOGE("buffer %p is not in pool %p", mem->vir_addr, p);
+        return 0;
+    }
+
+    return 1;
+}
+
+static RK_S32 stubPoolIncUsed(vpu_display_mem_pool *p, void *hdl)
+{
+    VPUMemLinear_t *mem = (VPUMemLinear_t *)hdl;
+
+    if (mem->offset != NULL) {
+        if (!stubPoolOwns(p, mem))
+            return -1;
+        stubMemGet((StubMem *)mem->offset);
+    }
+
+    return 0;
+}
+
+static RK_S32 stubPoolPutUsed(vpu_display_mem_pool *p, void *hdl)
+{
+    VPUMemLinear_t *mem = (VPUMemLinear_t *)hdl;
+
+    if (mem->offset != NULL) {
+        if (!stubPoolOwns(p, mem))
+            return -1;
+        stubMemPut((StubMem *)mem->offset);
+    }
+
+    return 0;
+}
+
+static RK_S32 stubPoolReset(vpu_display_mem_pool *p)
+{
+    StubPool *pool = (StubPool *)p;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int32_t i = 0; i < pool->num; i++)
+        pool->bufs[i].ref = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+static RK_S32 stubPoolGetUnusedNum(vpu_display_mem_pool *p)
+{
+    StubPool *pool = (StubPool *)p;
+    int32_t unused = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int32_t i = 0; i < pool->num; i++) {
+        if (pool->bufs[i].ref == 0)
+            unused++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return unused;
+}
+
+int create_vpu_memory_pool_allocator(vpu_display_mem_pool **ipool, int num, int size)
+{
+    StubPool *pool = (StubPool *)calloc(1, sizeof(StubPool));
+
+    if (pool == NULL)
+        return -1;
+
+    pool->bufs = (StubMem *)calloc(num, sizeof(StubMem));
+    if (pool->bufs == NULL) {
+        free(pool);
+        return -1;
+    }
+
+    for (int32_t i = 0; i < num; i++) {
+        pool->bufs[i].data = (RK_U32 *)malloc(size);
+        if (pool->bufs[i].data == NULL) {
+            pool->num = i;
+            release_vpu_memory_pool_allocator(&pool->base);
+            return -1;
+        }
+        pool->bufs[i].pool = pool;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->num = num;
+    pool->base.commit_hdl = stubPoolCommitHdl;
+    pool->base.get_free = stubPoolGetFree;
+    pool->base.inc_used = stubPoolIncUsed;
+    pool->base.put_used = stubPoolPutUsed;
+    pool->base.reset = stubPoolReset;
+    pool->base.get_unused_num = stubPoolGetUnusedNum;
+    pool->base.buff_size = size;
+
+    *ipool = &pool->base;
+
+    return 0;
+}
+
+void release_vpu_memory_pool_allocator(vpu_display_mem_pool *ipool)
+{
+    StubPool *pool = (StubPool *)ipool;
+
+    if (pool == NULL)
+        return;
+
+    for (int32_t i = 0; i < pool->num; i++)
+        free(pool->bufs[i].data);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->bufs);
+    free(pool);
+}
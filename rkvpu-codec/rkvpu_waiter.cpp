@@ -0,0 +1,150 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKPollWaiter
+ * date  : 2021/03/10
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKPollWaiter"
+#include <utils/Log.h>
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "rkvpu_waiter.h"
+
+#define WAIT_SPIN_COUNT         4
+#define WAIT_MIN_SLEEP_US       100
+/* nothing signals the codec output, this bounds the latency added */
+#define WAIT_MAX_SLEEP_US       1000
+
+static int64_t getNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+RKPollWaiter::RKPollWaiter()
+{
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    mSignaled = 0;
+    mDeadlineUs = -1;
+    mStartUs = 0;
+    mSpinLeft = 0;
+    mSleepUs = 0;
+    mExpectUs = WAIT_MIN_SLEEP_US;
+    mPolled = false;
+
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+RKPollWaiter::~RKPollWaiter()
+{
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+void RKPollWaiter::begin(int32_t timeoutMs)
+{
+    mStartUs = getNowUs();
+    mDeadlineUs = (timeoutMs < 0) ? -1 : mStartUs + (int64_t)timeoutMs * 1000;
+    mSpinLeft = WAIT_SPIN_COUNT;
+    mSleepUs = 0;
+    mPolled = false;
+    mStats.waits++;
+}
+
+bool RKPollWaiter::wait()
+{
+    int64_t now = getNowUs();
+
+    if (mPolled)
+        mStats.wastedWakeups++;
+
+    if (mDeadlineUs >= 0 && now >= mDeadlineUs) {
+        mStats.timeouts++;
+        return false;
+    }
+
+    if (mSpinLeft > 0) {
+        // output normally comes soon after the input, spin a while first
+        mSpinLeft--;
+        sched_yield();
+    } else {
+        if (mSleepUs == 0) {
+            // sleep until the time the output is expected
+            mSleepUs = mExpectUs - (now - mStartUs);
+        } else {
+            mSleepUs *= 2;
+        }
+        if (mSleepUs < WAIT_MIN_SLEEP_US)
+            mSleepUs = WAIT_MIN_SLEEP_US;
+        if (mSleepUs > WAIT_MAX_SLEEP_US)
+            mSleepUs = WAIT_MAX_SLEEP_US;
+
+        int64_t wakeUs = now + mSleepUs;
+        if (mDeadlineUs >= 0 && wakeUs > mDeadlineUs)
+            wakeUs = mDeadlineUs;
+
+        struct timespec ts;
+        ts.tv_sec = wakeUs / 1000000;
+        ts.tv_nsec = (wakeUs % 1000000) * 1000;
+
+        pthread_mutex_lock(&mLock);
+        if (!mSignaled)
+            pthread_cond_timedwait(&mCond, &mLock, &ts);
+        mSignaled = 0;
+        pthread_mutex_unlock(&mLock);
+    }
+
+    mStats.wakeups++;
+    mPolled = true;
+
+    return true;
+}
+
+void RKPollWaiter::done()
+{
+    int64_t elapsed = getNowUs() - mStartUs;
+
+    // moving average of the wait time, the first sleep targets it
+    mExpectUs = (mExpectUs * 7 + elapsed) / 8;
+    mPolled = false;
+}
+
+void RKPollWaiter::signal()
+{
+    pthread_mutex_lock(&mLock);
+    mSignaled = 1;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mLock);
+}
+
+void RKPollWaiter::getStats(WaitStats *stats)
+{
+    *stats = mStats;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKPollWaiter
+ * date  : 2021/03/10
+ */
+
+#ifndef __RKVPU_WAITER_H__
+#define __RKVPU_WAITER_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Wait helper for the async vpu interfaces which have no pollable fd.
+ *
+ * The caller polls the codec, and calls wait() between polls. A wait spins
+ * a few rounds first, then sleeps on a condition variable with a timeout
+ * learned from how long the previous outputs took, so the thread neither
+ * burns cpu nor wakes up a thousand times a second. signal() is called when
+ * new input is queued to end the sleep early.
+ *
+ * The codec has no event for its output, so an output ready while the
+ * thread sleeps is seen at the next poll. One sleep is 1 ms at most, the
+ * latency added to a frame is bounded by that, no worse than the usleep(1000)
+ * polling, and there are no wakeups at all while output comes in the spin.
+ */
+class RKPollWaiter
+{
+public:
+    RKPollWaiter();
+    ~RKPollWaiter();
+
+    typedef struct WaitStats {
+        int64_t waits;          /* wait rounds, one per blocking call */
+        int64_t wakeups;        /* polls after spin or sleep */
+        int64_t wastedWakeups;  /* polls that got nothing */
+        int64_t timeouts;       /* wait rounds ended by deadline */
+    } WaitStats_t;
+
+    /* start a wait round, @timeoutMs < 0 means wait forever */
+    void begin(int32_t timeoutMs);
+
+    /*
+     * called after a poll missed, return true when it's time to poll
+     * again, or false if the deadline passed.
+     */
+    bool wait();
+
+    /* the poll got result, end of the wait round */
+    void done();
+
+    /* wake up the waiting thread */
+    void signal();
+
+    void getStats(WaitStats *stats);
+
+private:
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    int32_t mSignaled;
+
+    int64_t mDeadlineUs;
+    int64_t mStartUs;
+    int32_t mSpinLeft;
+    int64_t mSleepUs;
+    int64_t mExpectUs;      /* expected wait time of one round */
+    bool mPolled;
+
+    WaitStats mStats;
+};
+
+#endif  // __RKVPU_WAITER_H__
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKYuvWriter
+ * date  : 2021/03/24
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "RKYuvWriter"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "rkvpu_yuv_writer.h"
+
+/* called on the writer thread, the frame goes back to decoder */
+static void releaseFrame(void *opaque)
+{
+    delete (DecodedFrame *)opaque;
+}
+
+static void releaseConverted(void *opaque)
+{
+    free(opaque);
+}
+
+/*
+ * the format a frame is converted to, COLOR_FORMAT_BUTT if the planes are
+ * written directly.
+ */
+static ColorFormat convertFormat(RKYuvWriter::YuvFormat format, int32_t depth)
+{
+    switch (format) {
+    case RKYuvWriter::YUV_FORMAT_RGBA8888:
+        return COLOR_FORMAT_RGBA8888;
+    case RKYuvWriter::YUV_FORMAT_BGR888:
+        return COLOR_FORMAT_BGR888;
+    case RKYuvWriter::YUV_FORMAT_NV12:
+        return (depth == 10) ? COLOR_FORMAT_NV12 : COLOR_FORMAT_BUTT;
+    case RKYuvWriter::YUV_FORMAT_I420:
+        return (depth == 10) ? COLOR_FORMAT_I420 : COLOR_FORMAT_BUTT;
+    case RKYuvWriter::YUV_FORMAT_P010:
+        return (depth == 10) ? COLOR_FORMAT_P010 : COLOR_FORMAT_BUTT;
+    case RKYuvWriter::YUV_FORMAT_I010:
+        return (depth == 10) ? COLOR_FORMAT_I010 : COLOR_FORMAT_BUTT;
+    default:
+        return COLOR_FORMAT_BUTT;
+    }
+}
+
+RKYuvWriter::RKYuvWriter()
+{
+    mFormat = YUV_FORMAT_NV12;
+    mOpened = false;
+}
+
+RKYuvWriter::~RKYuvWriter()
+{
+    close();
+}
+
+VPU_RET RKYuvWriter::open(const char *file, YuvFormat format, int32_t depth,
+                          bool directIo)
+{
+    if (mWriter.open(file, depth, directIo)) {
+        ALOGE("failed to open writer for %s", file);
+        return VPU_ERR_INIT;
+    }
+
+    mFormat = format;
+    mOpened = true;
+
+    if (format == YUV_FORMAT_RGBA8888 || format == YUV_FORMAT_BGR888)
+        return setConvertThreads(1);
+
+    return VPU_OK;
+}
+
+VPU_RET RKYuvWriter::setConvertThreads(int32_t threads)
+{
+    return mConvert.init(threads) ? VPU_ERR_INIT : VPU_OK;
+}
+
+void RKYuvWriter::setDither(bool dither)
+{
+    mConvert.setDither(dither);
+}
+
+VPU_RET RKYuvWriter::close()
+{
+    if (!mOpened)
+        return VPU_OK;
+
+    mOpened = false;
+    mConvert.deinit();
+
+    return mWriter.close() ? VPU_ERR_UNKNOW : VPU_OK;
+}
+
+/*
+ * the converted frame is a new buffer, the decoded frame is not held.
+ */
+VPU_RET RKYuvWriter::writeConvertFrame(VPU_FRAME *vframe, ColorFormat format)
+{
+    int32_t size = color_image_size(format, vframe->DisplayWidth, vframe->DisplayHeight);
+    uint8_t *buf;
+    ColorImage dst;
+
+    buf = (uint8_t *)malloc(size > 0 ? size : 1);
+    if (buf == NULL) {
+        ALOGE("failed to malloc %d bytes %s frame", size, color_format_name(format));
+        return VPU_ERR_UNKNOW;
+    }
+
+    color_image_setup(&dst, buf, format, vframe->DisplayWidth, vframe->DisplayHeight);
+    if (mConvert.convertFrame(vframe, &dst)) {
+        free(buf);
+        return VPU_ERR_UNKNOW;
+    }
+
+    if (mWriter.queueBuffer(buf, size, releaseConverted, buf)) {
+        ALOGE("failed to queue frame");
+        return VPU_ERR_UNKNOW;
+    }
+
+    return VPU_OK;
+}
+
+VPU_RET RKYuvWriter::writeFrame(const DecodedFrame &frame)
+{
+    VPU_FRAME *vframe = frame.get();
+    RKAsyncWriter::WriterPlane planes[2];
+    ColorFormat format;
+    int32_t num;
+
+    if (!mOpened || vframe == NULL || vframe->vpumem.vir_addr == NULL)
+        return VPU_ERR_UNKNOW;
+
+    format = convertFormat(mFormat, color_frame_bit_depth(vframe));
+    if (format != COLOR_FORMAT_BUTT)
+        return writeConvertFrame(vframe, format);
+
+    const uint8_t *base = (const uint8_t *)vframe->vpumem.vir_addr;
+    int32_t stride = vframe->FrameWidth;
+    int32_t width = vframe->DisplayWidth;
+    int32_t height = vframe->DisplayHeight;
+
+    if ((vframe->ColorType & VPU_OUTPUT_FORMAT_TYPE_MASK) != VPU_OUTPUT_FORMAT_YUV420_SEMIPLANAR ||
+        (vframe->ColorType & VPU_OUTPUT_FORMAT_BIT_MASK) != VPU_OUTPUT_FORMAT_BIT_8 ||
+        width <= 0 || height <= 0 || width > stride) {
+        ALOGV("color type 0x%x %dx%d(%d) not cropped, write as is",
+              vframe->ColorType, width, height, stride);
+
+        planes[0].data = base;
+        planes[0].width = vframe->vpumem.size;
+        planes[0].height = 1;
+        planes[0].stride = vframe->vpumem.size;
+        planes[0].splitUV = 0;
+        num = 1;
+    } else {
+        // luma rows, then the interleaved chroma rows under FrameHeight
+        planes[0].data = base;
+        planes[0].width = width;
+        planes[0].height = height;
+        planes[0].stride = stride;
+        planes[0].splitUV = 0;
+
+        planes[1].data = base + (size_t)stride * vframe->FrameHeight;
+        planes[1].width = (width + 1) / 2 * 2;
+        planes[1].height = (height + 1) / 2;
+        planes[1].stride = stride;
+        planes[1].splitUV = (mFormat == YUV_FORMAT_I420 || mFormat == YUV_FORMAT_I010);
+        num = 2;
+    }
+
+    // one more reference held until the writer thread is done with it
+    DecodedFrame *ref = new (std::nothrow) DecodedFrame(frame.share());
+    if (ref == NULL)
+        return VPU_ERR_UNKNOW;
+
+    if (mWriter.queuePlanes(planes, num, releaseFrame, ref)) {
+        ALOGE("failed to queue frame");
+        return VPU_ERR_UNKNOW;
+    }
+
+    return VPU_OK;
+}
+
+void RKYuvWriter::getStats(RKAsyncWriter::WriterStats *stats)
+{
+    mWriter.getStats(stats);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * author: kevin.chen@rock-chips.com
+ * module: RKYuvWriter
+ * date  : 2021/03/24
+ */
+
+#ifndef __RKVPU_YUV_WRITER_H__
+#define __RKVPU_YUV_WRITER_H__
+
+#include <stdint.h>
+
+#include "rkvpu_dec_api.h"
+#include "rkvpu_async_writer.h"
+#include "rkvpu_color_convert.h"
+
+/*
+ * Writes the visible region of decoded frames to a yuv file.
+ *
+ * The decoder output is aligned, FrameWidth x FrameHeight is the buffer
+ * stride and DisplayWidth x DisplayHeight the real picture. The writer
+ * passes only the display rows of the strided planes to RKAsyncWriter, so
+ * the dump has no green edge and can be played without cropping. The frame
+ * is held by a shared reference until the writer thread has copied it, no
+ * copy and no file io in the decode thread.
+ *
+ * RGBA8888 and BGR888 are converted by RKColorConvert in the calling
+ * thread, with the workers set by setConvertThreads. 10bit frames in the
+ * vpu compact layout are converted the same way, to P010 / I010, or down
+ * to 8bit NV12 / I420 with rounding or ordered dither.
+ */
+class RKYuvWriter
+{
+public:
+    RKYuvWriter();
+    ~RKYuvWriter();
+
+    typedef enum YuvFormat {
+        YUV_FORMAT_NV12     = 0,
+        YUV_FORMAT_I420     = 1,
+        YUV_FORMAT_RGBA8888 = 2,
+        YUV_FORMAT_BGR888   = 3,
+        YUV_FORMAT_P010     = 4,    /* 10bit frames only, 8bit ones as NV12 */
+        YUV_FORMAT_I010     = 5,    /* 10bit frames only, 8bit ones as I420 */
+    } YuvFormat;
+
+    /*
+     * @depth: frames queued to the writer thread at most
+     * @directIo: write with O_DIRECT
+     */
+    VPU_RET open(const char *file, YuvFormat format, int32_t depth,
+                 bool directIo);
+
+    /* threads converting one frame to rgb, 1 by default */
+    VPU_RET setConvertThreads(int32_t threads);
+
+    /* ordered dither when 10bit frames go down to 8bit, rounding by default */
+    void setDither(bool dither);
+
+    /* write the frames left and close the file */
+    VPU_RET close();
+
+    /*
+     * queue a NV12 frame, blocks only if the queue is full. Frames in
+     * other formats are written as is.
+     */
+    VPU_RET writeFrame(const DecodedFrame &frame);
+
+    void getStats(RKAsyncWriter::WriterStats *stats);
+
+private:
+    VPU_RET writeConvertFrame(VPU_FRAME *vframe, ColorFormat format);
+
+    RKAsyncWriter mWriter;
+    RKColorConvert mConvert;
+    YuvFormat mFormat;
+    bool mOpened;
+};
+
+#endif  // __RKVPU_YUV_WRITER_H__